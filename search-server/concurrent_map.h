@@ -1,38 +1,190 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <shared_mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "hash_functions.h"
+
 using namespace std;
 
+/**
+ * @brief Словарь для одновременной работы нескольких потоков
+ *
+ *  Пространство ключей разбито на части (по старшим битам хеша ключа), каждая
+ *  часть - хеш-таблица с открытой адресацией (линейное пробирование) под своим
+ *  shared_mutex. Ключ - любой тип с std::hash и operator==.
+ *  - operator[] возвращает Access, который держит часть заблокированной
+ *    монопольно, пока существует (как в шаблоне Synchronized);
+ *  - Add для числовых значений прибавляет к значению существующего ключа
+ *    атомарно под разделяемой блокировкой, поэтому потоки, обновляющие
+ *    ключи одной части, не ждут друг друга; монопольная блокировка нужна
+ *    только для добавления ключа;
+ *  - BuildSortedVector копирует и сортирует части параллельно, затем
+ *    сливает их попарно (тоже параллельно).
+ */
 template<typename Key, typename Value>
 class ConcurrentMap {
-
 private:
+    enum class SlotState : uint8_t {
+        EMPTY,
+        FULL,
+        DELETED,
+    };
+
+    struct Slot {
+        SlotState state = SlotState::EMPTY;
+        uint64_t hash = 0;
+        Key key { };
+        Value value { };
+    };
+
     struct Bucket {
-        mutex submap_mutex_;
-        map<Key, Value> submap_;
+        shared_mutex submap_mutex_;
+        // размер - степень двойки (или 0)
+        vector<Slot> slots_;
+        // количество ключей и количество удалённых ячеек
+        size_t size_ = 0;
+        size_t deleted_count_ = 0;
     };
 
-    vector<Bucket> buckets_;
+    unique_ptr<Bucket[]> buckets_;
+    size_t bucket_count_;
 
-public:
-    // не даст программе скомпилироваться при попытке использовать в качестве
-    // типа ключа что-либо, кроме целых чисел
-    static_assert(is_integral_v<Key>, "ConcurrentMap supports only integer keys"s);
+    static constexpr size_t MIN_SLOT_COUNT = 16;
+
+    // перемешивание битов хеша (финализатор MurmurHash3): std::hash целых
+    // чисел - само число
+    static uint64_t HashKey(const Key &key) {
+        return MixBits(hash<Key> { }(key));
+    }
+
+    Bucket& GetBucket(uint64_t key_hash) const {
+        // старшие биты хеша - номер части, младшие - ячейка в части
+        return buckets_[(key_hash >> 32) % bucket_count_];
+    }
 
+    // ячейка ключа (nullptr, если ключа нет)
+    static Slot* FindSlot(Bucket &bucket, const Key &key, uint64_t key_hash) {
+        if (bucket.slots_.empty()) {
+            return nullptr;
+        }
+        const size_t mask = bucket.slots_.size() - 1;
+        for (size_t i = key_hash & mask;; i = (i + 1) & mask) {
+            Slot &slot = bucket.slots_[i];
+            if (slot.state == SlotState::EMPTY) {
+                return nullptr;
+            }
+            if (slot.state == SlotState::FULL && slot.hash == key_hash
+                    && slot.key == key) {
+                return &slot;
+            }
+        }
+    }
+
+    // увеличивает таблицу части вдвое (или убирает удалённые ячейки)
+    static void Rehash(Bucket &bucket) {
+        size_t slot_count = max(MIN_SLOT_COUNT, bucket.slots_.size());
+        if ((bucket.size_ + 1) * 2 > slot_count) {
+            slot_count *= 2;
+        }
+        vector<Slot> slots(slot_count);
+        const size_t mask = slot_count - 1;
+        for (Slot &slot : bucket.slots_) {
+            if (slot.state == SlotState::FULL) {
+                size_t i = slot.hash & mask;
+                while (slots[i].state != SlotState::EMPTY) {
+                    i = (i + 1) & mask;
+                }
+                slots[i] = move(slot);
+            }
+        }
+        bucket.slots_ = move(slots);
+        bucket.deleted_count_ = 0;
+    }
+
+    // ячейка ключа; если ключа нет, он добавляется со значением Value()
+    static Slot& FindOrInsertSlot(Bucket &bucket, const Key &key,
+            uint64_t key_hash) {
+        if (Slot *slot = FindSlot(bucket, key, key_hash)) {
+            return *slot;
+        }
+        // заполненные и удалённые ячейки - не больше 3/4 таблицы
+        if ((bucket.size_ + bucket.deleted_count_ + 1) * 4
+                > bucket.slots_.size() * 3) {
+            Rehash(bucket);
+        }
+        const size_t mask = bucket.slots_.size() - 1;
+        size_t i = key_hash & mask;
+        while (bucket.slots_[i].state == SlotState::FULL) {
+            i = (i + 1) & mask;
+        }
+        Slot &slot = bucket.slots_[i];
+        if (slot.state == SlotState::DELETED) {
+            --bucket.deleted_count_;
+        }
+        slot.state = SlotState::FULL;
+        slot.hash = key_hash;
+        slot.key = key;
+        slot.value = Value();
+        ++bucket.size_;
+        return slot;
+    }
+
+    // атомарно прибавляет delta к значению, которое могут одновременно
+    // изменять другие потоки
+    static void AtomicAdd(Value &value, Value delta) {
+        if constexpr (is_integral_v<Value>) {
+            __atomic_fetch_add(&value, delta, __ATOMIC_RELAXED);
+        } else {
+            Value expected;
+            __atomic_load(&value, &expected, __ATOMIC_RELAXED);
+            Value desired = expected + delta;
+            while (!__atomic_compare_exchange(&value, &expected, &desired,
+                    true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                desired = expected + delta;
+            }
+        }
+    }
+
+    // значение, которое могут одновременно изменять потоки Add
+    static Value LoadValue(const Value &value) {
+        if constexpr (is_arithmetic_v<Value>) {
+            Value result;
+            __atomic_load(&value, &result, __ATOMIC_RELAXED);
+            return result;
+        } else {
+            return value;
+        }
+    }
+
+public:
     // Структура Access должна вести себя так же, как в шаблоне Synchronized:
     // предоставлять ссылку на значение словаря и обеспечивать синхронизацию доступа к нему.
     struct Access {
-        lock_guard<mutex> guard;
+        unique_lock<shared_mutex> guard;
         Value &ref_to_value;
 
-        Access(const Key &key, Bucket &bucket) :
-                guard(bucket.submap_mutex_), ref_to_value(bucket.submap_[key]) {
+        Access(const Key &key, uint64_t key_hash, Bucket &bucket) :
+                guard(bucket.submap_mutex_), ref_to_value(
+                        FindOrInsertSlot(bucket, key, key_hash).value) {
         }
     };
 
     // Конструктор класса ConcurrentMap<Key, Value> принимает количество подсловарей,
     // на которые надо разбить всё пространство ключей.
     explicit ConcurrentMap(size_t bucket_count) :
-            buckets_(bucket_count) {
+            buckets_(make_unique<Bucket[]>(max<size_t>(1, bucket_count))),
+            bucket_count_(max<size_t>(1, bucket_count)) {
     }
 
     // оператор [] ведёт себя так же, как аналогичный оператор у map:
@@ -41,31 +193,110 @@ public:
     //    - если key в словаре нет, в него надо добавить пару (key, Value()) и
     //      вернуть объект класса Access, содержащий ссылку на только что добавленное значение.
     Access operator[](const Key &key) {
-        // Ключи — целые числа. Операция взятия остатка от деления поможет выбрать, в подсловаре
-        // с каким индексом хранить данный ключ.
-        // Чтобы не мучиться с отрицательными числами, предварительно приведём ключ к типу uint64_t.
-        auto &bucket = buckets_[static_cast<uint64_t>(key) % buckets_.size()];
-        return {key, bucket};
+        const uint64_t key_hash = HashKey(key);
+        return {key, key_hash, GetBucket(key_hash)};
+    }
+
+    // прибавляет delta к значению ключа (ключа нет - добавляет его со
+    // значением delta). Значение существующего ключа изменяется атомарно
+    // под разделяемой блокировкой части
+    void Add(const Key &key, Value delta) {
+        static_assert(is_arithmetic_v<Value>,
+                "ConcurrentMap::Add supports only arithmetic values");
+        const uint64_t key_hash = HashKey(key);
+        Bucket &bucket = GetBucket(key_hash);
+        {
+            shared_lock guard(bucket.submap_mutex_);
+            if (Slot *slot = FindSlot(bucket, key, key_hash)) {
+                AtomicAdd(slot->value, delta);
+                return;
+            }
+        }
+        lock_guard guard(bucket.submap_mutex_);
+        FindOrInsertSlot(bucket, key, key_hash).value += delta;
     }
 
     // оператор erase
     void erase(const Key &key) {
-        lock_guard < mutex
-                > guard(
-                        buckets_[static_cast<uint64_t>(key) % buckets_.size()].submap_mutex_);
-        buckets_[static_cast<uint64_t>(key) % buckets_.size()].submap_.erase(
-                key);
+        const uint64_t key_hash = HashKey(key);
+        Bucket &bucket = GetBucket(key_hash);
+        lock_guard guard(bucket.submap_mutex_);
+        if (Slot *slot = FindSlot(bucket, key, key_hash)) {
+            slot->state = SlotState::DELETED;
+            slot->key = Key();
+            slot->value = Value();
+            --bucket.size_;
+            ++bucket.deleted_count_;
+        }
+    }
+
+    // пары (ключ, значение) всех частей, упорядоченные по ключу. Каждая
+    // часть копируется под своей разделяемой блокировкой (одновременно
+    // с другими операциями), поэтому результат - согласованный снимок
+    // каждой части, но не всего словаря в один момент
+    vector<pair<Key, Value>> BuildSortedVector() const {
+        vector<vector<pair<Key, Value>>> parts(bucket_count_);
+        vector<size_t> indexes(bucket_count_);
+        iota(indexes.begin(), indexes.end(), 0);
+        for_each(execution::par, indexes.begin(), indexes.end(),
+                [this, &parts](size_t index) {
+                    Bucket &bucket = buckets_[index];
+                    vector<pair<Key, Value>> &part = parts[index];
+                    {
+                        shared_lock guard(bucket.submap_mutex_);
+                        part.reserve(bucket.size_);
+                        for (const Slot &slot : bucket.slots_) {
+                            if (slot.state == SlotState::FULL) {
+                                part.emplace_back(slot.key,
+                                        LoadValue(slot.value));
+                            }
+                        }
+                    }
+                    sort(part.begin(), part.end(), [](const auto &lhs,
+                            const auto &rhs) {
+                        return lhs.first < rhs.first;
+                    });
+                });
+
+        // части подряд в одном массиве, part_ends[i] - конец части i
+        vector<size_t> part_ends(bucket_count_ + 1, 0);
+        for (size_t i = 0; i < bucket_count_; ++i) {
+            part_ends[i + 1] = part_ends[i] + parts[i].size();
+        }
+        vector<pair<Key, Value>> result;
+        result.reserve(part_ends.back());
+        for (auto &part : parts) {
+            move(part.begin(), part.end(), back_inserter(result));
+        }
+
+        // попарное слияние соседних групп частей: ширина группы удваивается
+        for (size_t width = 1; width < bucket_count_; width *= 2) {
+            vector<size_t> firsts;
+            for (size_t first = 0; first + width < bucket_count_;
+                    first += 2 * width) {
+                firsts.push_back(first);
+            }
+            for_each(execution::par, firsts.begin(), firsts.end(),
+                    [&result, &part_ends, width, this](size_t first) {
+                        const size_t last = min(first + 2 * width,
+                                bucket_count_);
+                        inplace_merge(result.begin() + part_ends[first],
+                                result.begin() + part_ends[first + width],
+                                result.begin() + part_ends[last],
+                                [](const auto &lhs, const auto &rhs) {
+                                    return lhs.first < rhs.first;
+                                });
+                    });
+        }
+        return result;
     }
 
     // Метод BuildOrdinaryMap сливает вместе части словаря и возвращать весь словарь целиком.
     // При этом он потокобезопасным, то есть корректно работает, когда другие потоки
     // выполняют операции с ConcurrentMap.
-    map<Key, Value> BuildOrdinaryMap() {
-        map<Key, Value> result;
-        for (auto& [submap_mutex, submap] : buckets_) {
-            lock_guard guard(submap_mutex);
-            result.insert(submap.begin(), submap.end());
-        }
-        return result;
+    map<Key, Value> BuildOrdinaryMap() const {
+        const vector<pair<Key, Value>> items = BuildSortedVector();
+        // элементы упорядочены, поэтому каждая вставка с подсказкой - O(1)
+        return map<Key, Value>(items.begin(), items.end());
     }
 };
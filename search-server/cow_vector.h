@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Массив, данные которого лежат в собственном vector или в чужой памяти
+ *
+ *  Чужая память - файл снапшота, отображённый в память (см. snapshot.h):
+ *  такой массив только ссылается на данные и ничего не копирует.
+ *  Чтение одинаково для обоих случаев, а для изменения нужно получить vector
+ *  через Modify: при первом изменении данные копируются в собственную память
+ *  (copy-on-write). Чужая память должна жить дольше массива и всех его копий.
+ */
+template<typename T>
+class CowVector {
+    static_assert(is_trivially_copyable_v<T>,
+            "CowVector может ссылаться только на тривиально копируемые данные");
+
+public:
+    CowVector() = default;
+    CowVector(vector<T> values) :
+            owned_(move(values)) {
+    }
+
+    // массив, ссылающийся на size элементов в чужой памяти
+    static CowVector View(const T *data, size_t size) {
+        CowVector result;
+        result.view_ = size > 0 ? data : nullptr;
+        result.view_size_ = size;
+        return result;
+    }
+
+    const T* data() const {
+        return view_ ? view_ : owned_.data();
+    }
+    size_t size() const {
+        return view_ ? view_size_ : owned_.size();
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+
+    const T& operator[](size_t index) const {
+        return data()[index];
+    }
+    const T& front() const {
+        return data()[0];
+    }
+    const T& back() const {
+        return data()[size() - 1];
+    }
+
+    const T* begin() const {
+        return data();
+    }
+    const T* end() const {
+        return data() + size();
+    }
+
+    // объём собственной памяти (в элементах)
+    size_t capacity() const {
+        return owned_.capacity();
+    }
+
+    // данные для изменения (данные из чужой памяти сначала копируются)
+    vector<T>& Modify() {
+        if (view_) {
+            owned_.assign(view_, view_ + view_size_);
+            view_ = nullptr;
+            view_size_ = 0;
+        }
+        return owned_;
+    }
+
+private:
+    const T *view_ = nullptr;
+    size_t view_size_ = 0;
+    vector<T> owned_;
+};
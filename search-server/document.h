@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 
 const double MIN_DELTA_RELEVANCE = 1e-6;
@@ -35,3 +36,6 @@ enum class DocumentStatus {
     BANNED,      // запрещённые
     REMOVED,     // удалённые
 };
+
+// внутренний (плотный) номер документа в поисковом сервере: 0, 1, 2, ...
+using DocumentOrdinal = uint32_t;
@@ -0,0 +1,97 @@
+#include <algorithm>
+
+#include "document_filter.h"
+
+using namespace std;
+
+DocumentFilterIndex::DocumentFilterIndex(const DocumentFilterIndex &other) {
+    Assign(other);
+}
+
+DocumentFilterIndex& DocumentFilterIndex::operator=(
+        const DocumentFilterIndex &other) {
+    if (this != &other) {
+        Assign(other);
+    }
+    return *this;
+}
+
+DocumentFilterIndex::DocumentFilterIndex(DocumentFilterIndex &&other) {
+    *this = move(other);
+}
+
+/**
+ * @brief Перемещение индекса
+ *
+ *  Мьютекс не перемещается, поэтому поля переносятся по одному.
+ */
+DocumentFilterIndex& DocumentFilterIndex::operator=(
+        DocumentFilterIndex &&other) {
+    if (this != &other) {
+        status_bitmaps_ = move(other.status_bitmaps_);
+        rating_order_ = move(other.rating_order_);
+        indexed_count_.store(other.indexed_count_.load());
+        other.status_bitmaps_ = { };
+        other.indexed_count_.store(0);
+    }
+    return *this;
+}
+
+void DocumentFilterIndex::Assign(const DocumentFilterIndex &other) {
+    lock_guard lock(other.update_mutex_);
+    status_bitmaps_ = other.status_bitmaps_;
+    rating_order_ = other.rating_order_;
+    indexed_count_.store(other.indexed_count_.load());
+}
+
+/**
+ * @brief Дополняет индекс документами, добавленными после предыдущего
+ *        обновления
+ *
+ *  Биты новых документов дописываются в битовые карты статусов, пары новых
+ *  документов сортируются и сливаются с уже упорядоченными (O(n) на
+ *  обновление).
+ *
+ * @param documents Хранилище документов
+ */
+void DocumentFilterIndex::Update(const DocumentStore &documents) const {
+    const size_t ordinal_count = documents.GetOrdinalCount();
+    if (indexed_count_.load(memory_order_acquire) == ordinal_count) {
+        return;
+    }
+    lock_guard lock(update_mutex_);
+    const size_t indexed_count = indexed_count_.load(memory_order_relaxed);
+    if (indexed_count == ordinal_count) {
+        return;
+    }
+
+    for (vector<uint64_t> &bitmap : status_bitmaps_) {
+        bitmap.resize((ordinal_count + 63) / 64, 0);
+    }
+    const size_t old_size = rating_order_.size();
+    for (size_t ordinal = indexed_count; ordinal < ordinal_count; ++ordinal) {
+        const DocumentOrdinal document = static_cast<DocumentOrdinal>(ordinal);
+        vector<uint64_t> &bitmap = status_bitmaps_[static_cast<size_t>(
+                documents.GetStatus(document))];
+        bitmap[ordinal / 64] |= uint64_t(1) << (ordinal % 64);
+        rating_order_.emplace_back(documents.GetRating(document), document);
+    }
+    sort(rating_order_.begin() + old_size, rating_order_.end());
+    inplace_merge(rating_order_.begin(), rating_order_.begin() + old_size,
+            rating_order_.end());
+    indexed_count_.store(ordinal_count, memory_order_release);
+}
+
+void DocumentFilterIndex::SelectRatingRange(int min_rating, int max_rating,
+        vector<uint64_t> &bitmap) const {
+    if (min_rating > max_rating) {
+        return;
+    }
+    const auto first = lower_bound(rating_order_.begin(), rating_order_.end(),
+            pair { min_rating, DocumentOrdinal(0) });
+    const auto last = upper_bound(first, rating_order_.end(),
+            pair { max_rating, DocumentStore::NO_DOCUMENT });
+    for (auto it = first; it != last; ++it) {
+        bitmap[it->second / 64] |= uint64_t(1) << (it->second % 64);
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "document.h"
+#include "document_store.h"
+
+using namespace std;
+
+// количество значений DocumentStatus
+constexpr size_t DOCUMENT_STATUS_COUNT =
+        static_cast<size_t>(DocumentStatus::REMOVED) + 1;
+
+/**
+ * @brief Критерий поиска, который сервер проверяет по своим индексам
+ *
+ *  Статус и диапазон рейтинга проверяются по битовой карте документов,
+ *  построенной один раз для запроса (DocumentFilterIndex), а не вызовом
+ *  функции для каждого найденного документа. Произвольный критерий
+ *  (SetResidual) проверяется только для документов, прошедших остальные
+ *  условия (медленный путь).
+ */
+class DocumentFilter {
+public:
+    using Residual = function<bool(int document_id, DocumentStatus status,
+            int rating)>;
+
+    // все документы
+    DocumentFilter() = default;
+    // документы со статусом status
+    explicit DocumentFilter(DocumentStatus status) :
+            status_(status) {
+    }
+
+    DocumentFilter& SetStatus(DocumentStatus status) {
+        status_ = status;
+        return *this;
+    }
+    // документы с рейтингом из [min_rating, max_rating]
+    DocumentFilter& SetRatingRange(int min_rating, int max_rating) {
+        min_rating_ = min_rating;
+        max_rating_ = max_rating;
+        return *this;
+    }
+    DocumentFilter& SetResidual(Residual residual) {
+        residual_ = move(residual);
+        return *this;
+    }
+
+    const optional<DocumentStatus>& GetStatus() const {
+        return status_;
+    }
+    int GetMinRating() const {
+        return min_rating_;
+    }
+    int GetMaxRating() const {
+        return max_rating_;
+    }
+    bool HasRatingRange() const {
+        return min_rating_ != numeric_limits<int>::min()
+                || max_rating_ != numeric_limits<int>::max();
+    }
+    const Residual& GetResidual() const {
+        return residual_;
+    }
+
+private:
+    optional<DocumentStatus> status_;
+    int min_rating_ = numeric_limits<int>::min();
+    int max_rating_ = numeric_limits<int>::max();
+    Residual residual_;
+};
+
+/**
+ * @brief Индексы документов для DocumentFilter
+ *
+ *  - битовая карта документов каждого статуса (бит - внутренний номер);
+ *  - пары {рейтинг, внутренний номер}, упорядоченные по рейтингу: документы
+ *    диапазона рейтинга - непрерывный участок, который находится двоичным
+ *    поиском.
+ *  Статус и рейтинг документа не изменяются, а внутренние номера выдаются
+ *  по возрастанию, поэтому индекс только дополняется: Update добавляет
+ *  документы, появившиеся после предыдущего обновления (при первом запросе
+ *  с фильтром после изменений, как таблица IDF). Удалённые документы
+ *  остаются в индексе, их исключает поиск.
+ */
+class DocumentFilterIndex {
+public:
+    DocumentFilterIndex() = default;
+    DocumentFilterIndex(const DocumentFilterIndex &other);
+    DocumentFilterIndex& operator=(const DocumentFilterIndex &other);
+    DocumentFilterIndex(DocumentFilterIndex &&other);
+    DocumentFilterIndex& operator=(DocumentFilterIndex &&other);
+
+    // дополняет индекс документами хранилища (безопасно вызывать из
+    // нескольких потоков поиска одновременно)
+    void Update(const DocumentStore &documents) const;
+
+    // битовая карта документов со статусом status
+    const vector<uint64_t>& GetStatusBitmap(DocumentStatus status) const {
+        return status_bitmaps_[static_cast<size_t>(status)];
+    }
+
+    // отмечает в bitmap документы с рейтингом из [min_rating, max_rating]
+    void SelectRatingRange(int min_rating, int max_rating,
+            vector<uint64_t> &bitmap) const;
+
+private:
+    mutable mutex update_mutex_;
+    // количество проиндексированных документов (внутренние номера
+    // [0, indexed_count_))
+    mutable atomic<size_t> indexed_count_ { 0 };
+    mutable array<vector<uint64_t>, DOCUMENT_STATUS_COUNT> status_bitmaps_;
+    mutable vector<pair<int, DocumentOrdinal>> rating_order_;
+
+    void Assign(const DocumentFilterIndex &other);
+};
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "document_store.h"
+
+using namespace std;
+
+namespace {
+
+// сливает пары буфера с отсортированным по id массивом пар
+void MergeIds(const DocumentStore::PendingIds &pending_ids,
+        vector<DocumentStore::IdOrdinal> &id_to_ordinal) {
+    const size_t old_size = id_to_ordinal.size();
+    for (const auto [document_id, ordinal] : pending_ids) {
+        id_to_ordinal.push_back( { document_id, ordinal });
+    }
+    inplace_merge(id_to_ordinal.begin(), id_to_ordinal.begin() + old_size,
+            id_to_ordinal.end(),
+            [](const DocumentStore::IdOrdinal &lhs,
+                    const DocumentStore::IdOrdinal &rhs) {
+                return lhs.id < rhs.id;
+            });
+}
+
+}  // namespace
+
+/**
+ * @brief Добавляет документ в хранилище
+ *
+ *  Документы обычно добавляются в порядке возрастания id, тогда пара
+ *  {id, внутренний номер} просто дописывается в конец. Иначе пара заносится
+ *  в буфер, который сливается с массивом, когда превышает 1/8 его размера
+ *  (не меньше MIN_PENDING_ID_MERGE пар).
+ *
+ * @param document_id id документа
+ * @param rating      Ср.рейтинг документа
+ * @param status      Статус документа
+ * @param word_count  Количество слов документа (без стоп-слов)
+ * @return Внутренний номер документа
+ */
+DocumentOrdinal DocumentStore::Add(int document_id, int rating,
+        DocumentStatus status, size_t word_count) {
+    const DocumentOrdinal ordinal = static_cast<DocumentOrdinal>(ids_.size());
+    ids_.Modify().push_back(document_id);
+    ratings_.Modify().push_back(rating);
+    statuses_.Modify().push_back(status);
+    inverse_word_counts_.Modify().push_back(1.0 / word_count);
+    if (ordinal % 64 == 0) {
+        removed_.push_back(0);
+    }
+
+    if (id_to_ordinal_.empty() || id_to_ordinal_.back().id < document_id) {
+        id_to_ordinal_.Modify().push_back( { document_id, ordinal });
+        return ordinal;
+    }
+    const IdOrdinal *it = LowerBound(document_id);
+    if (it != id_to_ordinal_.end() && it->id == document_id) {
+        // пара удалённого документа с тем же id (до Compact)
+        id_to_ordinal_.Modify()[it - id_to_ordinal_.begin()].ordinal = ordinal;
+        --removed_count_;
+        return ordinal;
+    }
+    const auto [pending_it, is_inserted] = pending_ids_.emplace(document_id,
+            ordinal);
+    if (!is_inserted) {
+        pending_it->second = ordinal;
+        --removed_count_;
+    } else if (pending_ids_.size() >= MIN_PENDING_ID_MERGE
+            && pending_ids_.size() * 8 >= id_to_ordinal_.size()) {
+        MergePendingIds();
+    }
+    return ordinal;
+}
+
+/**
+ * @brief Отмечает документ удалённым
+ *
+ *  Внутренний номер удалённого документа повторно не выдаётся. Массив пар
+ *  {id, внутренний номер} не изменяется (см. Compact).
+ *
+ * @param document_id id документа
+ * @return Внутренний номер удалённого документа или NO_DOCUMENT
+ */
+DocumentOrdinal DocumentStore::Remove(int document_id) {
+    const DocumentOrdinal ordinal = Find(document_id);
+    if (ordinal != NO_DOCUMENT) {
+        MarkRemoved(ordinal);
+    }
+    return ordinal;
+}
+
+/**
+ * @brief Отмечает пакет документов удалёнными
+ *
+ * @param document_ids id документов
+ * @return Внутренние номера удалённых документов (по возрастанию id)
+ */
+vector<DocumentOrdinal> DocumentStore::Remove(vector<int> document_ids) {
+    sort(document_ids.begin(), document_ids.end());
+    document_ids.erase(unique(document_ids.begin(), document_ids.end()),
+            document_ids.end());
+    vector<DocumentOrdinal> ordinals;
+    for (const int document_id : document_ids) {
+        const DocumentOrdinal ordinal = Remove(document_id);
+        if (ordinal != NO_DOCUMENT) {
+            ordinals.push_back(ordinal);
+        }
+    }
+    return ordinals;
+}
+
+void DocumentStore::Compact() {
+    MergePendingIds();
+    if (removed_count_ == 0) {
+        return;
+    }
+    vector<IdOrdinal> &id_to_ordinal = id_to_ordinal_.Modify();
+    id_to_ordinal.erase(remove_if(id_to_ordinal.begin(), id_to_ordinal.end(),
+            [this](const IdOrdinal &item) {
+                return IsRemoved(item.ordinal);
+            }), id_to_ordinal.end());
+    removed_count_ = 0;
+}
+
+DocumentOrdinal DocumentStore::Find(int document_id) const {
+    DocumentOrdinal ordinal = NO_DOCUMENT;
+    const IdOrdinal *it = LowerBound(document_id);
+    if (it != id_to_ordinal_.end() && it->id == document_id) {
+        ordinal = it->ordinal;
+    } else if (!pending_ids_.empty()) {
+        const auto pending_it = pending_ids_.find(document_id);
+        if (pending_it != pending_ids_.end()) {
+            ordinal = pending_it->second;
+        }
+    }
+    return ordinal == NO_DOCUMENT || IsRemoved(ordinal) ? NO_DOCUMENT : ordinal;
+}
+
+void DocumentStore::MarkRemoved(DocumentOrdinal ordinal) {
+    removed_[ordinal / 64] |= uint64_t(1) << (ordinal % 64);
+    ++removed_count_;
+}
+
+/**
+ * @brief Сливает буфер пар с массивом пар за один проход
+ */
+void DocumentStore::MergePendingIds() {
+    if (pending_ids_.empty()) {
+        return;
+    }
+    MergeIds(pending_ids_, id_to_ordinal_.Modify());
+    pending_ids_.clear();
+}
+
+void DocumentStore::SaveSnapshot(SnapshotWriter &writer) const {
+    writer.WriteSection(SnapshotSection::DOCUMENT_IDS, ids_);
+    writer.WriteSection(SnapshotSection::DOCUMENT_RATINGS, ratings_);
+    writer.WriteSection(SnapshotSection::DOCUMENT_STATUSES, statuses_);
+    writer.WriteSection(SnapshotSection::DOCUMENT_INVERSE_WORD_COUNTS,
+            inverse_word_counts_);
+    if (pending_ids_.empty()) {
+        writer.WriteSection(SnapshotSection::DOCUMENT_ID_TO_ORDINAL,
+                id_to_ordinal_);
+        return;
+    }
+    // в снапшот записывается массив пар, слитый с буфером
+    vector<IdOrdinal> id_to_ordinal(id_to_ordinal_.begin(),
+            id_to_ordinal_.end());
+    MergeIds(pending_ids_, id_to_ordinal);
+    writer.WriteSection(SnapshotSection::DOCUMENT_ID_TO_ORDINAL,
+            id_to_ordinal);
+}
+
+DocumentStore DocumentStore::OpenSnapshot(const SnapshotReader &reader) {
+    DocumentStore store;
+    store.ids_ = reader.GetSection<int>(SnapshotSection::DOCUMENT_IDS);
+    store.ratings_ = reader.GetSection<int>(SnapshotSection::DOCUMENT_RATINGS);
+    store.statuses_ = reader.GetSection<DocumentStatus>(
+            SnapshotSection::DOCUMENT_STATUSES);
+    store.inverse_word_counts_ = reader.GetSection<double>(
+            SnapshotSection::DOCUMENT_INVERSE_WORD_COUNTS);
+    store.id_to_ordinal_ = reader.GetSection<IdOrdinal>(
+            SnapshotSection::DOCUMENT_ID_TO_ORDINAL);
+    const size_t ordinal_count = store.ids_.size();
+    store.removed_.assign((ordinal_count + 63) / 64, 0);
+    if (store.ratings_.size() != ordinal_count
+            || store.statuses_.size() != ordinal_count
+            || store.inverse_word_counts_.size() != ordinal_count
+            || store.id_to_ordinal_.size() > ordinal_count) {
+        throw runtime_error("неверный формат документов в снапшоте"s);
+    }
+    return store;
+}
+
+const DocumentStore::IdOrdinal* DocumentStore::LowerBound(
+        int document_id) const {
+    return lower_bound(id_to_ordinal_.begin(), id_to_ordinal_.end(),
+            document_id, [](const IdOrdinal &item, int id) {
+                return item.id < id;
+            });
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <vector>
+
+#include "cow_vector.h"
+#include "document.h"
+#include "snapshot.h"
+
+using namespace std;
+
+/**
+ * @brief Хранилище данных документов поискового сервера
+ *
+ *  Каждый документ при добавлении получает внутренний номер (DocumentOrdinal),
+ *  номера выдаются подряд. Данные документов хранятся по столбцам: в массивах,
+ *  индексируемых внутренним номером, поэтому получение рейтинга или статуса
+ *  документа - чтение элемента массива.
+ *  Соответствие id документа -> внутренний номер хранится в отсортированном
+ *  по id массиве пар (8 байт на документ), он же задаёт порядок обхода
+ *  id документов. Документ, id которого меньше последнего id массива,
+ *  попадает в упорядоченный буфер (map); буфер сливается с массивом за один
+ *  проход, когда становится больше 1/8 массива, поэтому добавление
+ *  документов с id в произвольном порядке стоит O(log N) в среднем, а не
+ *  сдвиг массива. Поиск и обход id просматривают массив и буфер.
+ *  Удаление документа только отмечает его внутренний номер в битовой карте
+ *  удалённых документов (пара {id, номер} остаётся в массиве, но документ
+ *  больше не находится и не обходится); отмеченные пары удаляются из массива
+ *  пакетом (Compact). Внутренние номера не переиспользуются и не
+ *  перенумеровываются, поэтому элементы столбцов и бит удалённого документа
+ *  остаются в хранилище (около 20 байт на документ) до его пересоздания.
+ *  Хранилище, открытое из снапшота, читает столбцы прямо из отображённого файла.
+ */
+class DocumentStore {
+public:
+    // номер отсутствующего документа
+    static constexpr DocumentOrdinal NO_DOCUMENT = numeric_limits<
+            DocumentOrdinal>::max();
+
+    // пара {id документа, внутренний номер}
+    struct IdOrdinal {
+        int id;
+        DocumentOrdinal ordinal;
+    };
+
+    // пары, добавленные не по возрастанию id (id -> внутренний номер)
+    using PendingIds = map<int, DocumentOrdinal>;
+
+    // итератор по id документов (в порядке возрастания id), пропускающий
+    // удалённые документы: сливает массив пар и буфер
+    class IdIterator {
+    public:
+        using Base = const IdOrdinal*;
+        using PendingBase = PendingIds::const_iterator;
+        using iterator_category = forward_iterator_tag;
+        using value_type = int;
+        using difference_type = ptrdiff_t;
+        using pointer = const int*;
+        using reference = const int&;
+
+        IdIterator(Base it, Base end, PendingBase pending_it,
+                PendingBase pending_end, const DocumentStore &store) :
+                it_(it), end_(end), pending_it_(pending_it),
+                pending_end_(pending_end), store_(&store) {
+            SkipRemoved();
+        }
+
+        const int& operator*() const {
+            return IsPendingCurrent() ? pending_it_->first : it_->id;
+        }
+        IdIterator& operator++() {
+            Advance();
+            SkipRemoved();
+            return *this;
+        }
+        IdIterator operator++(int) {
+            IdIterator old = *this;
+            ++*this;
+            return old;
+        }
+        bool operator==(const IdIterator &other) const {
+            return it_ == other.it_ && pending_it_ == other.pending_it_;
+        }
+        bool operator!=(const IdIterator &other) const {
+            return !(*this == other);
+        }
+
+    private:
+        Base it_;
+        Base end_;
+        PendingBase pending_it_;
+        PendingBase pending_end_;
+        const DocumentStore *store_;
+
+        // текущий id - из буфера
+        bool IsPendingCurrent() const {
+            return pending_it_ != pending_end_
+                    && (it_ == end_ || pending_it_->first < it_->id);
+        }
+        void Advance() {
+            if (IsPendingCurrent()) {
+                ++pending_it_;
+            } else {
+                ++it_;
+            }
+        }
+        void SkipRemoved() {
+            while ((it_ != end_ || pending_it_ != pending_end_)
+                    && store_->IsRemoved(IsPendingCurrent() ?
+                            pending_it_->second : it_->ordinal)) {
+                Advance();
+            }
+        }
+    };
+
+    // добавляет документ и возвращает его внутренний номер
+    // (документа с таким id ещё не должно быть в хранилище)
+    DocumentOrdinal Add(int document_id, int rating, DocumentStatus status,
+            size_t word_count);
+
+    // отмечает документ удалённым и возвращает его внутренний номер
+    // (или NO_DOCUMENT)
+    DocumentOrdinal Remove(int document_id);
+    // отмечает документы удалёнными и возвращает их внутренние номера
+    // (id, которых нет в хранилище, пропускаются)
+    vector<DocumentOrdinal> Remove(vector<int> document_ids);
+
+    // сливает буфер с массивом пар и удаляет из соответствия
+    // id -> внутренний номер пары удалённых документов (за один проход)
+    void Compact();
+
+    // количество удалённых документов, пары которых ещё не удалены Compact
+    size_t GetRemovedCount() const {
+        return removed_count_;
+    }
+
+    bool IsRemoved(DocumentOrdinal ordinal) const {
+        return (removed_[ordinal / 64] >> (ordinal % 64)) & 1;
+    }
+
+    // возвращает внутренний номер документа (или NO_DOCUMENT)
+    DocumentOrdinal Find(int document_id) const;
+
+    int GetId(DocumentOrdinal ordinal) const {
+        return ids_[ordinal];
+    }
+    int GetRating(DocumentOrdinal ordinal) const {
+        return ratings_[ordinal];
+    }
+    DocumentStatus GetStatus(DocumentOrdinal ordinal) const {
+        return statuses_[ordinal];
+    }
+    // TF слова, входящего в документ term_count раз
+    double GetTermFreq(DocumentOrdinal ordinal, uint32_t term_count) const {
+        return term_count * inverse_word_counts_[ordinal];
+    }
+
+    // количество документов в хранилище
+    size_t size() const {
+        return id_to_ordinal_.size() + pending_ids_.size() - removed_count_;
+    }
+
+    // количество выданных внутренних номеров (включая номера удалённых документов)
+    size_t GetOrdinalCount() const {
+        return ids_.size();
+    }
+
+    IdIterator begin() const {
+        return IdIterator(id_to_ordinal_.begin(), id_to_ordinal_.end(),
+                pending_ids_.begin(), pending_ids_.end(), *this);
+    }
+    IdIterator end() const {
+        return IdIterator(id_to_ordinal_.end(), id_to_ordinal_.end(),
+                pending_ids_.end(), pending_ids_.end(), *this);
+    }
+
+    // записывает хранилище в снапшот
+    void SaveSnapshot(SnapshotWriter &writer) const;
+    // открывает хранилище из снапшота (без копирования столбцов); в снапшоте
+    // не должно быть удалённых документов, пары которых не удалены Compact
+    static DocumentStore OpenSnapshot(const SnapshotReader &reader);
+
+private:
+    // минимальный размер буфера пар, при котором он сливается с массивом
+    static constexpr size_t MIN_PENDING_ID_MERGE = 1024;
+
+    // столбцы данных документов (индекс - внутренний номер документа)
+    CowVector<int> ids_;
+    CowVector<int> ratings_;
+    CowVector<DocumentStatus> statuses_;
+    CowVector<double> inverse_word_counts_;  // 1 / количество слов документа
+
+    // пары {id документа, внутренний номер}, отсортированные по id
+    // (в том числе пары удалённых документов до Compact)
+    CowVector<IdOrdinal> id_to_ordinal_;
+    // пары, ещё не слитые с id_to_ordinal_ (id не пересекаются)
+    PendingIds pending_ids_;
+
+    // битовая карта удалённых документов (бит - внутренний номер)
+    vector<uint64_t> removed_;
+    // количество пар удалённых документов в id_to_ordinal_
+    size_t removed_count_ = 0;
+
+    // отмечает документ пары удалённым
+    void MarkRemoved(DocumentOrdinal ordinal);
+
+    // сливает буфер с массивом пар
+    void MergePendingIds();
+
+    const IdOrdinal* LowerBound(int document_id) const;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+using namespace std;
+
+// Хеш-функции индекса: constexpr, поэтому ими пользуются и таблицы,
+// которые строятся при компиляции (StaticStopWords)
+
+// начальное значение FNV-1a
+constexpr uint64_t FNV1A_BASIS = 14695981039346656037ull;
+// шаг, которым из одного значения получают разные хеши (2^64 / золотое
+// сечение)
+constexpr uint64_t GOLDEN_RATIO_STEP = 0x9E3779B97F4A7C15ull;
+
+/**
+ * @brief FNV-1a
+ *
+ * @param data Байты
+ * @param hash Хеш предыдущих байтов (чтобы хешировать данные по частям)
+ * @return Хеш
+ */
+constexpr uint64_t HashFnv1a(string_view data, uint64_t hash = FNV1A_BASIS) {
+    for (const char c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// перемешивание битов (финализатор MurmurHash3)
+constexpr uint64_t MixBits(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+    return value;
+}
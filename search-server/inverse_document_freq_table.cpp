@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cmath>
+
+#include "inverse_document_freq_table.h"
+
+using namespace std;
+
+InverseDocumentFreqTable::InverseDocumentFreqTable(
+        const InverseDocumentFreqTable &other) {
+    Assign(other);
+}
+
+InverseDocumentFreqTable& InverseDocumentFreqTable::operator=(
+        const InverseDocumentFreqTable &other) {
+    if (this != &other) {
+        Assign(other);
+    }
+    return *this;
+}
+
+InverseDocumentFreqTable::InverseDocumentFreqTable(
+        InverseDocumentFreqTable &&other) {
+    *this = move(other);
+}
+
+/**
+ * @brief Перемещение таблицы
+ *
+ *  Мьютекс не перемещается, поэтому поля переносятся по одному.
+ */
+InverseDocumentFreqTable& InverseDocumentFreqTable::operator=(
+        InverseDocumentFreqTable &&other) {
+    if (this != &other) {
+        tolerance_ = other.tolerance_;
+        log_document_freqs_ = move(other.log_document_freqs_);
+        document_count_ = other.document_count_;
+        log_document_count_ = other.log_document_count_;
+        changed_terms_ = move(other.changed_terms_);
+        is_changed_ = move(other.is_changed_);
+        is_actual_.store(other.is_actual_.load());
+        other.is_actual_.store(false);
+    }
+    return *this;
+}
+
+void InverseDocumentFreqTable::Assign(const InverseDocumentFreqTable &other) {
+    lock_guard lock(other.update_mutex_);
+    tolerance_ = other.tolerance_;
+    log_document_freqs_ = other.log_document_freqs_;
+    document_count_ = other.document_count_;
+    log_document_count_ = other.log_document_count_;
+    changed_terms_ = other.changed_terms_;
+    is_changed_ = other.is_changed_;
+    is_actual_.store(other.is_actual_.load());
+}
+
+void InverseDocumentFreqTable::SetTolerance(double tolerance) {
+    tolerance_ = max(0.0, tolerance);
+    is_actual_.store(false);
+}
+
+void InverseDocumentFreqTable::MarkTermChanged(TermId term_id) {
+    if (term_id >= is_changed_.size()) {
+        is_changed_.resize(term_id + 1, false);
+    }
+    if (!is_changed_[term_id]) {
+        is_changed_[term_id] = true;
+        changed_terms_.push_back(term_id);
+    }
+    is_actual_.store(false, memory_order_relaxed);
+}
+
+/**
+ * @brief Обновляет таблицу после изменений документов
+ *
+ * @param postings       Списки документов слов (по идентификатору слова)
+ * @param removed_counts Количество записей удалённых документов, ещё
+ *                       остающихся в списках (по идентификатору слова;
+ *                       слов за концом массива - 0)
+ * @param document_count Количество документов
+ */
+void InverseDocumentFreqTable::Update(const vector<PostingList> &postings,
+        const vector<uint32_t> &removed_counts, size_t document_count) const {
+    if (is_actual_.load(memory_order_acquire)) {
+        return;
+    }
+    lock_guard lock(update_mutex_);
+    if (is_actual_.load(memory_order_relaxed)) {
+        return;
+    }
+
+    const double drift = abs(static_cast<double>(document_count)
+            - static_cast<double>(document_count_));
+    if (document_count_ == 0 || drift > tolerance_ * document_count_) {
+        SetDocumentCount(document_count);
+    }
+    // новые слова и слова с изменившимися списками
+    const size_t old_size = log_document_freqs_.size();
+    log_document_freqs_.resize(postings.size());
+    for (size_t term_id = old_size; term_id < postings.size(); ++term_id) {
+        log_document_freqs_[term_id] = ComputeLogDocumentFreq(postings,
+                removed_counts, term_id);
+    }
+    for (const TermId term_id : changed_terms_) {
+        if (term_id < old_size) {
+            log_document_freqs_[term_id] = ComputeLogDocumentFreq(postings,
+                    removed_counts, term_id);
+        }
+        is_changed_[term_id] = false;
+    }
+    changed_terms_.clear();
+    is_actual_.store(true, memory_order_release);
+}
+
+void InverseDocumentFreqTable::Refresh(const vector<PostingList> &postings,
+        const vector<uint32_t> &removed_counts, size_t document_count) {
+    lock_guard lock(update_mutex_);
+    RefreshAll(postings, removed_counts, document_count);
+    is_actual_.store(true, memory_order_release);
+}
+
+void InverseDocumentFreqTable::RefreshAll(const vector<PostingList> &postings,
+        const vector<uint32_t> &removed_counts, size_t document_count) const {
+    log_document_freqs_.resize(postings.size());
+    for (size_t term_id = 0; term_id < postings.size(); ++term_id) {
+        log_document_freqs_[term_id] = ComputeLogDocumentFreq(postings,
+                removed_counts, term_id);
+    }
+    SetDocumentCount(document_count);
+    for (const TermId term_id : changed_terms_) {
+        is_changed_[term_id] = false;
+    }
+    changed_terms_.clear();
+}
+
+void InverseDocumentFreqTable::SetDocumentCount(size_t document_count) const {
+    document_count_ = document_count;
+    log_document_count_ = log(static_cast<double>(document_count));
+}
+
+double InverseDocumentFreqTable::ComputeLogDocumentFreq(
+        const vector<PostingList> &postings,
+        const vector<uint32_t> &removed_counts, size_t term_id) {
+    const size_t removed_count =
+            term_id < removed_counts.size() ? removed_counts[term_id] : 0;
+    const size_t document_freq = postings[term_id].size() - removed_count;
+    // у слова, все документы которого удалены, IDF не используется
+    return document_freq == 0 ?
+            NO_DOCUMENTS : log(static_cast<double>(document_freq));
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include "posting_list.h"
+#include "term_dictionary.h"
+
+using namespace std;
+
+/**
+ * @brief Таблица IDF (inverse document frequency) всех слов словаря
+ *
+ *  IDF слова = log(количество документов) - log(количество документов
+ *  со словом): логарифмы количеств документов слов хранятся в плотном
+ *  массиве по идентификатору слова, логарифм количества документов - один
+ *  на таблицу, поэтому запрос берёт IDF своих слов без вызова log().
+ *  Изменения документов только отмечаются (слова, списки документов которых
+ *  изменились); таблица обновляется при первом запросе после изменений:
+ *  пересчитываются логарифмы отмеченных слов и, если количество документов
+ *  изменилось больше, чем на долю tolerance от количества, по которому
+ *  вычислена таблица, - логарифм количества документов. Время обновления
+ *  зависит от количества изменившихся слов, а не от размера словаря.
+ *  При tolerance = 0 (по умолчанию) IDF всегда точные.
+ *  Обновление из нескольких потоков поиска защищено мьютексом, в остальное
+ *  время чтение таблицы блокировок не требует.
+ */
+class InverseDocumentFreqTable {
+public:
+    InverseDocumentFreqTable() = default;
+    InverseDocumentFreqTable(const InverseDocumentFreqTable &other);
+    InverseDocumentFreqTable& operator=(const InverseDocumentFreqTable &other);
+    InverseDocumentFreqTable(InverseDocumentFreqTable &&other);
+    InverseDocumentFreqTable& operator=(InverseDocumentFreqTable &&other);
+
+    // допустимое относительное изменение количества документов, при котором
+    // таблица обновляется частично
+    void SetTolerance(double tolerance);
+    double GetTolerance() const {
+        return tolerance_;
+    }
+
+    // отмечает слово, список документов которого изменился
+    void MarkTermChanged(TermId term_id);
+    // отмечает изменение количества документов
+    void MarkDocumentCountChanged() {
+        is_actual_.store(false, memory_order_relaxed);
+    }
+
+    // обновляет таблицу, если были изменения (безопасно вызывать из
+    // нескольких потоков поиска одновременно)
+    // (removed_counts - записи удалённых документов, ещё остающиеся
+    // в списках документов слов)
+    void Update(const vector<PostingList> &postings,
+            const vector<uint32_t> &removed_counts,
+            size_t document_count) const;
+    // пересчитывает IDF всех слов по текущему количеству документов
+    void Refresh(const vector<PostingList> &postings,
+            const vector<uint32_t> &removed_counts, size_t document_count);
+
+    // IDF слова (после Update; 0, если документов со словом нет)
+    double Get(TermId term_id) const {
+        const double log_document_freq = log_document_freqs_[term_id];
+        return log_document_freq == NO_DOCUMENTS ?
+                0.0 : log_document_count_ - log_document_freq;
+    }
+
+    // IDF слова, встречающегося в document_freq документах из document_count
+    // (совпадает с Get до бита)
+    static double Compute(size_t document_count, size_t document_freq) {
+        return document_freq == 0 ?
+                0.0 : log(static_cast<double>(document_count))
+                        - log(static_cast<double>(document_freq));
+    }
+
+private:
+    // логарифм количества документов слова, у которого их нет
+    static constexpr double NO_DOCUMENTS = -numeric_limits<double>::infinity();
+
+    double tolerance_ = 0.0;
+
+    // log(количество документов со словом) по идентификатору слова
+    mutable vector<double> log_document_freqs_;
+    // количество документов, по которому вычислены IDF, и его логарифм
+    mutable size_t document_count_ = 0;
+    mutable double log_document_count_ = 0.0;
+    // слова, IDF которых нужно пересчитать
+    mutable vector<TermId> changed_terms_;
+    mutable vector<bool> is_changed_;
+
+    // false - были изменения после последнего обновления
+    mutable atomic<bool> is_actual_ { false };
+    mutable mutex update_mutex_;
+
+    void Assign(const InverseDocumentFreqTable &other);
+    void RefreshAll(const vector<PostingList> &postings,
+            const vector<uint32_t> &removed_counts,
+            size_t document_count) const;
+    void SetDocumentCount(size_t document_count) const;
+
+    // log(количество документов со словом) или NO_DOCUMENTS
+    static double ComputeLogDocumentFreq(const vector<PostingList> &postings,
+            const vector<uint32_t> &removed_counts, size_t term_id);
+};
@@ -0,0 +1,417 @@
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "posting_list.h"
+
+using namespace std;
+
+namespace {
+
+// количество полос упаковки: значение i блока попадает в полосу i % 4
+constexpr size_t LANE_COUNT = 4;
+constexpr size_t LANE_SIZE = PostingList::POSTING_BLOCK_SIZE / LANE_COUNT;
+
+// распаковывает значение I всех полос
+template<unsigned BITS, size_t I>
+void UnpackLaneValues(const uint32_t *in, uint32_t *out) {
+    constexpr uint32_t MASK = (1u << BITS) - 1;
+    constexpr size_t WORD = I * BITS / 32;
+    constexpr unsigned SHIFT = I * BITS % 32;
+#ifdef __SSE2__
+    const __m128i *words = reinterpret_cast<const __m128i*>(in);
+    __m128i value = _mm_srli_epi32(_mm_loadu_si128(words + WORD), SHIFT);
+    if constexpr (SHIFT + BITS > 32) {
+        value = _mm_or_si128(value,
+                _mm_slli_epi32(_mm_loadu_si128(words + WORD + 1), 32 - SHIFT));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out) + I,
+            _mm_and_si128(value, _mm_set1_epi32(MASK)));
+#else
+    for (size_t lane = 0; lane < LANE_COUNT; ++lane) {
+        uint32_t value = in[WORD * LANE_COUNT + lane] >> SHIFT;
+        if constexpr (SHIFT + BITS > 32) {
+            value |= in[(WORD + 1) * LANE_COUNT + lane] << (32 - SHIFT);
+        }
+        out[I * LANE_COUNT + lane] = value & MASK;
+    }
+#endif
+}
+
+template<unsigned BITS, size_t ... I>
+void UnpackLanes(const uint32_t *in, uint32_t *out, index_sequence<I...>) {
+    (UnpackLaneValues<BITS, I>(in, out), ...);
+}
+
+/**
+ * @brief Распаковывает блок из POSTING_BLOCK_SIZE значений по BITS бит
+ *
+ *  Каждая полоса хранит LANE_SIZE значений подряд в BITS 32-битных словах,
+ *  слова полос чередуются, поэтому все полосы распаковываются одной
+ *  SIMD-операцией (SSE2, без него - по одной полосе).
+ */
+template<unsigned BITS>
+void UnpackBlock(const uint32_t *in, uint32_t *out) {
+    if constexpr (BITS == 0) {
+        fill(out, out + PostingList::POSTING_BLOCK_SIZE, 0u);
+    } else if constexpr (BITS == 32) {
+        copy(in, in + PostingList::POSTING_BLOCK_SIZE, out);
+    } else {
+        UnpackLanes<BITS>(in, out, make_index_sequence<LANE_SIZE>());
+    }
+}
+
+using UnpackFunction = void (*)(const uint32_t*, uint32_t*);
+
+template<size_t ... BITS>
+constexpr array<UnpackFunction, sizeof...(BITS)> MakeUnpackFunctions(
+        index_sequence<BITS...>) {
+    return {&UnpackBlock<BITS>...};
+}
+
+// функции распаковки для разрядностей 0 ... 32
+constexpr auto UNPACK_FUNCTIONS = MakeUnpackFunctions(make_index_sequence<33>());
+
+// упаковывает блок из POSTING_BLOCK_SIZE значений по bits бит в конец out
+void PackBlock(const uint32_t *values, unsigned bits, vector<uint32_t> &out) {
+    const size_t offset = out.size();
+    out.resize(offset + bits * LANE_COUNT, 0u);
+    uint32_t *words = out.data() + offset;
+    for (size_t i = 0; bits > 0 && i < LANE_SIZE; ++i) {
+        const size_t word = i * bits / 32;
+        const unsigned shift = i * bits % 32;
+        for (size_t lane = 0; lane < LANE_COUNT; ++lane) {
+            const uint32_t value = values[i * LANE_COUNT + lane];
+            words[word * LANE_COUNT + lane] |= value << shift;
+            if (shift + bits > 32) {
+                words[(word + 1) * LANE_COUNT + lane] |= value >> (32 - shift);
+            }
+        }
+    }
+}
+
+// количество бит, достаточное для хранения любого из значений блока
+unsigned GetBitWidth(const uint32_t *values) {
+    uint32_t all_bits = 0;
+    for (size_t i = 0; i < PostingList::POSTING_BLOCK_SIZE; ++i) {
+        all_bits |= values[i];
+    }
+    unsigned bits = 0;
+    while (bits < 32 && (all_bits >> bits) != 0) {
+        ++bits;
+    }
+    return bits;
+}
+
+}  // namespace
+
+/**
+ * @brief Добавляет документ в конец списка
+ *
+ *  Запись дописывается в несжатый последний блок, заполненный блок упаковывается.
+ *
+ * @param ordinal    Внутренний номер документа
+ * @param term_count Количество вхождений слова в документ
+ * @param term_freq  TF слова в документе
+ */
+void PostingList::Append(DocumentOrdinal ordinal, uint32_t term_count,
+        double term_freq) {
+    tail_ordinals_.Modify().push_back(ordinal);
+    tail_counts_.Modify().push_back(term_count);
+    tail_max_term_freq_ = max(tail_max_term_freq_, term_freq);
+    max_term_freq_ = max(max_term_freq_, term_freq);
+    if (tail_ordinals_.size() == POSTING_BLOCK_SIZE) {
+        SealTail();
+    }
+}
+
+/**
+ * @brief Удаляет документ из списка
+ *
+ *  Блоки до блока с документом не меняются, записи следующих блоков
+ *  упаковываются заново.
+ *
+ * @param ordinal Внутренний номер документа
+ */
+void PostingList::Erase(DocumentOrdinal ordinal) {
+    if (!Contains(ordinal)) {
+        return;
+    }
+    Filter(FindBlock(0, ordinal), [ordinal](DocumentOrdinal other) {
+        return other != ordinal;
+    });
+}
+
+bool PostingList::Contains(DocumentOrdinal ordinal) const {
+    const size_t block = FindBlock(0, ordinal);
+    if (block == GetBlockCount() || GetBlockFirstOrdinal(block) > ordinal) {
+        return false;
+    }
+    DocumentOrdinal ordinals[POSTING_BLOCK_SIZE];
+    const size_t size = DecodeOrdinals(block, ordinals);
+    return binary_search(ordinals, ordinals + size, ordinal);
+}
+
+size_t PostingList::GetMemoryUsage() const {
+    return sizeof(*this) + blocks_.capacity() * sizeof(Block)
+            + packed_.capacity() * sizeof(uint32_t)
+            + tail_ordinals_.capacity() * sizeof(DocumentOrdinal)
+            + tail_counts_.capacity() * sizeof(uint32_t);
+}
+
+size_t PostingList::FindBlock(size_t from, DocumentOrdinal target) const {
+    // курсор, стоящий на неполном блоке, ищет с блока blocks_.size() + 1
+    if (from > blocks_.size()) {
+        return GetBlockCount();
+    }
+    const auto it = partition_point(blocks_.begin() + from, blocks_.end(),
+            [target](const Block &block) {
+                return block.last_ordinal < target;
+            });
+    if (it != blocks_.end()) {
+        return it - blocks_.begin();
+    }
+    return !tail_ordinals_.empty() && tail_ordinals_.back() >= target ?
+            blocks_.size() : GetBlockCount();
+}
+
+size_t PostingList::DecodeOrdinals(size_t block,
+        DocumentOrdinal *ordinals) const {
+    if (block == blocks_.size()) {
+        copy(tail_ordinals_.begin(), tail_ordinals_.end(), ordinals);
+        return tail_ordinals_.size();
+    }
+    const Block &info = blocks_[block];
+    UNPACK_FUNCTIONS[info.ordinal_bits](packed_.data() + info.offset,
+            ordinals);
+    // номер i = (первый номер - 1) + сумма (разность + 1) значений 0 ... i
+#ifdef __SSE2__
+    const __m128i one = _mm_set1_epi32(1);
+    __m128i carry = _mm_set1_epi32(info.first_ordinal - 1);
+    __m128i *values = reinterpret_cast<__m128i*>(ordinals);
+    for (size_t i = 0; i < POSTING_BLOCK_SIZE / 4; ++i) {
+        __m128i value = _mm_add_epi32(_mm_loadu_si128(values + i), one);
+        value = _mm_add_epi32(value, _mm_slli_si128(value, 4));
+        value = _mm_add_epi32(value, _mm_slli_si128(value, 8));
+        value = _mm_add_epi32(value, carry);
+        _mm_storeu_si128(values + i, value);
+        carry = _mm_shuffle_epi32(value, 0xFF);
+    }
+#else
+    ordinals[0] = info.first_ordinal;
+    for (size_t i = 1; i < POSTING_BLOCK_SIZE; ++i) {
+        ordinals[i] += ordinals[i - 1] + 1;
+    }
+#endif
+    return POSTING_BLOCK_SIZE;
+}
+
+void PostingList::DecodeCounts(size_t block, uint32_t *counts) const {
+    if (block == blocks_.size()) {
+        copy(tail_counts_.begin(), tail_counts_.end(), counts);
+        return;
+    }
+    const Block &info = blocks_[block];
+    UNPACK_FUNCTIONS[info.count_bits](
+            packed_.data() + info.offset + info.ordinal_bits * LANE_COUNT,
+            counts);
+    for (size_t i = 0; i < POSTING_BLOCK_SIZE; ++i) {
+        ++counts[i];
+    }
+}
+
+/**
+ * @brief Упаковывает заполненный последний блок
+ *
+ *  Хранятся разности соседних номеров документов минус 1 (первое значение
+ *  блока не используется - первый номер хранится в описании блока)
+ *  и количества вхождений минус 1.
+ */
+void PostingList::SealTail() {
+    uint32_t values[POSTING_BLOCK_SIZE];
+    Block block {};
+    block.first_ordinal = tail_ordinals_.front();
+    block.last_ordinal = tail_ordinals_.back();
+    block.offset = static_cast<uint32_t>(packed_.size());
+    block.max_term_freq = tail_max_term_freq_;
+
+    values[0] = 0;
+    for (size_t i = 1; i < POSTING_BLOCK_SIZE; ++i) {
+        values[i] = tail_ordinals_[i] - tail_ordinals_[i - 1] - 1;
+    }
+    block.ordinal_bits = static_cast<uint8_t>(GetBitWidth(values));
+    vector<uint32_t> &packed = packed_.Modify();
+    PackBlock(values, block.ordinal_bits, packed);
+
+    for (size_t i = 0; i < POSTING_BLOCK_SIZE; ++i) {
+        values[i] = tail_counts_[i] - 1;
+    }
+    block.count_bits = static_cast<uint8_t>(GetBitWidth(values));
+    PackBlock(values, block.count_bits, packed);
+
+    blocks_.Modify().push_back(block);
+    // освобождаем память: у большинства слов последний блок так и не заполнится
+    tail_ordinals_ = {};
+    tail_counts_ = {};
+    tail_max_term_freq_ = 0.0;
+}
+
+void PostingList::Truncate(size_t from) {
+    if (from < blocks_.size()) {
+        packed_.Modify().resize(blocks_[from].offset);
+        blocks_.Modify().resize(from);
+    }
+    tail_ordinals_ = {};
+    tail_counts_ = {};
+    tail_max_term_freq_ = 0.0;
+    max_term_freq_ = 0.0;
+    for (const Block &block : blocks_) {
+        max_term_freq_ = max(max_term_freq_, block.max_term_freq);
+    }
+}
+
+/**
+ * @brief Записывает списки в снапшот
+ *
+ *  Блоки, упакованные данные и несжатые последние блоки всех списков
+ *  записываются подряд в общие разделы, для каждого списка - описание
+ *  с положением его данных. Смещения в описаниях блоков отсчитываются
+ *  от начала упакованных данных списка и не меняются.
+ */
+void PostingList::SaveSnapshot(const vector<PostingList> &lists,
+        SnapshotWriter &writer) {
+    vector<SnapshotHeader> headers;
+    headers.reserve(lists.size());
+    SnapshotHeader header {};
+    for (const PostingList &list : lists) {
+        header.block_count = static_cast<uint32_t>(list.blocks_.size());
+        header.packed_size = list.packed_.size();
+        header.tail_size = static_cast<uint32_t>(list.tail_ordinals_.size());
+        header.tail_max_term_freq = list.tail_max_term_freq_;
+        header.max_term_freq = list.max_term_freq_;
+        headers.push_back(header);
+        header.block_begin += header.block_count;
+        header.packed_begin += header.packed_size;
+        header.tail_begin += header.tail_size;
+    }
+    writer.WriteSection(SnapshotSection::POSTING_LIST_HEADERS, headers);
+
+    writer.BeginSection(SnapshotSection::POSTING_BLOCKS, sizeof(Block));
+    for (const PostingList &list : lists) {
+        writer.Write(list.blocks_.data(), list.blocks_.size());
+    }
+    writer.EndSection();
+    writer.BeginSection(SnapshotSection::POSTING_PACKED, sizeof(uint32_t));
+    for (const PostingList &list : lists) {
+        writer.Write(list.packed_.data(), list.packed_.size());
+    }
+    writer.EndSection();
+    writer.BeginSection(SnapshotSection::POSTING_TAIL_ORDINALS,
+            sizeof(DocumentOrdinal));
+    for (const PostingList &list : lists) {
+        writer.Write(list.tail_ordinals_.data(), list.tail_ordinals_.size());
+    }
+    writer.EndSection();
+    writer.BeginSection(SnapshotSection::POSTING_TAIL_COUNTS, sizeof(uint32_t));
+    for (const PostingList &list : lists) {
+        writer.Write(list.tail_counts_.data(), list.tail_counts_.size());
+    }
+    writer.EndSection();
+}
+
+/**
+ * @brief Открывает списки из снапшота
+ *
+ *  Для каждого списка создаётся объект, ссылающийся на свои данные
+ *  в отображённом файле.
+ */
+vector<PostingList> PostingList::OpenSnapshot(const SnapshotReader &reader) {
+    const CowVector<SnapshotHeader> headers =
+            reader.GetSection<SnapshotHeader>(
+                    SnapshotSection::POSTING_LIST_HEADERS);
+    const CowVector<Block> blocks = reader.GetSection<Block>(
+            SnapshotSection::POSTING_BLOCKS);
+    const CowVector<uint32_t> packed = reader.GetSection<uint32_t>(
+            SnapshotSection::POSTING_PACKED);
+    const CowVector<DocumentOrdinal> tail_ordinals = reader.GetSection<
+            DocumentOrdinal>(SnapshotSection::POSTING_TAIL_ORDINALS);
+    const CowVector<uint32_t> tail_counts = reader.GetSection<uint32_t>(
+            SnapshotSection::POSTING_TAIL_COUNTS);
+    if (tail_counts.size() != tail_ordinals.size()) {
+        throw runtime_error("неверный формат списков документов в снапшоте"s);
+    }
+
+    vector<PostingList> lists(headers.size());
+    for (size_t i = 0; i < headers.size(); ++i) {
+        const SnapshotHeader &header = headers[i];
+        if (header.block_begin + header.block_count > blocks.size()
+                || header.packed_begin + header.packed_size > packed.size()
+                || header.tail_begin + header.tail_size > tail_ordinals.size()
+                || header.tail_size >= POSTING_BLOCK_SIZE) {
+            throw runtime_error(
+                    "неверный формат списков документов в снапшоте"s);
+        }
+        PostingList &list = lists[i];
+        list.blocks_ = CowVector<Block>::View(
+                blocks.data() + header.block_begin, header.block_count);
+        list.packed_ = CowVector<uint32_t>::View(
+                packed.data() + header.packed_begin, header.packed_size);
+        list.tail_ordinals_ = CowVector<DocumentOrdinal>::View(
+                tail_ordinals.data() + header.tail_begin, header.tail_size);
+        list.tail_counts_ = CowVector<uint32_t>::View(
+                tail_counts.data() + header.tail_begin, header.tail_size);
+        list.tail_max_term_freq_ = header.tail_max_term_freq;
+        list.max_term_freq_ = header.max_term_freq;
+    }
+    return lists;
+}
+
+PostingList::Cursor::Cursor(const PostingList &list, DocumentOrdinal first,
+        DocumentOrdinal last) :
+        list_(&list), last_(last), block_count_(list.GetBlockCount()) {
+    probe_block_ = list.FindBlock(0, first);
+    LoadBlock(probe_block_);
+    Advance(first);
+}
+
+/**
+ * @brief Переходит к первой записи с номером документа не меньше target
+ *
+ *  Если запись не в распакованном блоке, нужный блок находится двоичным
+ *  поиском по последним номерам документов блоков, и распаковывается только он.
+ *
+ * @param target Номер документа
+ */
+void PostingList::Cursor::Advance(DocumentOrdinal target) {
+    if (ordinal_ >= target) {
+        return;
+    }
+    if (ordinals_[size_ - 1] < target) {
+        LoadBlock(list_->FindBlock(block_ + 1, target));
+        if (ordinal_ >= target) {
+            return;
+        }
+    }
+    index_ = lower_bound(ordinals_ + index_, ordinals_ + size_, target)
+            - ordinals_;
+    SetOrdinal(ordinals_[index_]);
+}
+
+void PostingList::Cursor::LoadBlock(size_t block) {
+    block_ = block;
+    index_ = 0;
+    if (block_ >= block_count_
+            || list_->GetBlockFirstOrdinal(block_) >= last_) {
+        size_ = 0;
+        ordinal_ = END;
+        return;
+    }
+    size_ = list_->DecodeOrdinals(block_, ordinals_);
+    list_->DecodeCounts(block_, counts_);
+    SetOrdinal(ordinals_[0]);
+}
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "cow_vector.h"
+#include "document.h"
+#include "snapshot.h"
+
+using namespace std;
+
+/**
+ * @brief Список документов, содержащих слово (posting list)
+ *
+ *  Записи (внутренний номер документа, количество вхождений слова в документ)
+ *  упорядочены по номеру документа и хранятся в сжатом виде блоками по
+ *  POSTING_BLOCK_SIZE записей:
+ *  - номера документов - разности соседних номеров, количества вхождений -
+ *    (количество - 1); значения блока упаковываются в минимальное для блока
+ *    число бит (в раскладке SIMD-BP128: 4 чередующиеся полосы по 32 значения,
+ *    блок всегда занимает целое число 32-битных слов);
+ *  - для каждого блока хранятся первый и последний номера документов
+ *    (по ним блоки пропускаются без распаковки), смещение упакованных данных,
+ *    разрядности и максимальный TF (для поиска с отсечением).
+ *  Последние записи, не набравшие полного блока, хранятся несжатыми
+ *  и упаковываются, когда блок заполнится.
+ *  TF документа = количество вхождений / количество слов документа,
+ *  делитель хранится в DocumentStore.
+ *  Списки, открытые из снапшота, читают блоки прямо из отображённого файла.
+ */
+class PostingList {
+public:
+    // количество записей в блоке списка
+    static constexpr size_t POSTING_BLOCK_SIZE = 128;
+
+    class Cursor;
+
+    // добавляет документ в конец списка (номер документа должен быть больше
+    // номеров документов, уже добавленных в список)
+    void Append(DocumentOrdinal ordinal, uint32_t term_count, double term_freq);
+
+    // удаляет документ из списка
+    void Erase(DocumentOrdinal ordinal);
+
+    // удаляет из списка все документы, для которых predicate(номер документа) == true
+    template<typename Predicate>
+    void EraseIf(Predicate predicate);
+
+    bool Contains(DocumentOrdinal ordinal) const;
+
+    // вызывает action(номер документа, количество вхождений) для записей
+    // с номерами документов из диапазона [first, last), распаковывая
+    // только блоки, в которых есть такие записи; возвращает количество
+    // таких записей
+    template<typename Action>
+    size_t ForEachInRange(DocumentOrdinal first, DocumentOrdinal last,
+            Action action) const;
+
+    size_t size() const {
+        return blocks_.size() * POSTING_BLOCK_SIZE + tail_ordinals_.size();
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // максимальный TF слова среди всех документов списка
+    double GetMaxTermFreq() const {
+        return max_term_freq_;
+    }
+
+    // объём памяти, занимаемой списком (в байтах, без отображённого файла)
+    size_t GetMemoryUsage() const;
+
+    // записывает списки в снапшот
+    static void SaveSnapshot(const vector<PostingList> &lists,
+            SnapshotWriter &writer);
+    // открывает списки из снапшота (без копирования и распаковки блоков)
+    static vector<PostingList> OpenSnapshot(const SnapshotReader &reader);
+
+private:
+    struct Block {
+        DocumentOrdinal first_ordinal;
+        DocumentOrdinal last_ordinal;
+        uint32_t offset;        // начало упакованных данных блока в packed_
+        uint8_t ordinal_bits;   // разрядность разностей номеров документов
+        uint8_t count_bits;     // разрядность (количество вхождений - 1)
+        double max_term_freq;
+    };
+
+    // описание списка в снапшоте: положение его данных в общих для всех
+    // списков разделах
+    struct SnapshotHeader {
+        uint64_t block_begin;
+        uint64_t packed_begin;
+        uint64_t tail_begin;
+        uint64_t packed_size;
+        uint32_t block_count;
+        uint32_t tail_size;
+        double tail_max_term_freq;
+        double max_term_freq;
+    };
+
+    CowVector<Block> blocks_;     // упакованные блоки
+    CowVector<uint32_t> packed_;  // упакованные данные блоков
+    // записи последнего, неполного блока
+    CowVector<DocumentOrdinal> tail_ordinals_;
+    CowVector<uint32_t> tail_counts_;
+    double tail_max_term_freq_ = 0.0;
+    double max_term_freq_ = 0.0;
+
+    // количество блоков, включая неполный последний блок
+    size_t GetBlockCount() const {
+        return blocks_.size() + (tail_ordinals_.empty() ? 0 : 1);
+    }
+    DocumentOrdinal GetBlockFirstOrdinal(size_t block) const {
+        return block < blocks_.size() ?
+                blocks_[block].first_ordinal : tail_ordinals_.front();
+    }
+    DocumentOrdinal GetBlockLastOrdinal(size_t block) const {
+        return block < blocks_.size() ?
+                blocks_[block].last_ordinal : tail_ordinals_.back();
+    }
+    double GetBlockMaxTermFreq(size_t block) const {
+        return block < blocks_.size() ?
+                blocks_[block].max_term_freq : tail_max_term_freq_;
+    }
+
+    // первый блок, начиная с from, последний номер документа которого
+    // не меньше target (или GetBlockCount(), в том числе если from больше
+    // номера последнего блока)
+    size_t FindBlock(size_t from, DocumentOrdinal target) const;
+
+    // распаковывает номера документов блока, возвращает количество записей
+    size_t DecodeOrdinals(size_t block, DocumentOrdinal *ordinals) const;
+    // распаковывает количества вхождений блока
+    void DecodeCounts(size_t block, uint32_t *counts) const;
+
+    // упаковывает заполненный последний блок
+    void SealTail();
+
+    // удаляет блоки, начиная с from
+    void Truncate(size_t from);
+
+    // распаковывает записи блоков, начиная с from, и заново добавляет те,
+    // для которых keep(номер документа) == true
+    template<typename Predicate>
+    void Filter(size_t from, Predicate keep);
+};
+
+/**
+ * @brief Курсор для обхода списка документов с пропусками
+ *
+ *  Обходит записи с номерами документов из диапазона [first, last).
+ *  Закончившийся курсор возвращает номер документа END.
+ *  Распаковывается только блок текущей записи; блоки, которые Advance
+ *  перешагивает, пропускаются по последним номерам документов блоков.
+ *  Номера документов target, передаваемые в Advance и GetBlock..., не должны
+ *  убывать: поиск блока продолжается с блока, найденного в прошлый раз.
+ */
+class PostingList::Cursor {
+public:
+    static constexpr DocumentOrdinal END = numeric_limits<DocumentOrdinal>::max();
+
+    Cursor(const PostingList &list, DocumentOrdinal first, DocumentOrdinal last);
+
+    // номер документа текущей записи (или END)
+    DocumentOrdinal GetOrdinal() const {
+        return ordinal_;
+    }
+    // количество вхождений слова в документ текущей записи
+    uint32_t GetTermCount() const {
+        return counts_[index_];
+    }
+
+    // переходит к следующей записи
+    void Next() {
+        if (++index_ == size_) {
+            LoadBlock(block_ + 1);
+            return;
+        }
+        SetOrdinal(ordinals_[index_]);
+    }
+
+    // переходит к первой записи с номером документа не меньше target
+    void Advance(DocumentOrdinal target);
+
+    // максимальный TF в блоке, где находится (или была бы) запись документа
+    // target (0, если такой записи нет); курсор не сдвигается
+    double GetBlockMaxTermFreq(DocumentOrdinal target) {
+        probe_block_ = list_->FindBlock(probe_block_, target);
+        return probe_block_ < block_count_
+                && list_->GetBlockFirstOrdinal(probe_block_) < last_ ?
+                list_->GetBlockMaxTermFreq(probe_block_) : 0.0;
+    }
+
+private:
+    const PostingList *list_;
+    DocumentOrdinal last_;  // номер документа, следующий за диапазоном
+    size_t block_count_;
+    size_t block_;          // распакованный блок
+    size_t probe_block_;    // блок, найденный последним вызовом GetBlockMaxTermFreq
+    size_t index_ = 0;      // текущая запись в распакованном блоке
+    size_t size_ = 0;       // количество записей в распакованном блоке
+    DocumentOrdinal ordinal_ = END;
+    DocumentOrdinal ordinals_[POSTING_BLOCK_SIZE];
+    uint32_t counts_[POSTING_BLOCK_SIZE];
+
+    void SetOrdinal(DocumentOrdinal ordinal) {
+        ordinal_ = ordinal < last_ ? ordinal : END;
+    }
+
+    // распаковывает блок и встаёт на его первую запись
+    void LoadBlock(size_t block);
+};
+
+template<typename Action>
+size_t PostingList::ForEachInRange(DocumentOrdinal first, DocumentOrdinal last,
+        Action action) const {
+    DocumentOrdinal ordinals[POSTING_BLOCK_SIZE];
+    uint32_t counts[POSTING_BLOCK_SIZE];
+    const size_t block_count = GetBlockCount();
+    size_t visited = 0;
+    for (size_t block = FindBlock(0, first);
+            block < block_count && GetBlockFirstOrdinal(block) < last;
+            ++block) {
+        const size_t size = DecodeOrdinals(block, ordinals);
+        DecodeCounts(block, counts);
+        for (size_t i = lower_bound(ordinals, ordinals + size, first) - ordinals;
+                i < size && ordinals[i] < last; ++i) {
+            action(ordinals[i], counts[i]);
+            ++visited;
+        }
+    }
+    return visited;
+}
+
+template<typename Predicate>
+void PostingList::Filter(size_t from, Predicate keep) {
+    vector<DocumentOrdinal> ordinals;
+    vector<uint32_t> counts;
+    vector<double> term_freq_bounds;
+    DocumentOrdinal block_ordinals[POSTING_BLOCK_SIZE];
+    uint32_t block_counts[POSTING_BLOCK_SIZE];
+    for (size_t block = from; block < GetBlockCount(); ++block) {
+        const size_t block_size = DecodeOrdinals(block, block_ordinals);
+        DecodeCounts(block, block_counts);
+        for (size_t i = 0; i < block_size; ++i) {
+            if (keep(block_ordinals[i])) {
+                ordinals.push_back(block_ordinals[i]);
+                counts.push_back(block_counts[i]);
+                // точный TF записи неизвестен, максимум её блока остаётся оценкой сверху
+                term_freq_bounds.push_back(GetBlockMaxTermFreq(block));
+            }
+        }
+    }
+    Truncate(from);
+    for (size_t i = 0; i < ordinals.size(); ++i) {
+        Append(ordinals[i], counts[i], term_freq_bounds[i]);
+    }
+}
+
+template<typename Predicate>
+void PostingList::EraseIf(Predicate predicate) {
+    Filter(0, [&predicate](DocumentOrdinal ordinal) {
+        return !predicate(ordinal);
+    });
+}
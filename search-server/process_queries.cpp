@@ -1,27 +1,80 @@
 #include <algorithm>
-#include <execution>
-#include <numeric>
 
 #include "process_queries.h"
 
 using namespace std;
 
-vector<vector<Document>> ProcessQueries(const SearchServer &search_server,
-        const vector<string> &queries) {
+namespace {
+
+// Query - string или SearchServer::PreparedQuery
+template<typename Query>
+vector<vector<Document>> ProcessQueriesInPool(const QueryExecutor &executor,
+        const SearchServer &search_server, const vector<Query> &queries) {
     vector<vector<Document>> result(queries.size());
-    transform(execution::par, queries.begin(), queries.end(), result.begin(),
-            [&search_server](const string &query) {
-                return search_server.FindTopDocuments(query);
+    executor.ParallelFor(queries.size(),
+            [&executor, &search_server, &queries, &result](size_t i) {
+                result[i] = search_server.FindTopDocuments(executor,
+                        queries[i]);
             });
     return result;
 }
 
+}  // namespace
+
+vector<vector<Document>> ProcessQueries(const SearchServer &search_server,
+        const vector<string> &queries) {
+    return ProcessQueries(QueryExecutor::GetDefault(), search_server, queries);
+}
+
+vector<vector<Document>> ProcessQueries(const QueryExecutor &executor,
+        const SearchServer &search_server, const vector<string> &queries) {
+    return ProcessQueriesInPool(executor, search_server, queries);
+}
+
+vector<vector<Document>> ProcessQueries(const SearchServer &search_server,
+        const vector<SearchServer::PreparedQuery> &queries) {
+    return ProcessQueries(QueryExecutor::GetDefault(), search_server, queries);
+}
+
+vector<vector<Document>> ProcessQueries(const QueryExecutor &executor,
+        const SearchServer &search_server,
+        const vector<SearchServer::PreparedQuery> &queries) {
+    return ProcessQueriesInPool(executor, search_server, queries);
+}
+
 vector<Document> ProcessQueriesJoined(const SearchServer &search_server,
         const vector<string> &queries) {
-    vector<Document> documents;
-    for (const auto &local_documents : ProcessQueries(search_server, queries)) {
-        documents.insert(documents.end(), local_documents.begin(),
-                local_documents.end());
+    return ProcessQueriesJoined(QueryExecutor::GetDefault(), search_server,
+            queries);
+}
+
+/**
+ * @brief Выполняет запросы и возвращает их результаты подряд
+ *
+ *  Запрос возвращает не больше MAX_RESULT_DOCUMENT_COUNT документов, поэтому
+ *  результаты запроса i сразу пишутся в общий массив с позиции
+ *  i * MAX_RESULT_DOCUMENT_COUNT, затем массив уплотняется по порядку запросов
+ *  (без промежуточного vector<vector<Document>>).
+ */
+vector<Document> ProcessQueriesJoined(const QueryExecutor &executor,
+        const SearchServer &search_server, const vector<string> &queries) {
+    vector<Document> documents(queries.size() * MAX_RESULT_DOCUMENT_COUNT);
+    vector<size_t> document_counts(queries.size());
+    executor.ParallelFor(queries.size(),
+            [&executor, &search_server, &queries, &documents,
+                    &document_counts](size_t i) {
+                const vector<Document> query_documents =
+                        search_server.FindTopDocuments(executor, queries[i]);
+                copy(query_documents.begin(), query_documents.end(),
+                        documents.begin() + i * MAX_RESULT_DOCUMENT_COUNT);
+                document_counts[i] = query_documents.size();
+            });
+
+    auto end = documents.begin();
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto first = documents.begin() + i * MAX_RESULT_DOCUMENT_COUNT;
+        end = copy(first, first + document_counts[i], end);
     }
+    documents.erase(end, documents.end());
     return documents;
 }
@@ -4,12 +4,26 @@
 #include <vector>
 
 #include "document.h"
+#include "query_executor.h"
 #include "search_server.h"
 
 using namespace std;
 
+// запросы выполняются в пуле потоков executor (без него - в общем пуле
+// QueryExecutor::GetDefault()), части каждого запроса - в том же пуле
 vector<vector<Document>> ProcessQueries(const SearchServer &search_server,
         const vector<string> &queries);
+vector<vector<Document>> ProcessQueries(const QueryExecutor &executor,
+        const SearchServer &search_server, const vector<string> &queries);
+// запросы, разобранные заранее (SearchServer::Prepare)
+vector<vector<Document>> ProcessQueries(const SearchServer &search_server,
+        const vector<SearchServer::PreparedQuery> &queries);
+vector<vector<Document>> ProcessQueries(const QueryExecutor &executor,
+        const SearchServer &search_server,
+        const vector<SearchServer::PreparedQuery> &queries);
 
+// результаты всех запросов подряд в порядке запросов
 vector<Document> ProcessQueriesJoined(const SearchServer &search_server,
         const vector<string> &queries);
+vector<Document> ProcessQueriesJoined(const QueryExecutor &executor,
+        const SearchServer &search_server, const vector<string> &queries);
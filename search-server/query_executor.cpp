@@ -0,0 +1,169 @@
+#include <algorithm>
+
+#include "query_executor.h"
+
+using namespace std;
+
+namespace {
+
+// пул, которому принадлежит текущий поток (nullptr - потоку не из пула),
+// и номер очереди потока в пуле
+thread_local const QueryExecutor *current_executor = nullptr;
+thread_local size_t current_queue = 0;
+
+}  // namespace
+
+QueryExecutor::QueryExecutor(size_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = max(1u, thread::hardware_concurrency());
+    }
+    queue_count_ = thread_count;
+    queues_ = make_unique<TaskQueue[]>(queue_count_);
+    // поток, вызвавший ParallelFor, выполняет задачи сам, поэтому рабочих
+    // потоков на один меньше
+    workers_.reserve(thread_count - 1);
+    for (size_t i = 1; i < thread_count; ++i) {
+        workers_.emplace_back([this, i] {
+            WorkerLoop(i);
+        });
+    }
+}
+
+QueryExecutor::~QueryExecutor() {
+    {
+        lock_guard lock(sleep_mutex_);
+        stop_ = true;
+    }
+    wake_up_.notify_all();
+    for (thread &worker : workers_) {
+        worker.join();
+    }
+}
+
+const QueryExecutor& QueryExecutor::GetDefault() {
+    static const QueryExecutor executor;
+    return executor;
+}
+
+/**
+ * @brief Выполняет action(i) для всех i из [0, count) и ждёт завершения
+ *
+ *  Пока номера выполняются, вызывающий поток тоже берёт задачи из очередей
+ *  (в том числе задачи других вызовов ParallelFor). Когда задач в очередях
+ *  нет, поток засыпает до завершения группы или появления новых задач.
+ */
+void QueryExecutor::Run(size_t count,
+        const function<void(size_t)> &action) const {
+    TaskGroup group;
+    group.action = &action;
+    group.remaining = count;
+    Push( { &group, 0, count });
+    while (group.remaining.load(memory_order_acquire) > 0) {
+        Task task;
+        if (TryPop(task)) {
+            Execute(task);
+            continue;
+        }
+        unique_lock lock(sleep_mutex_);
+        wake_up_.wait(lock, [this, &group] {
+            return group.remaining.load(memory_order_acquire) == 0
+                    || queued_task_count_.load() > 0;
+        });
+    }
+    if (group.exception) {
+        rethrow_exception(group.exception);
+    }
+}
+
+void QueryExecutor::WorkerLoop(size_t queue_index) {
+    current_executor = this;
+    current_queue = queue_index;
+    while (true) {
+        Task task;
+        if (TryPop(task)) {
+            Execute(task);
+            continue;
+        }
+        unique_lock lock(sleep_mutex_);
+        wake_up_.wait(lock, [this] {
+            return stop_ || queued_task_count_.load() > 0;
+        });
+        if (stop_) {
+            return;
+        }
+    }
+}
+
+void QueryExecutor::Push(const Task &task) const {
+    TaskQueue &queue = queues_[current_executor == this ? current_queue : 0];
+    {
+        lock_guard lock(queue.queue_mutex);
+        queue.tasks.push_back(task);
+    }
+    queued_task_count_.fetch_add(1);
+    {
+        // между проверкой условия и засыпанием потока уведомление не теряется
+        lock_guard lock(sleep_mutex_);
+    }
+    wake_up_.notify_one();
+}
+
+/**
+ * @brief Берёт задачу: сначала последнюю из своей очереди, затем первую из
+ *        очередей других потоков
+ */
+bool QueryExecutor::TryPop(Task &task) const {
+    const size_t own_queue = current_executor == this ? current_queue : 0;
+    {
+        TaskQueue &queue = queues_[own_queue];
+        lock_guard lock(queue.queue_mutex);
+        if (!queue.tasks.empty()) {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+            queued_task_count_.fetch_sub(1);
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queue_count_; ++i) {
+        TaskQueue &queue = queues_[(own_queue + i) % queue_count_];
+        lock_guard lock(queue.queue_mutex);
+        if (!queue.tasks.empty()) {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+            queued_task_count_.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Выполняет задачу
+ *
+ *  Верхние половины диапазона задачи отдаются в очередь (их могут забрать
+ *  другие потоки), выполняется первый номер диапазона.
+ */
+void QueryExecutor::Execute(Task task) const {
+    while (task.last - task.first > 1) {
+        const size_t middle = task.first + (task.last - task.first) / 2;
+        Push( { task.group, middle, task.last });
+        task.last = middle;
+    }
+    TaskGroup &group = *task.group;
+    try {
+        (*group.action)(task.first);
+    } catch (...) {
+        lock_guard lock(group.exception_mutex);
+        if (!group.exception) {
+            group.exception = current_exception();
+        }
+    }
+    // после уменьшения счётчика группа может быть уже удалена
+    if (group.remaining.fetch_sub(1, memory_order_acq_rel) == 1) {
+        {
+            // ожидающий группу поток не пропустит уведомление
+            lock_guard lock(sleep_mutex_);
+        }
+        wake_up_.notify_all();
+    }
+}
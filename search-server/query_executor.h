@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <execution>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Пул потоков для выполнения поисковых запросов
+ *
+ *  Потоки создаются один раз и живут, пока жив объект. Задача ParallelFor -
+ *  диапазон номеров [first, last): поток, взявший диапазон, отдаёт его верхнюю
+ *  половину в свою очередь, пока не останется один номер. Поток берёт задачи
+ *  с конца своей очереди, а свободные потоки забирают ("крадут") задачи с начала
+ *  чужих очередей - там самые большие диапазоны. Поток, ожидающий завершения
+ *  ParallelFor, сам выполняет задачи, поэтому вложенные вызовы (запрос внутри
+ *  пакета запросов, части диапазона документов внутри запроса, шарды) работают
+ *  в тех же потоках и не создают лишних.
+ */
+class QueryExecutor {
+public:
+    // thread_count - количество потоков, выполняющих задачи, включая поток,
+    // вызвавший ParallelFor (0 - по количеству ядер процессора)
+    explicit QueryExecutor(size_t thread_count = 0);
+    ~QueryExecutor();
+
+    QueryExecutor(const QueryExecutor&) = delete;
+    QueryExecutor& operator=(const QueryExecutor&) = delete;
+
+    // количество потоков, выполняющих задачи
+    size_t GetConcurrency() const {
+        return workers_.size() + 1;
+    }
+
+    // вызывает action(i) для всех i из [0, count) в потоках пула и ждёт
+    // завершения; первое исключение из action пробрасывается вызывающему
+    template<typename Action>
+    void ParallelFor(size_t count, Action action) const;
+
+    // общий пул по количеству ядер процессора
+    static const QueryExecutor& GetDefault();
+
+private:
+    // вызов ParallelFor, номера которого ещё выполняются
+    struct TaskGroup {
+        const function<void(size_t)> *action;
+        atomic<size_t> remaining;
+        mutex exception_mutex;
+        exception_ptr exception;
+    };
+
+    struct Task {
+        TaskGroup *group;
+        size_t first;
+        size_t last;
+    };
+
+    struct TaskQueue {
+        mutex queue_mutex;
+        deque<Task> tasks;
+    };
+
+    // очереди задач: [0] - потоков, не принадлежащих пулу, [i] - потока
+    // workers_[i - 1]
+    unique_ptr<TaskQueue[]> queues_;
+    size_t queue_count_;
+    vector<thread> workers_;
+
+    // количество задач в очередях; свободные потоки ждут его увеличения,
+    // потоки в ParallelFor - его увеличения или завершения своей группы
+    mutable atomic<size_t> queued_task_count_ { 0 };
+    mutable mutex sleep_mutex_;
+    mutable condition_variable wake_up_;
+    bool stop_ = false;
+
+    void Run(size_t count, const function<void(size_t)> &action) const;
+    void WorkerLoop(size_t queue_index);
+
+    void Push(const Task &task) const;
+    bool TryPop(Task &task) const;
+    void Execute(Task task) const;
+};
+
+template<typename Action>
+void QueryExecutor::ParallelFor(size_t count, Action action) const {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1 || workers_.empty()) {
+        for (size_t i = 0; i < count; ++i) {
+            action(i);
+        }
+        return;
+    }
+    Run(count, function<void(size_t)>(ref(action)));
+}
+
+/**
+ * @brief Вызывает action(i) для всех i из [0, count) параллельно
+ *
+ *  Одинаково для стандартной политики выполнения execution::par и для пула
+ *  QueryExecutor, поэтому поиск может выполняться и так, и так.
+ */
+template<typename Action>
+void ParallelFor(const execution::parallel_policy &policy, size_t count,
+        Action action) {
+    vector<size_t> indexes(count);
+    iota(indexes.begin(), indexes.end(), 0);
+    for_each(policy, indexes.begin(), indexes.end(), action);
+}
+
+template<typename Action>
+void ParallelFor(const QueryExecutor &executor, size_t count, Action action) {
+    executor.ParallelFor(count, action);
+}
@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <functional>
+
+#include "query_result_cache.h"
+
+using namespace std;
+
+namespace {
+
+template<typename Value>
+void AppendBytes(string &key, const Value &value) {
+    key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+}  // namespace
+
+QueryResultCache::QueryResultCache(const SearchServer &search_server,
+        size_t capacity, size_t shard_count) :
+        search_server_(search_server), shard_count_(max<size_t>(1,
+                shard_count)) {
+    shards_ = make_unique<Shard[]>(shard_count_);
+    shard_capacity_ = max<size_t>(1,
+            (capacity + shard_count_ - 1) / shard_count_);
+}
+
+vector<Document> QueryResultCache::FindTopDocuments(string_view raw_query) {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+vector<Document> QueryResultCache::FindTopDocuments(string_view raw_query,
+        DocumentStatus status, size_t top_k, EvaluationMode mode) {
+    return Find(raw_query, PredicateKind::STATUS,
+            static_cast<uint64_t>(status), top_k,
+            [this, status, top_k, mode](const SearchServer::Query &query) {
+                const DocumentFilter filter(status);
+                const SearchServer::FilterPredicate predicate =
+                        search_server_.MakeFilterPredicate(filter);
+                return search_server_.FindAllDocuments(query,
+                        [&predicate](DocumentOrdinal ordinal) {
+                            return predicate(ordinal);
+                        }, top_k, mode);
+            });
+}
+
+QueryResultCache::Stats QueryResultCache::GetStats() const {
+    Stats stats;
+    stats.hits = hits_.load();
+    stats.misses = misses_.load();
+    stats.evictions = evictions_.load();
+    stats.invalidations = invalidations_.load();
+    return stats;
+}
+
+/**
+ * @brief Строит ключ кеша по разобранному запросу
+ *
+ *  Ключ - байты вида и номера критерия поиска, top_k, количества плюс-слов,
+ *  идентификаторов плюс-слов и минус-слов (идентификаторы слов не меняются,
+ *  пока жив сервер).
+ */
+string QueryResultCache::MakeKey(const SearchServer::Query &query,
+        PredicateKind kind, uint64_t predicate_id, size_t top_k) const {
+    string key;
+    key.reserve(sizeof(kind) + sizeof(predicate_id) + sizeof(uint64_t) * 2
+            + (query.plus_words.size() + query.minus_words.size())
+                    * sizeof(TermId));
+    AppendBytes(key, kind);
+    AppendBytes(key, predicate_id);
+    AppendBytes(key, static_cast<uint64_t>(top_k));
+    AppendBytes(key, static_cast<uint64_t>(query.plus_words.size()));
+    for (const TermId word : query.plus_words) {
+        AppendBytes(key, word);
+    }
+    for (const TermId word : query.minus_words) {
+        AppendBytes(key, word);
+    }
+    return key;
+}
+
+QueryResultCache::Shard& QueryResultCache::GetShard(string_view key) {
+    return shards_[hash<string_view> { }(key) % shard_count_];
+}
+
+/**
+ * @brief Ищет запись в кеше
+ *
+ *  Найденная запись становится последней использованной; запись, вычисленная
+ *  при другой версии индекса, удаляется.
+ *
+ * @param key       Ключ
+ * @param epoch     Текущая версия индекса сервера
+ * @param documents Результат поиска из записи
+ * @return true, если запись найдена
+ */
+bool QueryResultCache::Lookup(const string &key, uint64_t epoch,
+        vector<Document> &documents) {
+    Shard &shard = GetShard(key);
+    {
+        lock_guard lock(shard.shard_mutex);
+        const auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            if (it->second->epoch == epoch) {
+                shard.entries.splice(shard.entries.begin(), shard.entries,
+                        it->second);
+                documents = it->second->documents;
+                ++hits_;
+                return true;
+            }
+            const auto entry = it->second;
+            shard.index.erase(it);
+            shard.entries.erase(entry);
+            ++invalidations_;
+        }
+    }
+    ++misses_;
+    return false;
+}
+
+/**
+ * @brief Добавляет запись в кеш, вытесняя давно использованные записи
+ */
+void QueryResultCache::Insert(string key, uint64_t epoch,
+        const vector<Document> &documents) {
+    Shard &shard = GetShard(key);
+    lock_guard lock(shard.shard_mutex);
+    const auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        // запись добавил другой поток, пока результат вычислялся
+        it->second->epoch = epoch;
+        it->second->documents = documents;
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        return;
+    }
+    while (shard.entries.size() >= shard_capacity_) {
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+        ++evictions_;
+    }
+    shard.entries.push_front( { move(key), epoch, documents });
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+using namespace std;
+
+// количество частей кеша результатов по умолчанию
+const size_t DEFAULT_CACHE_SHARD_COUNT = 16;
+
+/**
+ * @brief Кеш результатов поиска перед SearchServer::FindTopDocuments
+ *
+ *  Ключ - разобранный запрос (плюс-слова и минус-слова без повторов,
+ *  упорядоченные так же, как в SearchServer::ParseQuery), статус или номер
+ *  критерия поиска и top_k, поэтому запросы, которые отличаются порядком
+ *  и повторами слов или словами, которых нет в словаре, находят одну запись.
+ *  Запись хранит номер версии индекса сервера (SearchServer::GetEpoch), при
+ *  которой она вычислена: после изменения документов сервера или
+ *  присваивания ему другого сервера записи устаревают и вычисляются заново.
+ *  Кеш разбит на части по хешу ключа, каждая часть - список LRU под своим
+ *  мьютексом, поэтому кеш можно использовать из нескольких потоков
+ *  (например, из ProcessQueries) одновременно.
+ */
+class QueryResultCache {
+public:
+    // счётчики обращений к кешу
+    struct Stats {
+        uint64_t hits = 0;           // результат взят из кеша
+        uint64_t misses = 0;         // результат вычислен
+        uint64_t evictions = 0;      // записи, вытесненные из-за размера кеша
+        uint64_t invalidations = 0;  // устаревшие записи, удалённые из кеша
+    };
+
+    // capacity - максимальное количество записей в кеше
+    QueryResultCache(const SearchServer &search_server, size_t capacity,
+            size_t shard_count = DEFAULT_CACHE_SHARD_COUNT);
+
+    vector<Document> FindTopDocuments(string_view raw_query);
+
+    vector<Document> FindTopDocuments(string_view raw_query,
+            DocumentStatus status, size_t top_k = MAX_RESULT_DOCUMENT_COUNT,
+            EvaluationMode mode = EvaluationMode::EXHAUSTIVE);
+
+    // predicate_id - номер критерия поиска: одинаковые номера должны быть
+    // только у критериев, отбирающих одни и те же документы
+    template<typename DocumentPredicate>
+    vector<Document> FindTopDocuments(string_view raw_query,
+            uint64_t predicate_id, DocumentPredicate document_predicate,
+            size_t top_k = MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE);
+
+    Stats GetStats() const;
+
+    size_t GetCapacity() const {
+        return shard_capacity_ * shard_count_;
+    }
+
+private:
+    // вид критерия поиска в ключе
+    enum class PredicateKind : uint8_t {
+        STATUS,
+        CUSTOM,
+    };
+
+    struct Entry {
+        string key;
+        uint64_t epoch;
+        vector<Document> documents;
+    };
+
+    struct Shard {
+        mutex shard_mutex;
+        // записи от недавно использованных к давно использованным
+        list<Entry> entries;
+        // ключ (string_view на Entry::key) -> запись
+        unordered_map<string_view, list<Entry>::iterator> index;
+    };
+
+    const SearchServer &search_server_;
+    unique_ptr<Shard[]> shards_;
+    size_t shard_count_;
+    size_t shard_capacity_;
+
+    atomic<uint64_t> hits_ { 0 };
+    atomic<uint64_t> misses_ { 0 };
+    atomic<uint64_t> evictions_ { 0 };
+    atomic<uint64_t> invalidations_ { 0 };
+
+    template<typename Search>
+    vector<Document> Find(string_view raw_query, PredicateKind kind,
+            uint64_t predicate_id, size_t top_k, Search search);
+
+    string MakeKey(const SearchServer::Query &query, PredicateKind kind,
+            uint64_t predicate_id, size_t top_k) const;
+
+    Shard& GetShard(string_view key);
+
+    bool Lookup(const string &key, uint64_t epoch,
+            vector<Document> &documents);
+    void Insert(string key, uint64_t epoch, const vector<Document> &documents);
+};
+
+template<typename DocumentPredicate>
+vector<Document> QueryResultCache::FindTopDocuments(string_view raw_query,
+        uint64_t predicate_id, DocumentPredicate document_predicate,
+        size_t top_k, EvaluationMode mode) {
+    return Find(raw_query, PredicateKind::CUSTOM, predicate_id, top_k,
+            [this, &document_predicate, top_k, mode](
+                    const SearchServer::Query &query) {
+                return search_server_.FindAllDocuments(query,
+                        search_server_.MakeOrdinalPredicate(
+                                document_predicate), top_k, mode);
+            });
+}
+
+/**
+ * @brief Ищет результат запроса в кеше, если его нет - вычисляет и запоминает
+ *
+ *  Результаты EvaluationMode::EXHAUSTIVE и PRUNED совпадают, поэтому способ
+ *  вычисления в ключ не входит.
+ *
+ * @param raw_query    Поисковые слова
+ * @param kind         Вид критерия поиска
+ * @param predicate_id Статус или номер критерия поиска
+ * @param top_k        Максимальное количество документов в результате
+ * @param search       Поиск по разобранному запросу с вычисленными IDF
+ * @return Результат поиска
+ */
+template<typename Search>
+vector<Document> QueryResultCache::Find(string_view raw_query,
+        PredicateKind kind, uint64_t predicate_id, size_t top_k,
+        Search search) {
+    SearchServer::Query query = search_server_.ParseQuery(raw_query, false);
+    const uint64_t epoch = search_server_.GetEpoch();
+    string key = MakeKey(query, kind, predicate_id, top_k);
+    vector<Document> documents;
+    if (Lookup(key, epoch, documents)) {
+        return documents;
+    }
+    search_server_.ComputeInverseDocumentFreqs(query);
+    documents = search(query);
+    Insert(move(key), epoch, documents);
+    return documents;
+}
@@ -1,50 +1,265 @@
-#include <iostream>
-#include <map>
-#include <set>
-#include <string>
-
-#include "remove_duplicates.h"
-#include "search_server.h"
-
-/**
- * @brief Функцию поиска и удаления дубликатов
- *
- *  Дубликатами считаются документы, у которых наборы встречающихся слов совпадают.
- *  Совпадение частот необязательно. Порядок слов неважен, а стоп-слова игнорируются.
- *  Функция использует только доступные к этому моменту методы поискового сервера.
- *  При обнаружении дублирующихся документов функция удаляет документ с большим id
- *  из поискового сервера, и при этом сообщает id удалённого документа в соответствии
- *  с форматом:
- *    "Found duplicate document id N"
- *    N - id удаляемого документа.
- *
- * @param search_server ссылка на поисковый сервер
- */
-void RemoveDuplicates(SearchServer &search_server) {
-    vector<int> duplicates_id;  // id дубликатов, которые следует удалить
-    set<set<string_view>> set_words; // набор наборов слов документов
-    for (const int document_id : search_server) {
-        // слова в документе document_id
-        map<string_view, double> word_freq = search_server.GetWordFrequencies(
-                document_id);
-        // собираем эти слова в set
-        set<string_view> words;
-        for (const auto &pair : word_freq) {
-            words.insert(pair.first);
-        }
-
-        if (set_words.count(words)) {
-            // уже есть набор из таких слов
-            duplicates_id.push_back(document_id);
-        } else {
-            // добавляем набор в набор наборов)
-            set_words.emplace(words);
-        }
-    }
-
-    // удаляем дубликаты
-    for (const int id : duplicates_id) {
-        cout << "Found duplicate document id "s << id << endl;
-        search_server.RemoveDocument(id);
-    }
-}
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <execution>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "hash_functions.h"
+#include "query_executor.h"
+#include "remove_duplicates.h"
+#include "search_server.h"
+
+using namespace std;
+
+namespace {
+
+// наименьшая вероятность, с которой документ со сходством, равным порогу,
+// становится кандидатом в почти-дубликаты
+constexpr double MIN_CANDIDATE_PROBABILITY = 0.99;
+
+/**
+ * @brief Документы сервера по возрастанию id и их слова
+ */
+struct DocumentTerms {
+    vector<int> ids;
+    vector<SearchServer::TermRange> terms;
+
+    explicit DocumentTerms(const SearchServer &search_server) {
+        ids.assign(search_server.begin(), search_server.end());
+        terms.reserve(ids.size());
+        for (const int document_id : ids) {
+            terms.push_back(search_server.GetDocumentTerms(document_id));
+        }
+    }
+};
+
+size_t GetTermCount(const SearchServer::TermRange &terms) {
+    return terms.second - terms.first;
+}
+
+// 64-битный отпечаток набора слов (слова документа упорядочены, поэтому
+// одинаковые наборы дают одинаковые отпечатки)
+uint64_t ComputeFingerprint(const SearchServer::TermRange &terms) {
+    uint64_t fingerprint = MixBits(GetTermCount(terms));
+    for (const TermId *term = terms.first; term != terms.second; ++term) {
+        fingerprint = MixBits(fingerprint ^ (*term + GOLDEN_RATIO_STEP));
+    }
+    return fingerprint;
+}
+
+bool IsSameTerms(const SearchServer::TermRange &lhs,
+        const SearchServer::TermRange &rhs) {
+    return equal(lhs.first, lhs.second, rhs.first, rhs.second);
+}
+
+// коэффициент Жаккара наборов слов (у двух пустых наборов - 1)
+double ComputeJaccard(const SearchServer::TermRange &lhs,
+        const SearchServer::TermRange &rhs) {
+    const size_t lhs_size = GetTermCount(lhs);
+    const size_t rhs_size = GetTermCount(rhs);
+    if (lhs_size == 0 && rhs_size == 0) {
+        return 1.0;
+    }
+    size_t intersection = 0;
+    const TermId *lhs_it = lhs.first;
+    const TermId *rhs_it = rhs.first;
+    while (lhs_it != lhs.second && rhs_it != rhs.second) {
+        if (*lhs_it < *rhs_it) {
+            ++lhs_it;
+        } else if (*rhs_it < *lhs_it) {
+            ++rhs_it;
+        } else {
+            ++intersection;
+            ++lhs_it;
+            ++rhs_it;
+        }
+    }
+    return intersection * 1.0 / (lhs_size + rhs_size - intersection);
+}
+
+/**
+ * @brief Выбирает разбиение подписи MinHash на полосы LSH
+ *
+ *  Документы со сходством s попадают в одну корзину хотя бы одной из b полос
+ *  по r значений с вероятностью 1 - (1 - s^r)^b. Выбирается наибольшее r
+ *  (меньше лишних кандидатов), при котором документ со сходством
+ *  min_similarity становится кандидатом с вероятностью не меньше
+ *  MIN_CANDIDATE_PROBABILITY (кандидаты всё равно проверяются точно).
+ *
+ * @return {количество полос, количество значений в полосе}
+ */
+pair<size_t, size_t> ChooseBands(size_t hash_count, double min_similarity) {
+    pair<size_t, size_t> best { hash_count, 1 };
+    for (size_t rows = 1; rows <= hash_count; ++rows) {
+        const size_t bands = hash_count / rows;
+        const double probability = 1.0
+                - pow(1.0 - pow(min_similarity, rows), bands);
+        if (probability >= MIN_CANDIDATE_PROBABILITY) {
+            best = { bands, rows };
+        }
+    }
+    return best;
+}
+
+void ReportAndRemove(SearchServer &search_server,
+        const vector<int> &duplicate_ids) {
+    for (const int id : duplicate_ids) {
+        cout << "Found duplicate document id "s << id << endl;
+    }
+    search_server.RemoveDocuments(execution::par, duplicate_ids);
+}
+
+}  // namespace
+
+/**
+ * @brief Ищет дубликаты
+ *
+ *  Дубликатами считаются документы, у которых наборы встречающихся слов совпадают.
+ *  Совпадение частот необязательно. Порядок слов неважен, а стоп-слова игнорируются.
+ *  Отпечатки наборов слов считаются параллельно, затем документы обходятся
+ *  по возрастанию id: документ с отпечатком, который уже встречался, сравнивается
+ *  со словами оставленных документов с тем же отпечатком.
+ *
+ * @param search_server ссылка на поисковый сервер
+ * @return id дубликатов (из каждой группы остаётся документ с меньшим id)
+ */
+vector<int> FindDuplicates(const SearchServer &search_server) {
+    const DocumentTerms documents(search_server);
+    vector<uint64_t> fingerprints(documents.ids.size());
+    ParallelFor(execution::par, documents.ids.size(),
+            [&documents, &fingerprints](size_t i) {
+                fingerprints[i] = ComputeFingerprint(documents.terms[i]);
+            });
+
+    vector<int> duplicate_ids;
+    // отпечаток -> оставленные документы с этим отпечатком
+    unordered_map<uint64_t, vector<size_t>> kept_documents;
+    kept_documents.reserve(documents.ids.size());
+    for (size_t i = 0; i < documents.ids.size(); ++i) {
+        vector<size_t> &kept = kept_documents[fingerprints[i]];
+        if (any_of(kept.begin(), kept.end(), [&documents, i](size_t other) {
+            return IsSameTerms(documents.terms[i], documents.terms[other]);
+        })) {
+            duplicate_ids.push_back(documents.ids[i]);
+        } else {
+            kept.push_back(i);
+        }
+    }
+    return duplicate_ids;
+}
+
+/**
+ * @brief Ищет почти-дубликаты (MinHash + LSH)
+ *
+ *  - для каждого документа параллельно считается подпись MinHash: для каждой
+ *    из hash_count хеш-функций - минимальный хеш слов документа (доля
+ *    совпадающих значений подписей двух документов - оценка коэффициента
+ *    Жаккара их наборов слов);
+ *  - подпись делится на полосы (ChooseBands), документы обходятся по
+ *    возрастанию id; кандидаты - оставленные документы, у которых хотя бы одна
+ *    полоса подписи совпадает;
+ *  - документ - почти-дубликат, если точный коэффициент Жаккара с одним
+ *    из кандидатов не меньше min_similarity, иначе он оставляется.
+ *
+ * @param search_server  ссылка на поисковый сервер
+ * @param min_similarity Наименьший коэффициент Жаккара почти-дубликатов
+ * @param hash_count     Количество хеш-функций MinHash
+ * @return id почти-дубликатов в порядке возрастания
+ */
+vector<int> FindNearDuplicates(const SearchServer &search_server,
+        double min_similarity, size_t hash_count) {
+    if (min_similarity >= 1.0) {
+        return FindDuplicates(search_server);
+    }
+    hash_count = max<size_t>(1, hash_count);
+    const DocumentTerms documents(search_server);
+    const size_t document_count = documents.ids.size();
+
+    vector<uint64_t> signatures(document_count * hash_count);
+    ParallelFor(execution::par, document_count,
+            [&documents, &signatures, hash_count](size_t i) {
+                uint64_t *signature = signatures.data() + i * hash_count;
+                fill(signature, signature + hash_count,
+                        numeric_limits<uint64_t>::max());
+                const SearchServer::TermRange &terms = documents.terms[i];
+                for (const TermId *term = terms.first; term != terms.second;
+                        ++term) {
+                    const uint64_t term_hash =
+                            MixBits(*term + GOLDEN_RATIO_STEP);
+                    for (size_t j = 0; j < hash_count; ++j) {
+                        signature[j] = min(signature[j], MixBits(term_hash
+                                + (j + 1) * GOLDEN_RATIO_STEP));
+                    }
+                }
+            });
+
+    const auto [band_count, band_size] = ChooseBands(hash_count,
+            min_similarity);
+    // корзины полос: хеш полосы подписи -> оставленные документы
+    vector<unordered_map<uint64_t, vector<size_t>>> band_buckets(band_count);
+    vector<uint64_t> band_keys(band_count);
+    vector<size_t> candidates;
+    vector<int> duplicate_ids;
+    for (size_t i = 0; i < document_count; ++i) {
+        const uint64_t *signature = signatures.data() + i * hash_count;
+        candidates.clear();
+        for (size_t band = 0; band < band_count; ++band) {
+            uint64_t key = MixBits(band);
+            for (size_t j = band * band_size; j < (band + 1) * band_size; ++j) {
+                key = MixBits(key ^ signature[j]);
+            }
+            band_keys[band] = key;
+            const auto it = band_buckets[band].find(key);
+            if (it != band_buckets[band].end()) {
+                candidates.insert(candidates.end(), it->second.begin(),
+                        it->second.end());
+            }
+        }
+        sort(candidates.begin(), candidates.end());
+        candidates.erase(unique(candidates.begin(), candidates.end()),
+                candidates.end());
+
+        if (any_of(candidates.begin(), candidates.end(),
+                [&documents, i, min_similarity](size_t other) {
+                    return ComputeJaccard(documents.terms[i],
+                            documents.terms[other]) >= min_similarity;
+                })) {
+            duplicate_ids.push_back(documents.ids[i]);
+        } else {
+            for (size_t band = 0; band < band_count; ++band) {
+                band_buckets[band][band_keys[band]].push_back(i);
+            }
+        }
+    }
+    return duplicate_ids;
+}
+
+/**
+ * @brief Функцию поиска и удаления дубликатов
+ *
+ *  Дубликаты (см. FindDuplicates) удаляются из поискового сервера одним
+ *  пакетом, id каждого удалённого документа сообщается в соответствии
+ *  с форматом:
+ *    "Found duplicate document id N"
+ *    N - id удаляемого документа.
+ *
+ * @param search_server ссылка на поисковый сервер
+ */
+void RemoveDuplicates(SearchServer &search_server) {
+    ReportAndRemove(search_server, FindDuplicates(search_server));
+}
+
+/**
+ * @brief Удаляет почти-дубликаты (см. FindNearDuplicates)
+ *
+ * @param search_server  ссылка на поисковый сервер
+ * @param min_similarity Наименьший коэффициент Жаккара почти-дубликатов
+ */
+void RemoveNearDuplicates(SearchServer &search_server, double min_similarity) {
+    ReportAndRemove(search_server,
+            FindNearDuplicates(search_server, min_similarity));
+}
@@ -1,5 +1,22 @@
-#pragma once
-
-#include "search_server.h"
-
-void RemoveDuplicates(SearchServer &search_server);
+#pragma once
+
+#include <vector>
+
+#include "search_server.h"
+
+// количество хеш-функций MinHash при поиске почти-дубликатов по умолчанию
+const size_t DEFAULT_MINHASH_COUNT = 128;
+
+// id дубликатов (документов, набор слов которых совпадает с набором слов
+// документа с меньшим id) в порядке возрастания
+vector<int> FindDuplicates(const SearchServer &search_server);
+
+// id почти-дубликатов: документов, коэффициент Жаккара наборов слов которых
+// с одним из оставляемых документов с меньшим id не меньше min_similarity
+// (кандидаты отбираются MinHash + LSH, сходство кандидатов проверяется точно)
+vector<int> FindNearDuplicates(const SearchServer &search_server,
+        double min_similarity, size_t hash_count = DEFAULT_MINHASH_COUNT);
+
+void RemoveDuplicates(SearchServer &search_server);
+
+void RemoveNearDuplicates(SearchServer &search_server, double min_similarity);
@@ -1,42 +1,68 @@
 #pragma once
 
+#include <chrono>
 #include <string>
 #include <vector>
-#include <deque>
 
 #include "document.h"
+#include "request_statistics.h"
 #include "search_server.h"
 
 using namespace std;
 
+// количество последних запросов, по которым считается статистика
+// (запрос в минуту - сутки)
+const size_t REQUEST_WINDOW_SIZE = 1440;
+
+/**
+ * @brief Очередь запросов к поисковому серверу со статистикой последних
+ *        REQUEST_WINDOW_SIZE запросов
+ *
+ *  Все перегрузки AddFindRequest записывают в статистику признак пустого
+ *  результата и время выполнения запроса. Методы можно вызывать из
+ *  нескольких потоков одновременно (статистика не использует блокировок).
+ */
 class RequestQueue {
 public:
     explicit RequestQueue(const SearchServer &search_server);
 
     template<typename DocumentPredicate>
-    vector<Document> AddFindRequest(const string &raw_query,
+    vector<Document> AddFindRequest(string_view raw_query,
             DocumentPredicate document_predicate);
-    vector<Document> AddFindRequest(const string &raw_query,
+    vector<Document> AddFindRequest(string_view raw_query,
             DocumentStatus status);
-    vector<Document> AddFindRequest(const string &raw_query);
+    vector<Document> AddFindRequest(string_view raw_query);
 
+    // количество запросов с пустым результатом среди последних
+    // REQUEST_WINDOW_SIZE запросов
     int GetNoResultRequests() const;
 
+    // количество запросов, запросы в секунду и процентили задержек
+    // последних REQUEST_WINDOW_SIZE запросов
+    RequestStatistics::Stats GetStats() const;
+
 private:
-    struct QueryResult {
-        int time;
-        bool status = false;
-        int number_query_without_result = 0;
-    };
-
-    const static int min_in_day_ = 1440;
-    deque<QueryResult> requests_;
     const SearchServer &search_server_;
-    int current_time_ = 0;
+    RequestStatistics statistics_;
+
+    // выполняет поиск search и записывает запрос в статистику
+    template<typename Search>
+    vector<Document> Record(Search search);
 };
 
+template<typename Search>
+vector<Document> RequestQueue::Record(Search search) {
+    const auto start = RequestStatistics::Clock::now();
+    vector<Document> result = search();
+    statistics_.AddRequest(result.empty(),
+            RequestStatistics::Clock::now() - start);
+    return result;
+}
+
 template<typename DocumentPredicate>
-vector<Document> RequestQueue::AddFindRequest(const string &raw_query,
+vector<Document> RequestQueue::AddFindRequest(string_view raw_query,
         DocumentPredicate document_predicate) {
-    return search_server_.FindTopDocuments(raw_query, document_predicate);
+    return Record([this, raw_query, &document_predicate] {
+        return search_server_.FindTopDocuments(raw_query, document_predicate);
+    });
 }
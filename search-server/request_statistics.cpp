@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "request_statistics.h"
+
+using namespace std;
+
+void LatencyHistogram::Add(Duration latency) {
+    const uint64_t nanoseconds = static_cast<uint64_t>(max<Duration::rep>(0,
+            latency.count()));
+    ++counts_[GetBucket(nanoseconds)];
+    ++count_;
+    max_ = max(max_, nanoseconds);
+}
+
+/**
+ * @brief Процентиль задержек
+ *
+ * @param fraction Доля задержек (0.5 - медиана, 0.99 - 99-й процентиль)
+ * @return Верхняя граница корзины, в которую попадает задержка с номером
+ *         ceil(fraction * количество) по возрастанию (но не больше
+ *         наибольшей задержки)
+ */
+LatencyHistogram::Duration LatencyHistogram::GetPercentile(
+        double fraction) const {
+    if (count_ == 0) {
+        return Duration(0);
+    }
+    const uint64_t rank = max<uint64_t>(1,
+            static_cast<uint64_t>(ceil(clamp(fraction, 0.0, 1.0) * count_)));
+    uint64_t total = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        total += counts_[bucket];
+        if (total >= rank) {
+            return Duration(min(GetBucketUpperBound(bucket), max_));
+        }
+    }
+    return Duration(max_);
+}
+
+size_t LatencyHistogram::GetBucket(uint64_t nanoseconds) {
+    if (nanoseconds < SUB_BUCKET_COUNT) {
+        return nanoseconds;
+    }
+    // номер старшего бита (не меньше SUB_BUCKET_BITS) и следующие за ним
+    // SUB_BUCKET_BITS бит
+    const int exponent = 63 - __builtin_clzll(nanoseconds);
+    const size_t sub_bucket = (nanoseconds >> (exponent - SUB_BUCKET_BITS))
+            & (SUB_BUCKET_COUNT - 1);
+    return SUB_BUCKET_COUNT + (exponent - SUB_BUCKET_BITS) * SUB_BUCKET_COUNT
+            + sub_bucket;
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t bucket) {
+    if (bucket < SUB_BUCKET_COUNT) {
+        return bucket;
+    }
+    const int shift = static_cast<int>((bucket - SUB_BUCKET_COUNT)
+            / SUB_BUCKET_COUNT);
+    const uint64_t sub_bucket = (bucket - SUB_BUCKET_COUNT) % SUB_BUCKET_COUNT;
+    const uint64_t lower = (SUB_BUCKET_COUNT + sub_bucket) << shift;
+    return lower + ((uint64_t(1) << shift) - 1);
+}
+
+RequestStatistics::RequestStatistics(size_t window_size) :
+        window_size_(max<size_t>(1, window_size)), slots_(
+                make_unique<Slot[]>(window_size_)) {
+}
+
+/**
+ * @brief Записывает запрос в окно
+ *
+ *  Ячейка сначала помечается как записываемая (sequence = 0), затем
+ *  записываются данные и номер запроса, поэтому читатель, увидевший до
+ *  и после чтения данных один и тот же номер, прочитал данные этого запроса.
+ *
+ * @param is_empty Результат запроса пустой
+ * @param latency  Время выполнения запроса
+ */
+void RequestStatistics::AddRequest(bool is_empty,
+        LatencyHistogram::Duration latency) {
+    const uint64_t number = request_count_.fetch_add(1,
+            memory_order_relaxed);
+    Slot &slot = slots_[number % window_size_];
+    slot.sequence.store(0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot.latency.store(static_cast<uint64_t>(latency.count()),
+            memory_order_relaxed);
+    slot.finish_time.store(
+            chrono::duration_cast<chrono::nanoseconds>(
+                    Clock::now().time_since_epoch()).count(),
+            memory_order_relaxed);
+    slot.sequence.store((number + 1) * 2 + (is_empty ? 1 : 0),
+            memory_order_release);
+}
+
+template<typename Action>
+void RequestStatistics::ForEachRequest(Action action) const {
+    const uint64_t request_count = request_count_.load(memory_order_acquire);
+    // номера запросов окна: [first, request_count)
+    const uint64_t first =
+            request_count > window_size_ ? request_count - window_size_ : 0;
+    for (size_t i = 0; i < window_size_; ++i) {
+        const Slot &slot = slots_[i];
+        const uint64_t sequence = slot.sequence.load(memory_order_acquire);
+        if (sequence == 0) {
+            continue;
+        }
+        const uint64_t number = sequence / 2 - 1;
+        if (number < first || number >= request_count) {
+            continue;
+        }
+        const Request request { sequence % 2 == 1, slot.latency.load(
+                memory_order_relaxed), slot.finish_time.load(
+                memory_order_relaxed) };
+        atomic_thread_fence(memory_order_acquire);
+        if (slot.sequence.load(memory_order_relaxed) == sequence) {
+            action(request);
+        }
+    }
+}
+
+uint64_t RequestStatistics::GetNoResultRequests() const {
+    uint64_t no_result_count = 0;
+    ForEachRequest([&no_result_count](const Request &request) {
+        no_result_count += request.is_empty ? 1 : 0;
+    });
+    return no_result_count;
+}
+
+/**
+ * @brief Статистика запросов окна
+ *
+ * @return Количество запросов и запросов с пустым результатом, запросы
+ *         в секунду и гистограмма задержек
+ */
+RequestStatistics::Stats RequestStatistics::GetStats() const {
+    Stats stats;
+    int64_t first_finish = numeric_limits<int64_t>::max();
+    int64_t last_finish = numeric_limits<int64_t>::min();
+    ForEachRequest([&](const Request &request) {
+        ++stats.request_count;
+        stats.no_result_count += request.is_empty ? 1 : 0;
+        stats.latencies.Add(LatencyHistogram::Duration(request.latency));
+        first_finish = min(first_finish, request.finish_time);
+        last_finish = max(last_finish, request.finish_time);
+    });
+    if (stats.request_count > 1 && last_finish > first_finish) {
+        // между первым и последним завершениями - request_count - 1 запросов
+        stats.queries_per_second = (stats.request_count - 1) * 1e9
+                / (last_finish - first_finish);
+    }
+    return stats;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+using namespace std;
+
+/**
+ * @brief Гистограмма задержек с логарифмическими корзинами (как HDR Histogram)
+ *
+ *  Задержки до 2^SUB_BUCKET_BITS нс хранятся точно, остальные - в корзинах:
+ *  каждый интервал [2^k, 2^(k+1)) делится на 2^SUB_BUCKET_BITS равных частей,
+ *  поэтому относительная погрешность процентиля не больше 1/2^SUB_BUCKET_BITS
+ *  при фиксированном размере гистограммы.
+ */
+class LatencyHistogram {
+public:
+    using Duration = chrono::nanoseconds;
+
+    void Add(Duration latency);
+
+    uint64_t GetCount() const {
+        return count_;
+    }
+
+    // задержка, не меньше которой доля fraction (0..1) задержек
+    // (верхняя граница корзины; 0, если задержек нет)
+    Duration GetPercentile(double fraction) const;
+
+    Duration GetMax() const {
+        return Duration(max_);
+    }
+
+private:
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr size_t SUB_BUCKET_COUNT = size_t(1) << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT = SUB_BUCKET_COUNT
+            + (64 - SUB_BUCKET_BITS) * SUB_BUCKET_COUNT;
+
+    array<uint64_t, BUCKET_COUNT> counts_ { };
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+
+    static size_t GetBucket(uint64_t nanoseconds);
+    // наибольшая задержка корзины
+    static uint64_t GetBucketUpperBound(size_t bucket);
+};
+
+/**
+ * @brief Статистика последних запросов (скользящее окно)
+ *
+ *  Окно - последние window_size запросов в кольцевом буфере фиксированного
+ *  размера. Запрос получает номер атомарным счётчиком и записывает в свою
+ *  ячейку (номер запроса % window_size) признак пустого результата, задержку
+ *  и время завершения; блокировок нет, поэтому AddRequest можно вызывать
+ *  из любого количества потоков. GetStats просматривает ячейки окна
+ *  (window_size атомарных чтений) и не мешает записи, поэтому статистику
+ *  можно снимать, например, каждую секунду из потока мониторинга. Запросы,
+ *  номер которых уже выдан, но которые ещё не записаны, в статистику
+ *  не попадают.
+ */
+class RequestStatistics {
+public:
+    using Clock = chrono::steady_clock;
+
+    struct Stats {
+        // запросы в окне и запросы с пустым результатом
+        uint64_t request_count = 0;
+        uint64_t no_result_count = 0;
+        // запросов в секунду: запросы окна за время от первого до последнего
+        double queries_per_second = 0.0;
+        // задержки запросов окна
+        LatencyHistogram latencies;
+    };
+
+    explicit RequestStatistics(size_t window_size);
+
+    void AddRequest(bool is_empty, LatencyHistogram::Duration latency);
+
+    // количество запросов с пустым результатом в окне
+    uint64_t GetNoResultRequests() const;
+
+    Stats GetStats() const;
+
+    size_t GetWindowSize() const {
+        return window_size_;
+    }
+
+private:
+    // ячейка запроса. sequence - (номер запроса + 1) * 2 + признак пустого
+    // результата, 0 - ячейка записывается
+    struct Slot {
+        atomic<uint64_t> sequence { 0 };
+        atomic<uint64_t> latency { 0 };
+        atomic<int64_t> finish_time { 0 };
+    };
+
+    // данные запроса, прочитанные из ячейки
+    struct Request {
+        bool is_empty;
+        uint64_t latency;
+        int64_t finish_time;
+    };
+
+    size_t window_size_;
+    unique_ptr<Slot[]> slots_;
+    atomic<uint64_t> request_count_ { 0 };
+
+    // обходит записанные запросы окна
+    template<typename Action>
+    void ForEachRequest(Action action) const;
+};
@@ -0,0 +1,61 @@
+#include "score_accumulator.h"
+
+using namespace std;
+
+namespace {
+
+// накопитель потока и признак того, что он сейчас используется
+struct ThreadAccumulator {
+    ScoreAccumulator accumulator;
+    bool in_use = false;
+};
+
+thread_local ThreadAccumulator thread_accumulator;
+
+}  // namespace
+
+ScoreAccumulator::Lease::Lease() {
+    if (thread_accumulator.in_use) {
+        own_accumulator_ = make_unique<ScoreAccumulator>();
+        accumulator_ = own_accumulator_.get();
+    } else {
+        thread_accumulator.in_use = true;
+        accumulator_ = &thread_accumulator.accumulator;
+    }
+}
+
+ScoreAccumulator::Lease::~Lease() {
+    accumulator_->Clear();
+    if (!own_accumulator_) {
+        thread_accumulator.in_use = false;
+    }
+}
+
+/**
+ * @brief Готовит накопитель к обработке диапазона номеров документов
+ *
+ *  Массивы только увеличиваются, уже выделенная память переиспользуется.
+ *
+ * @param first Первый номер документа диапазона
+ * @param size  Количество номеров в диапазоне
+ */
+void ScoreAccumulator::Reset(DocumentOrdinal first, size_t size) {
+    Clear();
+    first_ = first;
+    if (relevances_.size() < size) {
+        relevances_.resize(size, 0.0);
+        states_.resize(size, UNTOUCHED);
+    }
+}
+
+void ScoreAccumulator::Clear() {
+    for (const uint32_t index : touched_) {
+        relevances_[index] = 0.0;
+        states_[index] = UNTOUCHED;
+    }
+    touched_.clear();
+    for (const uint32_t index : excluded_) {
+        states_[index] = UNTOUCHED;
+    }
+    excluded_.clear();
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "document.h"
+
+using namespace std;
+
+/**
+ * @brief Накопитель релевантности документов для одного поискового запроса
+ *
+ *  Релевантность хранится в плотном массиве, индексируемом внутренним номером
+ *  документа (относительно начала обрабатываемого диапазона номеров), а номера
+ *  документов, к которым было обращение, запоминаются в отдельном списке:
+ *  по нему проходит выдача результатов и очистка накопителя, поэтому
+ *  стоимость запроса не зависит от размера массива.
+ *  Документы с минус-словами исключаются до подсчёта релевантности: Add
+ *  исключённому документу ничего не делает, а сами исключённые документы
+ *  запоминаются в своём списке (только для очистки), поэтому выдача
+ *  результатов проходит только по документам, получившим релевантность.
+ *
+ *  Массивы переиспользуются между запросами: каждый поток получает свой
+ *  накопитель через Lease, синхронизация не нужна.
+ */
+class ScoreAccumulator {
+public:
+    // доступ к накопителю текущего потока (на время жизни объекта Lease)
+    class Lease {
+    public:
+        Lease();
+        ~Lease();
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        ScoreAccumulator& operator*() const {
+            return *accumulator_;
+        }
+        ScoreAccumulator* operator->() const {
+            return accumulator_;
+        }
+
+    private:
+        ScoreAccumulator *accumulator_;
+        // если накопитель потока уже занят (вложенный поиск),
+        // выдаётся временный накопитель
+        unique_ptr<ScoreAccumulator> own_accumulator_;
+    };
+
+    // готовит накопитель к обработке номеров документов [first, first + size)
+    void Reset(DocumentOrdinal first, size_t size);
+
+    // добавляет релевантность документу (если он не исключён)
+    void Add(DocumentOrdinal ordinal, double relevance) {
+        const size_t index = ordinal - first_;
+        if (states_[index] == UNTOUCHED) {
+            states_[index] = SCORED;
+            touched_.push_back(index);
+        }
+        if (states_[index] == SCORED) {
+            relevances_[index] += relevance;
+        }
+    }
+
+    // исключает документ из результатов (до или после Add)
+    void Exclude(DocumentOrdinal ordinal) {
+        const size_t index = ordinal - first_;
+        if (states_[index] == UNTOUCHED) {
+            excluded_.push_back(index);
+        }
+        states_[index] = EXCLUDED;
+    }
+
+    // исключает документы, получившие релевантность, для которых
+    // predicate(номер документа) возвращает true
+    template<typename Predicate>
+    void ExcludeIf(Predicate predicate);
+
+    // вызывает action(номер документа, релевантность) для всех документов,
+    // получивших релевантность и не исключённых
+    template<typename Action>
+    void ForEachScored(Action action) const;
+
+    // возвращает накопитель в исходное состояние
+    void Clear();
+
+private:
+    enum State : uint8_t {
+        UNTOUCHED, SCORED, EXCLUDED,
+    };
+
+    DocumentOrdinal first_ = 0;
+    vector<double> relevances_;
+    vector<State> states_;
+    vector<uint32_t> touched_;  // индексы документов, получивших релевантность
+    // индексы документов, исключённых до получения релевантности
+    vector<uint32_t> excluded_;
+};
+
+template<typename Predicate>
+void ScoreAccumulator::ExcludeIf(Predicate predicate) {
+    for (const uint32_t index : touched_) {
+        if (states_[index] == SCORED
+                && predicate(static_cast<DocumentOrdinal>(first_ + index))) {
+            states_[index] = EXCLUDED;
+        }
+    }
+}
+
+template<typename Action>
+void ScoreAccumulator::ForEachScored(Action action) const {
+    for (const uint32_t index : touched_) {
+        if (states_[index] == SCORED) {
+            action(static_cast<DocumentOrdinal>(first_ + index),
+                    relevances_[index]);
+        }
+    }
+}
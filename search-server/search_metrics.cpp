@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "search_metrics.h"
+
+using namespace std;
+
+// без SEARCH_SERVER_METRICS метрики не собираются и не компилируются
+#ifdef SEARCH_SERVER_METRICS
+namespace {
+
+// счётчики одного потока (пишет только поток-владелец, читает Collect)
+struct alignas(64) ThreadBlock {
+    array<atomic<int64_t>, SearchMetrics::STAGE_COUNT> stage_times { };
+    array<atomic<uint64_t>, SearchMetrics::COUNTER_COUNT> counters { };
+    // выполняемый этап (Stage::COUNT - нет этапа); только для владельца
+    SearchMetrics::Stage current_stage = SearchMetrics::Stage::COUNT;
+};
+
+// блоки всех потоков; блоки не удаляются, поэтому счётчики завершившихся
+// потоков остаются в суммах
+struct Registry {
+    mutex blocks_mutex;
+    vector<unique_ptr<ThreadBlock>> blocks;
+};
+
+Registry& GetRegistry() {
+    // не уничтожается при завершении программы: потоки могут писать
+    // в свои блоки до самого конца
+    static Registry *registry = new Registry;
+    return *registry;
+}
+
+// блок текущего потока (nullptr, пока поток не записал ни одной метрики)
+thread_local ThreadBlock *thread_block = nullptr;
+
+ThreadBlock& GetThreadBlock() {
+    if (thread_block == nullptr) {
+        auto block = make_unique<ThreadBlock>();
+        Registry &registry = GetRegistry();
+        lock_guard guard(registry.blocks_mutex);
+        registry.blocks.push_back(move(block));
+        thread_block = registry.blocks.back().get();
+    }
+    return *thread_block;
+}
+
+// прибавление к счётчику, в который пишет только текущий поток
+template<typename T>
+void AddOwned(atomic<T> &value, T delta) {
+    value.store(value.load(memory_order_relaxed) + delta,
+            memory_order_relaxed);
+}
+
+}  // namespace
+
+void SearchMetrics::Add(Counter counter, uint64_t value) {
+    AddOwned(GetThreadBlock().counters[static_cast<size_t>(counter)], value);
+}
+
+SearchMetrics::Snapshot SearchMetrics::Collect() {
+    Snapshot snapshot;
+    Registry &registry = GetRegistry();
+    lock_guard guard(registry.blocks_mutex);
+    for (const auto &block : registry.blocks) {
+        for (size_t i = 0; i < STAGE_COUNT; ++i) {
+            snapshot.stage_times[i] += chrono::nanoseconds(
+                    block->stage_times[i].load(memory_order_relaxed));
+        }
+        for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+            snapshot.counters[i] += block->counters[i].load(
+                    memory_order_relaxed);
+        }
+    }
+    // этап, из которого вычтено время вложенного, но который ещё не закончен,
+    // может временно иметь отрицательное время
+    for (chrono::nanoseconds &time : snapshot.stage_times) {
+        time = max(time, chrono::nanoseconds(0));
+    }
+    return snapshot;
+}
+
+/**
+ * @brief Записывает метрики в текстовом формате Prometheus
+ *
+ *  search_stage_seconds_total{stage="..."} - собственное время этапов,
+ *  search_<счётчик>_total - счётчики.
+ *
+ * @param output Поток вывода
+ */
+void SearchMetrics::WritePrometheus(ostream &output) {
+    const Snapshot snapshot = Collect();
+    output << "# HELP search_stage_seconds_total Собственное время этапов поиска\n"s
+            << "# TYPE search_stage_seconds_total counter\n"s;
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        output << "search_stage_seconds_total{stage=\""s
+                << GetName(static_cast<Stage>(i)) << "\"} "s
+                << chrono::duration<double>(snapshot.stage_times[i]).count()
+                << '\n';
+    }
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        const string name = "search_"s + GetName(static_cast<Counter>(i))
+                + "_total"s;
+        output << "# TYPE "s << name << " counter\n"s << name << ' '
+                << snapshot.counters[i] << '\n';
+    }
+}
+
+const char* SearchMetrics::GetName(Stage stage) {
+    switch (stage) {
+    case Stage::PARSE:
+        return "parse";
+    case Stage::POSTINGS:
+        return "postings";
+    case Stage::PREDICATE:
+        return "predicate";
+    case Stage::MINUS_WORDS:
+        return "minus_words";
+    case Stage::TOP_K:
+        return "top_k";
+    default:
+        return "unknown";
+    }
+}
+
+const char* SearchMetrics::GetName(Counter counter) {
+    switch (counter) {
+    case Counter::QUERIES:
+        return "queries";
+    case Counter::POSTINGS_SCANNED:
+        return "postings_scanned";
+    case Counter::DOCUMENTS_SCORED:
+        return "documents_scored";
+    case Counter::ALLOCATIONS:
+        return "allocations";
+    default:
+        return "unknown";
+    }
+}
+
+SearchMetrics::StageTimer::StageTimer(Stage stage) :
+        stage_(stage), parent_(GetThreadBlock().current_stage), start_(
+                chrono::steady_clock::now()) {
+    thread_block->current_stage = stage;
+}
+
+SearchMetrics::StageTimer::~StageTimer() {
+    const int64_t elapsed = chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now() - start_).count();
+    ThreadBlock &block = *thread_block;
+    AddOwned(block.stage_times[static_cast<size_t>(stage_)], elapsed);
+    if (parent_ != Stage::COUNT) {
+        AddOwned(block.stage_times[static_cast<size_t>(parent_)], -elapsed);
+    }
+    block.current_stage = parent_;
+}
+
+// выделения памяти считаются, пока у потока выполняется этап поиска;
+// заменены все замещаемые формы operator new и operator delete
+// (обычные, для массивов, с выравниванием и nothrow), поэтому учитывается
+// любое выделение через new, кроме размещающего new
+namespace {
+
+// alignment == 0 - выравнивание по умолчанию
+void* Allocate(size_t size, size_t alignment) {
+    if (thread_block != nullptr
+            && thread_block->current_stage != SearchMetrics::Stage::COUNT) {
+        AddOwned(thread_block->counters[static_cast<size_t>(
+                SearchMetrics::Counter::ALLOCATIONS)], uint64_t(1));
+    }
+    if (size == 0) {
+        size = 1;
+    }
+    if (alignment != 0) {
+        alignment = max(alignment, sizeof(void*));
+        // aligned_alloc требует размер, кратный выравниванию
+        size = (size + alignment - 1) / alignment * alignment;
+    }
+    while (true) {
+        if (void *pointer = alignment == 0 ?
+                malloc(size) : aligned_alloc(alignment, size)) {
+            return pointer;
+        }
+        new_handler handler = get_new_handler();
+        if (handler == nullptr) {
+            throw bad_alloc();
+        }
+        handler();
+    }
+}
+
+void* AllocateNoThrow(size_t size, size_t alignment) noexcept {
+    try {
+        return Allocate(size, alignment);
+    } catch (const bad_alloc&) {
+        return nullptr;
+    }
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+    return Allocate(size, 0);
+}
+
+void* operator new[](size_t size) {
+    return Allocate(size, 0);
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+    return Allocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, align_val_t alignment) {
+    return Allocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept {
+    return AllocateNoThrow(size, 0);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept {
+    return AllocateNoThrow(size, 0);
+}
+
+void* operator new(size_t size, align_val_t alignment,
+        const nothrow_t&) noexcept {
+    return AllocateNoThrow(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, align_val_t alignment,
+        const nothrow_t&) noexcept {
+    return AllocateNoThrow(size, static_cast<size_t>(alignment));
+}
+
+// память, выделенная malloc и aligned_alloc, освобождается free
+void operator delete(void *pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept {
+    free(pointer);
+}
+
+void operator delete(void *pointer, align_val_t) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void *pointer, align_val_t) noexcept {
+    free(pointer);
+}
+
+void operator delete(void *pointer, size_t, align_val_t) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void *pointer, size_t, align_val_t) noexcept {
+    free(pointer);
+}
+
+void operator delete(void *pointer, const nothrow_t&) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void *pointer, const nothrow_t&) noexcept {
+    free(pointer);
+}
+
+void operator delete(void *pointer, align_val_t, const nothrow_t&) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void *pointer, align_val_t, const nothrow_t&) noexcept {
+    free(pointer);
+}
+#endif
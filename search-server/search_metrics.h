@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+using namespace std;
+
+/**
+ * @brief Метрики поиска: время этапов запроса и счётчики
+ *
+ *  Собираются, только если программа собрана с макросом SEARCH_SERVER_METRICS
+ *  (например, -DSEARCH_SERVER_METRICS); без него макросы SEARCH_METRICS_*
+ *  не генерируют никакого кода, а методы SearchMetrics не определены
+ *  (search_metrics.cpp пуст, operator new не заменяется).
+ *  - у каждого потока свой блок счётчиков, в который пишет только он
+ *    (без атомарных операций чтения-изменения-записи и без общих строк кеша);
+ *    Collect суммирует блоки всех потоков;
+ *  - время этапа - собственное время: время вложенного этапа (например,
+ *    проверки минус-слов внутри обхода списков документов) вычитается
+ *    из времени объемлющего;
+ *  - ALLOCATIONS - выделения памяти потоком через любую замещаемую форму
+ *    operator new (в том числе new[], с выравниванием и nothrow), пока
+ *    у него выполняется какой-либо этап; прямые вызовы malloc
+ *    не учитываются.
+ */
+class SearchMetrics {
+public:
+    enum class Stage : uint8_t {
+        PARSE,        // разбор запроса и IDF слов
+        POSTINGS,     // обход списков документов плюс-слов
+        PREDICATE,    // проверка критерия поиска
+        MINUS_WORDS,  // исключение документов с минус-словами
+        TOP_K,        // отбор лучших документов
+        COUNT,
+    };
+
+    enum class Counter : uint8_t {
+        QUERIES,           // выполненные запросы
+        POSTINGS_SCANNED,  // просмотренные записи списков документов
+        DOCUMENTS_SCORED,  // документы, переданные в отбор лучших
+        ALLOCATIONS,       // выделения памяти во время этапов
+        COUNT,
+    };
+
+    static constexpr size_t STAGE_COUNT = static_cast<size_t>(Stage::COUNT);
+    static constexpr size_t COUNTER_COUNT = static_cast<size_t>(Counter::COUNT);
+
+    // суммы по всем потокам
+    struct Snapshot {
+        array<chrono::nanoseconds, STAGE_COUNT> stage_times { };
+        array<uint64_t, COUNTER_COUNT> counters { };
+    };
+
+    static void Add(Counter counter, uint64_t value);
+
+    static Snapshot Collect();
+
+    // метрики в текстовом формате Prometheus
+    static void WritePrometheus(ostream &output);
+
+    static const char* GetName(Stage stage);
+    static const char* GetName(Counter counter);
+
+    /**
+     * @brief Замеряет время этапа от создания до уничтожения объекта
+     */
+    class StageTimer {
+    public:
+        explicit StageTimer(Stage stage);
+        ~StageTimer();
+        StageTimer(const StageTimer&) = delete;
+        StageTimer& operator=(const StageTimer&) = delete;
+
+    private:
+        Stage stage_;
+        // этап, который выполнялся до этого (или Stage::COUNT)
+        Stage parent_;
+        chrono::steady_clock::time_point start_;
+    };
+};
+
+#ifdef SEARCH_SERVER_METRICS
+#define SEARCH_METRICS_CONCAT_INTERNAL(X, Y) X##Y
+#define SEARCH_METRICS_CONCAT(X, Y) SEARCH_METRICS_CONCAT_INTERNAL(X, Y)
+#define SEARCH_METRICS_STAGE(stage) SearchMetrics::StageTimer \
+        SEARCH_METRICS_CONCAT(search_metrics_stage_, __LINE__)( \
+                SearchMetrics::Stage::stage)
+#define SEARCH_METRICS_COUNT(counter, value) SearchMetrics::Add( \
+        SearchMetrics::Counter::counter, (value))
+#else
+#define SEARCH_METRICS_STAGE(stage)
+#define SEARCH_METRICS_COUNT(counter, value)
+#endif
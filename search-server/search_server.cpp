@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <iostream>
 #include <iterator>
@@ -7,6 +8,7 @@
 #include <set>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "document.h"
@@ -16,6 +18,48 @@
 
 using namespace std;
 
+namespace {
+
+// сообщения об ошибках добавления документа
+const string NEGATIVE_ID_MESSAGE =
+        "Попытка добавления документа с отрицательный id !!!"s;
+const string DUPLICATE_ID_MESSAGE =
+        "Попытка добавления документа с id ранее добавленного документа !!!"s;
+const string INVALID_CHARACTERS_MESSAGE = "недопустимые символы!!!"s;
+const string INVALID_QUERY_MESSAGE = "недопустимые символы в запросе !!!"s;
+
+// слова разбираемого запроса (буфер потока, чтобы не выделять память на
+// каждый запрос)
+thread_local vector<string_view> query_words;
+
+/**
+ * @brief Часть пакета документов AddDocuments, разобранная на слова
+ *
+ *  Слова документов части хранятся в собственном словаре части (в индекс
+ *  сервера попадают только слова добавленных документов). Слова документа
+ *  с номером i в пакете - элементы [word_ends[i - first - 1], word_ends[i - first])
+ *  массивов words и word_counts, отсортированные по идентификатору слова.
+ */
+struct BatchPart {
+    size_t first;  // номер первого документа части в пакете
+    size_t last;   // номер документа после последнего документа части
+    TermDictionary dictionary;
+    vector<size_t> word_ends;
+    vector<TermId> words;
+    vector<uint32_t> word_counts;
+    vector<size_t> document_word_counts;  // количество слов (без стоп-слов)
+    vector<int> ratings;                  // ср.рейтинг
+    vector<const string*> errors;         // сообщение об ошибке или nullptr
+};
+
+}  // namespace
+
+uint64_t SearchServer::Epoch::Next() {
+    // номера всех серверов процесса; первый номер - 1
+    static atomic<uint64_t> last_epoch = 0;
+    return last_epoch.fetch_add(1, memory_order_relaxed) + 1;
+}
+
 SearchServer::SearchServer(string stop_words_text) :
         SearchServer(SplitIntoWords(stop_words_text)) {
 }
@@ -32,10 +76,13 @@ SearchServer::SearchServer(string_view stop_words_text) :
  *  - расчитывает ср.рейтинг (средний рейтинг слов в документе),
  *  - расчитывает TF (term frequency) слова в документе
  *  результаты заносит в контейнеры:
- *  - documents_ (id документа, ср.рейтинг, статус)
- *  - documents_ids_
- *  - word_to_document_freqs_ (слово, map<id документа, TF>)
- *  - document_to_word_freqs_ (id документа, map<слово, TF>)
+ *  - documents_ (id документа -> внутренний номер, ср.рейтинг, статус,
+ *    количество слов)
+ *  - dictionary_ (слово -> идентификатор слова)
+ *  - word_to_document_freqs_ (идентификатор слова, список документов
+ *    с количеством вхождений слова)
+ *  - document_words_, document_word_counts_ (слова документа с количеством
+ *    вхождений, квантованным до 16 бит)
  *
  * @param document_id id документа
  * @param document    Текст документа
@@ -45,105 +92,447 @@ SearchServer::SearchServer(string_view stop_words_text) :
 void SearchServer::AddDocument(int document_id, string_view document,
         DocumentStatus status, const vector<int> &ratings) {
     if (document_id < 0) {
-        throw invalid_argument(
-                "Попытка добавления документа с отрицательный id !!!"s);
+        throw invalid_argument(NEGATIVE_ID_MESSAGE);
     }
-    if (documents_.count(document_id) > 0) {
-        throw invalid_argument(
-                "Попытка добавления документа с id ранее добавленного документа !!!"s);
+    if (documents_.Find(document_id) != DocumentStore::NO_DOCUMENT) {
+        throw invalid_argument(DUPLICATE_ID_MESSAGE);
     }
-    if (!IsValidWord(document)) {
-        throw invalid_argument("недопустимые символы!!!"s);
+    vector<string_view> words;
+    if (!SplitIntoWordsNoStop(document, words)) {
+        throw invalid_argument(INVALID_CHARACTERS_MESSAGE);
     }
-    vector<string_view> words = SplitIntoWordsNoStop(document);
-    const double inv_word_count = 1.0 / words.size();
+    map<TermId, uint32_t> term_counts;
     for (string_view word : words) {
-        string str_word { word };
-        auto it_word = find(all_words_.begin(), all_words_.end(), str_word);
-        if (it_word == all_words_.end()) {
-            all_words_.push_back(str_word);
-            it_word = --all_words_.end();
+        ++term_counts[dictionary_.Intern(word)];
+    }
+    const DocumentOrdinal ordinal = documents_.Add(document_id,
+            ComputeAverageRating(ratings), status, words.size());
+    word_to_document_freqs_.resize(dictionary_.size());
+    vector<TermId> &document_words = document_words_.Modify();
+    vector<QuantizedTermCount> &document_word_counts =
+            document_word_counts_.Modify();
+    for (const auto [term_id, term_count] : term_counts) {
+        word_to_document_freqs_[term_id].Append(ordinal, term_count,
+                documents_.GetTermFreq(ordinal, term_count));
+        inverse_document_freqs_.MarkTermChanged(term_id);
+        document_words.push_back(term_id);
+        document_word_counts.push_back(QuantizeTermCount(term_count));
+    }
+    document_word_ends_.Modify().push_back(document_words.size());
+    inverse_document_freqs_.MarkDocumentCountChanged();
+    epoch_.Advance();
+}
+
+/**
+ * @brief Добавляет пакет документов в поисковый сервер
+ *
+ *  - пакет делится на части, в каждой части (параллельно) проверяются id
+ *    и символы документов, тексты разбираются на слова, слова заносятся
+ *    в словарь части и считаются вхождения слов в документы,
+ *  - документы в порядке пакета получают внутренние номера (здесь же
+ *    отсеиваются повторные id, в том числе внутри пакета),
+ *  - слова добавленных документов заносятся в словарь сервера,
+ *  - записи о документах дописываются в списки документов слов (списки
+ *    разных слов заполняются параллельно) и в индекс документ -> слова.
+ *  Результат совпадает с добавлением документов по одному через AddDocument.
+ *
+ * @param policy     Политика выполнения шагов, которые выполняются по частям
+ * @param documents  Пакет документов
+ * @param part_count Количество частей пакета
+ * @return Ошибки добавления документов в порядке пакета
+ */
+template<typename ExecutionPolicy>
+vector<AddDocumentError> SearchServer::AddDocumentsInParts(
+        const ExecutionPolicy &policy, const vector<DocumentToAdd> &documents,
+        size_t part_count) {
+    // разбор частей пакета
+    vector<BatchPart> parts(part_count);
+    for (size_t part = 0; part < part_count; ++part) {
+        parts[part].first = documents.size() * part / part_count;
+        parts[part].last = documents.size() * (part + 1) / part_count;
+    }
+    for_each(policy, parts.begin(), parts.end(),
+            [this, &documents](BatchPart &part) {
+                // буферы переиспользуются для всех документов части
+                vector<string_view> text_words;
+                vector<TermId> document_words;
+                for (size_t i = part.first; i < part.last; ++i) {
+                    const DocumentToAdd &document = documents[i];
+                    const string *error = nullptr;
+                    document_words.clear();
+                    if (document.id < 0) {
+                        error = &NEGATIVE_ID_MESSAGE;
+                    } else if (!SplitIntoWordsNoStop(document.text,
+                            text_words)) {
+                        error = &INVALID_CHARACTERS_MESSAGE;
+                    } else {
+                        for (string_view word : text_words) {
+                            document_words.push_back(
+                                    part.dictionary.Intern(word));
+                        }
+                        sort(document_words.begin(), document_words.end());
+                    }
+                    for (auto it = document_words.begin();
+                            it != document_words.end();) {
+                        const auto next = upper_bound(it, document_words.end(),
+                                *it);
+                        part.words.push_back(*it);
+                        part.word_counts.push_back(
+                                static_cast<uint32_t>(next - it));
+                        it = next;
+                    }
+                    part.word_ends.push_back(part.words.size());
+                    part.document_word_counts.push_back(document_words.size());
+                    part.ratings.push_back(
+                            error ? 0 : ComputeAverageRating(document.ratings));
+                    part.errors.push_back(error);
+                }
+            });
+
+    // внутренние номера документов в порядке пакета
+    vector<AddDocumentError> errors;
+    vector<DocumentOrdinal> ordinals(documents.size(),
+            DocumentStore::NO_DOCUMENT);
+    for (const BatchPart &part : parts) {
+        for (size_t i = part.first; i < part.last; ++i) {
+            const DocumentToAdd &document = documents[i];
+            const string *error = part.errors[i - part.first];
+            if (!error && documents_.Find(document.id)
+                    != DocumentStore::NO_DOCUMENT) {
+                error = &DUPLICATE_ID_MESSAGE;
+            }
+            if (error) {
+                errors.push_back( { i, document.id, *error });
+                continue;
+            }
+            ordinals[i] = documents_.Add(document.id,
+                    part.ratings[i - part.first], document.status,
+                    part.document_word_counts[i - part.first]);
         }
-        word_to_document_freqs_[*it_word][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][*it_word] += inv_word_count;
     }
 
-    for (string_view word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][word] += inv_word_count;
+    // слова частей -> слова сервера, количество новых записей в списках
+    // документов слов
+    vector<vector<TermId>> term_ids(part_count);
+    vector<size_t> term_entry_counts;
+    for (size_t part_index = 0; part_index < part_count; ++part_index) {
+        BatchPart &part = parts[part_index];
+        vector<TermId> &part_term_ids = term_ids[part_index];
+        part_term_ids.assign(part.dictionary.size(), TermDictionary::NO_TERM);
+        for (size_t i = part.first; i < part.last; ++i) {
+            if (ordinals[i] == DocumentStore::NO_DOCUMENT) {
+                continue;
+            }
+            const size_t local = i - part.first;
+            const size_t begin = local == 0 ? 0 : part.word_ends[local - 1];
+            for (size_t j = begin; j < part.word_ends[local]; ++j) {
+                TermId &term_id = part_term_ids[part.words[j]];
+                if (term_id == TermDictionary::NO_TERM) {
+                    term_id = dictionary_.Intern(
+                            part.dictionary.GetTerm(part.words[j]));
+                    term_entry_counts.resize(dictionary_.size());
+                }
+                ++term_entry_counts[term_id];
+                part.words[j] = term_id;
+            }
+        }
+    }
+    word_to_document_freqs_.resize(dictionary_.size());
+
+    // новые записи списков документов слов, сгруппированные по словам
+    // (внутри слова - по возрастанию номера документа)
+    vector<size_t> term_entry_ends(term_entry_counts.size());
+    partial_sum(term_entry_counts.begin(), term_entry_counts.end(),
+            term_entry_ends.begin());
+    vector<pair<DocumentOrdinal, uint32_t>> term_entries(
+            term_entry_ends.empty() ? 0 : term_entry_ends.back());
+    vector<size_t> term_entry_positions(term_entry_ends.size());
+    for (size_t term_id = 0; term_id < term_entry_ends.size(); ++term_id) {
+        term_entry_positions[term_id] = term_entry_ends[term_id]
+                - term_entry_counts[term_id];
+    }
+    vector<TermId> &document_words = document_words_.Modify();
+    vector<QuantizedTermCount> &document_word_counts =
+            document_word_counts_.Modify();
+    vector<uint64_t> &document_word_ends = document_word_ends_.Modify();
+    vector<pair<TermId, uint32_t>> document_terms;
+    for (BatchPart &part : parts) {
+        for (size_t i = part.first; i < part.last; ++i) {
+            const DocumentOrdinal ordinal = ordinals[i];
+            if (ordinal == DocumentStore::NO_DOCUMENT) {
+                continue;
+            }
+            const size_t local = i - part.first;
+            const size_t begin = local == 0 ? 0 : part.word_ends[local - 1];
+            document_terms.clear();
+            for (size_t j = begin; j < part.word_ends[local]; ++j) {
+                document_terms.emplace_back(part.words[j],
+                        part.word_counts[j]);
+                term_entries[term_entry_positions[part.words[j]]++] = {
+                        ordinal, part.word_counts[j] };
+            }
+            // как и в AddDocument, слова документа - по возрастанию
+            // идентификатора слова
+            sort(document_terms.begin(), document_terms.end());
+            for (const auto &[term_id, term_count] : document_terms) {
+                document_words.push_back(term_id);
+                document_word_counts.push_back(QuantizeTermCount(term_count));
+            }
+            document_word_ends.push_back(document_words.size());
+        }
+    }
+
+    // списки разных слов не пересекаются, поэтому блокировки не нужны
+    vector<TermId> touched_terms;
+    for (size_t term_id = 0; term_id < term_entry_counts.size(); ++term_id) {
+        if (term_entry_counts[term_id] > 0) {
+            touched_terms.push_back(static_cast<TermId>(term_id));
+            inverse_document_freqs_.MarkTermChanged(
+                    static_cast<TermId>(term_id));
+        }
     }
-    documents_.emplace(document_id,
-            DocumentData { ComputeAverageRating(ratings), status });
-    documents_ids_.emplace(document_id);
+    for_each(policy, touched_terms.begin(), touched_terms.end(),
+            [this, &term_entries, &term_entry_ends, &term_entry_counts](
+                    TermId term_id) {
+                PostingList &postings = word_to_document_freqs_[term_id];
+                const size_t end = term_entry_ends[term_id];
+                for (size_t i = end - term_entry_counts[term_id]; i < end;
+                        ++i) {
+                    const auto [ordinal, term_count] = term_entries[i];
+                    postings.Append(ordinal, term_count,
+                            documents_.GetTermFreq(ordinal, term_count));
+                }
+            });
+
+    if (errors.size() < documents.size()) {
+        inverse_document_freqs_.MarkDocumentCountChanged();
+        epoch_.Advance();
+    }
+    return errors;
+}
+
+vector<AddDocumentError> SearchServer::AddDocuments(
+        const vector<DocumentToAdd> &documents) {
+    return AddDocumentsInParts(execution::seq, documents, 1);
+}
+
+vector<AddDocumentError> SearchServer::AddDocuments(
+        const execution::sequenced_policy&,
+        const vector<DocumentToAdd> &documents) {
+    return AddDocuments(documents);
+}
+
+vector<AddDocumentError> SearchServer::AddDocuments(
+        const execution::parallel_policy&,
+        const vector<DocumentToAdd> &documents) {
+    return AddDocumentsInParts(execution::par, documents,
+            GetParallelPartCount(documents.size(), MIN_BATCH_PART_SIZE));
 }
 
 /**
  * @brief Удаляет документ из поискового сервера
  *
- *  удаляет информацию о документе из контейнеров:
- *  - documents_ (id документа, ср.рейтинг, статус)
- *  - documents_ids_
- *  - word_to_document_freqs_ (слово, map<id документа, TF>)
- *  - document_to_word_freqs_ (id документа, map<слово, TF>)
+ *  Документ отмечается удалённым в documents_ (он больше не находится
+ *  по id и не попадает в результаты поиска), его записи остаются в списках
+ *  документов слов до очистки (CompactIndex), а количество документов
+ *  со словом (для IDF) уменьшается сразу - для этого обходятся слова
+ *  документа в прямом индексе. Слова документа остаются в document_words_
+ *  до сжатия прямого индекса (CompactDocumentWords), внутренний номер
+ *  документа больше не используется и не переиспользуется; слово остаётся
+ *  в словаре, даже если документов с ним не осталось.
  *
  * @param document_id id документа
  */
 void SearchServer::RemoveDocument(int document_id) {
-    // удаляем из documents_
-    documents_.erase(document_id);
-    // удаляем из documents_ids_
-    auto inx = find(documents_ids_.begin(), documents_ids_.end(), document_id);
-    if (inx != documents_ids_.end()) {
-        documents_ids_.erase(inx);
-    }
-
-    auto word_freq = GetWordFrequencies(document_id);
-    if (!word_freq.empty()) {
-        // удаляем из document_to_word_freqs_
-        document_to_word_freqs_.erase(document_id);
-        // удаляем из word_to_document_freqs_
-        for (auto [word, freq] : word_freq) {
-            word_to_document_freqs_.at(word).erase(document_id);
-            // если для слова в контейнере не осталось документов
-            if (word_to_document_freqs_.at(word).empty()) {
-                // слово удаляем из контейнера
-                word_to_document_freqs_.erase(word);
-            }
-        }
-    }
+    RemoveDocument(execution::seq, document_id);
 }
 
-void SearchServer::RemoveDocument(const execution::sequenced_policy&,
+void SearchServer::RemoveDocument(const execution::sequenced_policy &policy,
         int document_id) {
-    RemoveDocument(document_id);
+    const DocumentOrdinal ordinal = documents_.Remove(document_id);
+    if (ordinal == DocumentStore::NO_DOCUMENT) {
+        return;
+    }
+    epoch_.Advance();
+    inverse_document_freqs_.MarkDocumentCountChanged();
+    MarkDocumentRemoved(ordinal);
+    CompactIndexIfNeeded(policy);
 }
 
-void SearchServer::RemoveDocument(const execution::parallel_policy&,
+void SearchServer::RemoveDocument(const execution::parallel_policy &policy,
         int document_id) {
-    if (documents_.count(document_id) != 0) {
-
-        // собираем вектор слов документа
-        vector<string> words(document_to_word_freqs_.at(document_id).size());
-        transform(execution::par,
-                document_to_word_freqs_.at(document_id).begin(),
-                document_to_word_freqs_.at(document_id).end(), words.begin(),
-                [](auto &word) {
-                    return word.first;
-                }
-        );
+    const DocumentOrdinal ordinal = documents_.Remove(document_id);
+    if (ordinal == DocumentStore::NO_DOCUMENT) {
+        return;
+    }
+    epoch_.Advance();
+    inverse_document_freqs_.MarkDocumentCountChanged();
+    MarkDocumentRemoved(ordinal);
+    CompactIndexIfNeeded(policy);
+}
 
-        // удаляем слова (можно распараллелить потому что из каждого словаря удалится максимум одна запись)
-        for_each(execution::par, words.begin(), words.end(),
-                [this, document_id](string word) {
-                    word_to_document_freqs_.at(word).erase(document_id);
-                });
+template<typename ExecutionPolicy>
+void SearchServer::RemoveDocumentsBatch(const ExecutionPolicy &policy,
+        const vector<int> &document_ids) {
+    const vector<DocumentOrdinal> ordinals = documents_.Remove(document_ids);
+    if (ordinals.empty()) {
+        return;
+    }
+    epoch_.Advance();
+    inverse_document_freqs_.MarkDocumentCountChanged();
+    for (const DocumentOrdinal ordinal : ordinals) {
+        MarkDocumentRemoved(ordinal);
+    }
+    CompactIndexIfNeeded(policy);
+}
+
+void SearchServer::MarkDocumentRemoved(DocumentOrdinal ordinal) {
+    removed_term_counts_.resize(dictionary_.size(), 0);
+    for (size_t i = GetDocumentWordsBegin(ordinal);
+            i < document_word_ends_[ordinal]; ++i) {
+        ++removed_term_counts_[document_words_[i]];
+        inverse_document_freqs_.MarkTermChanged(document_words_[i]);
+    }
+    removed_ordinals_.push_back(ordinal);
+}
 
-        documents_.erase(document_id);
-        documents_ids_.erase(document_id);
-        document_to_word_freqs_.erase(document_id);
+template<typename ExecutionPolicy>
+void SearchServer::CompactIndexIfNeeded(const ExecutionPolicy &policy) {
+    // доля удалённых документов среди живых и удалённых
+    if (removed_ordinals_.size() > compaction_threshold_
+            * (documents_.size() + removed_ordinals_.size())) {
+        CompactIndex(policy);
     }
 }
 
+/**
+ * @brief Убирает записи удалённых документов из списков документов слов
+ *
+ *  - пары {слово, удалённый документ} сортируются по слову (память -
+ *    по количеству слов удалённых документов, а не по количеству всех
+ *    документов или слов словаря),
+ *  - списки слов перестраиваются по одному разу (списки разных слов не
+ *    пересекаются, поэтому их можно изменять параллельно); из списка, где
+ *    удаляется одна запись, она удаляется поиском по блокам (Erase),
+ *    остальные записи удалённых документов находятся по битовой карте
+ *    удалённых документов documents_,
+ *  - пары {id, внутренний номер} удалённых документов удаляются
+ *    из documents_,
+ *  - прямой индекс сжимается, когда слова удалённых документов составляют
+ *    больше половины его слов.
+ *  Внутренние номера не перенумеровываются (иначе пришлось бы перестроить
+ *  все списки документов слов), поэтому столбцы удалённых документов
+ *  в documents_ остаются. Результаты поиска и IDF не изменяются, поэтому
+ *  номер версии индекса остаётся прежним.
+ *
+ * @param policy Политика выполнения перестройки списков
+ */
+template<typename ExecutionPolicy>
+void SearchServer::CompactIndex(const ExecutionPolicy &policy) {
+    if (removed_ordinals_.empty()) {
+        return;
+    }
+    vector<pair<TermId, DocumentOrdinal>> removed_entries;
+    for (const DocumentOrdinal ordinal : removed_ordinals_) {
+        for (size_t i = GetDocumentWordsBegin(ordinal);
+                i < document_word_ends_[ordinal]; ++i) {
+            removed_entries.emplace_back(document_words_[i], ordinal);
+        }
+    }
+    removed_word_count_ += removed_entries.size();
+    sort(removed_entries.begin(), removed_entries.end());
+    // первые пары слов
+    vector<size_t> term_begins;
+    for (size_t i = 0; i < removed_entries.size(); ++i) {
+        if (i == 0
+                || removed_entries[i].first != removed_entries[i - 1].first) {
+            term_begins.push_back(i);
+        }
+    }
+
+    for_each(policy, term_begins.begin(), term_begins.end(),
+            [this, &removed_entries](size_t begin) {
+                const auto [term_id, ordinal] = removed_entries[begin];
+                PostingList &postings = word_to_document_freqs_[term_id];
+                if (removed_term_counts_[term_id] == 1) {
+                    postings.Erase(ordinal);
+                } else {
+                    postings.EraseIf([this](DocumentOrdinal entry_ordinal) {
+                        return documents_.IsRemoved(entry_ordinal);
+                    });
+                }
+                removed_term_counts_[term_id] = 0;
+            });
+    documents_.Compact();
+    removed_ordinals_.clear();
+    if (removed_word_count_ * 2 > document_words_.size()) {
+        CompactDocumentWords();
+    }
+}
+
+/**
+ * @brief Убирает из прямого индекса слова удалённых документов
+ *
+ *  Прямой индекс переписывается за один проход; у удалённых документов
+ *  остаётся пустой диапазон слов. Записи удалённых документов должны быть
+ *  уже убраны из списков документов слов (removed_ordinals_ пуст): их
+ *  очистка читает слова документов.
+ */
+void SearchServer::CompactDocumentWords() {
+    if (removed_word_count_ == 0) {
+        return;
+    }
+    const size_t word_count = document_words_.size() - removed_word_count_;
+    vector<uint64_t> document_word_ends;
+    document_word_ends.reserve(document_word_ends_.size());
+    vector<TermId> document_words;
+    document_words.reserve(word_count);
+    vector<QuantizedTermCount> document_word_counts;
+    document_word_counts.reserve(word_count);
+    for (DocumentOrdinal ordinal = 0; ordinal < document_word_ends_.size();
+            ++ordinal) {
+        if (!documents_.IsRemoved(ordinal)) {
+            const size_t begin = GetDocumentWordsBegin(ordinal);
+            const size_t end = document_word_ends_[ordinal];
+            document_words.insert(document_words.end(),
+                    document_words_.data() + begin,
+                    document_words_.data() + end);
+            document_word_counts.insert(document_word_counts.end(),
+                    document_word_counts_.data() + begin,
+                    document_word_counts_.data() + end);
+        }
+        document_word_ends.push_back(document_words.size());
+    }
+    document_word_ends_ = move(document_word_ends);
+    document_words_ = move(document_words);
+    document_word_counts_ = move(document_word_counts);
+    removed_word_count_ = 0;
+}
+
+void SearchServer::SetCompactionThreshold(double threshold) {
+    compaction_threshold_ = threshold;
+    CompactIndexIfNeeded(execution::seq);
+}
+
+void SearchServer::CompactIndex() {
+    CompactIndex(execution::par);
+    CompactDocumentWords();
+}
+
+void SearchServer::RemoveDocuments(const vector<int> &document_ids) {
+    RemoveDocumentsBatch(execution::seq, document_ids);
+}
+
+void SearchServer::RemoveDocuments(const execution::sequenced_policy&,
+        const vector<int> &document_ids) {
+    RemoveDocuments(document_ids);
+}
+
+void SearchServer::RemoveDocuments(const execution::parallel_policy&,
+        const vector<int> &document_ids) {
+    RemoveDocumentsBatch(execution::par, document_ids);
+}
+
 /**
  * @brief Компаратор стоп-слов
  *
@@ -153,7 +542,7 @@ void SearchServer::RemoveDocument(const execution::parallel_policy&,
  * @return true - если слово есть в списке стоп-слов, false - если нет
  */
 bool SearchServer::IsStopWord(string_view word) const {
-    return stop_words_.count(string{word}) > 0;
+    return stop_words_.Contains(word);
 }
 
 /**
@@ -183,25 +572,42 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
 /**
  * @brief Парсим (разбираем) поисковый запрос
  *
+ *  Слова запроса заменяются их идентификаторами в словаре, слова,
+ *  которых нет в словаре, отбрасываются. Символы запроса проверяются
+ *  при разборе на слова.
+ *
  * @param text Строка поискового запроса
  * @return Структура (наборы слов поискового запроса)
+ * @throw invalid_argument В запросе есть недопустимые символы или неверно
+ *        использован символ "-"
  */
 SearchServer::Query SearchServer::ParseQuery(string_view text,
         bool skip_sort) const {
+    SEARCH_METRICS_STAGE(PARSE);
+    if (!SplitIntoWords(text, query_words)) {
+        throw invalid_argument(INVALID_QUERY_MESSAGE);
+    }
     SearchServer::Query query;
-    for (string_view word : SplitIntoWords(text)) {
+    for (string_view word : query_words) {
         SearchServer::QueryWord query_word = ParseQueryWord(word);
 
         if (!query_word.is_stop) {
+            const TermId term_id = dictionary_.Find(query_word.data);
+            if (term_id == TermDictionary::NO_TERM) {
+                continue;
+            }
             if (query_word.is_minus) {
-                query.minus_words.push_back(query_word.data);
+                query.minus_words.push_back(term_id);
             } else {
-                query.plus_words.push_back(query_word.data);
+                query.plus_words.push_back(term_id);
             }
         }
     }
     if (!skip_sort) {
-        sort(query.plus_words.begin(), query.plus_words.end());
+        sort(query.plus_words.begin(), query.plus_words.end(),
+                [this](TermId lhs, TermId rhs) {
+                    return dictionary_.GetTerm(lhs) < dictionary_.GetTerm(rhs);
+                });
         query.plus_words.resize(
                 distance(query.plus_words.begin(),
                         unique(query.plus_words.begin(),
@@ -221,7 +627,21 @@ SearchServer::Query SearchServer::ParseQuery(string_view text,
  * @return Количество документов в поисковом сервере
  */
 size_t SearchServer::GetDocumentCount() const {
-    return SearchServer::documents_.size();
+    return documents_.size();
+}
+
+/**
+ * @brief Получает объём памяти, занимаемой списками документов слов
+ *
+ * @return Объём памяти в байтах
+ */
+size_t SearchServer::GetIndexMemoryUsage() const {
+    size_t memory_usage = 0;
+    for (const PostingList &postings : word_to_document_freqs_) {
+        memory_usage += postings.GetMemoryUsage();
+    }
+    return memory_usage + (word_to_document_freqs_.capacity()
+            - word_to_document_freqs_.size()) * sizeof(PostingList);
 }
 
 SearchServer::MatchDocumentResult SearchServer::MatchDocument(
@@ -230,73 +650,94 @@ SearchServer::MatchDocumentResult SearchServer::MatchDocument(
 }
 
 SearchServer::MatchDocumentResult SearchServer::MatchDocument(
-        const execution::sequenced_policy&, string_view raw_query,
+        const execution::sequenced_policy &policy, string_view raw_query,
         int document_id) const {
-    if (documents_ids_.count(document_id) == 0) {
+    const DocumentOrdinal ordinal = documents_.Find(document_id);
+    if (ordinal == DocumentStore::NO_DOCUMENT) {
         return { {}, {}};
     }
 
-    if (!IsValidWord(raw_query)) {
-        throw invalid_argument("!!!"s);
-    }
-
-    const Query query = ParseQuery(raw_query);
-
-    const auto word_checker = [this, document_id](string_view word) {
-        const auto it = word_to_document_freqs_.find(word);
-        return it != word_to_document_freqs_.end()
-                && it->second.count(document_id);
-    };
+    return MatchQuery(policy, ParseQuery(raw_query), ordinal);
+}
 
-    if (any_of(execution::seq, query.minus_words.begin(),
-            query.minus_words.end(), word_checker)) {
-        vector<string_view> empty;
-        return {empty, documents_.at(document_id).status};
+SearchServer::MatchDocumentResult SearchServer::MatchDocument(
+        const execution::parallel_policy &policy, string_view raw_query,
+        int document_id) const {
+    const DocumentOrdinal ordinal = documents_.Find(document_id);
+    if (ordinal == DocumentStore::NO_DOCUMENT) {
+        return { {}, {}};
     }
 
-    vector<string_view> matched_words(query.plus_words.size());
-    auto words_end = copy_if(execution::seq, query.plus_words.begin(),
-            query.plus_words.end(), matched_words.begin(), word_checker);
-    sort(matched_words.begin(), words_end);
-    words_end = unique(matched_words.begin(), words_end);
-    matched_words.erase(words_end, matched_words.end());
+    return MatchQuery(policy, ParseQuery(raw_query, true), ordinal);
+}
 
-    return make_tuple(matched_words, documents_.at(document_id).status);
+SearchServer::MatchDocumentResult SearchServer::MatchDocument(
+        const PreparedQuery &prepared_query, int document_id) const {
+    return MatchDocument(execution::seq, prepared_query, document_id);
 }
 
 SearchServer::MatchDocumentResult SearchServer::MatchDocument(
-        const execution::parallel_policy&, string_view raw_query,
-        int document_id) const {
-    if (documents_ids_.count(document_id) == 0) {
+        const execution::sequenced_policy &policy,
+        const PreparedQuery &prepared_query, int document_id) const {
+    const DocumentOrdinal ordinal = documents_.Find(document_id);
+    if (ordinal == DocumentStore::NO_DOCUMENT) {
         return { {}, {}};
     }
+    Query stale_query;
+    return MatchQuery(policy, ResolveQuery(prepared_query, stale_query),
+            ordinal);
+}
 
-    if (!IsValidWord(raw_query)) {
-        throw invalid_argument("!!!"s);
+SearchServer::MatchDocumentResult SearchServer::MatchDocument(
+        const execution::parallel_policy &policy,
+        const PreparedQuery &prepared_query, int document_id) const {
+    const DocumentOrdinal ordinal = documents_.Find(document_id);
+    if (ordinal == DocumentStore::NO_DOCUMENT) {
+        return { {}, {}};
     }
+    Query stale_query;
+    return MatchQuery(policy, ResolveQuery(prepared_query, stale_query),
+            ordinal);
+}
 
-    const Query query = ParseQuery(raw_query, true);
-
-    const auto word_checker = [this, document_id](string_view word) {
-        const auto it = word_to_document_freqs_.find(word);
-        return it != word_to_document_freqs_.end()
-                && it->second.count(document_id);
+/**
+ * @brief Слова запроса, которые есть в документе
+ *
+ * @param policy  Политика выполнения алгоритмов (execution::seq или par)
+ * @param query   Слова запроса (плюс-слова могут быть не упорядочены
+ *                и повторяться)
+ * @param ordinal Внутренний номер документа
+ * @return Найденные слова по алфавиту (пусто, если в документе есть
+ *         минус-слово) и статус документа
+ */
+template<typename ExecutionPolicy>
+SearchServer::MatchDocumentResult SearchServer::MatchQuery(
+        const ExecutionPolicy &policy, const Query &query,
+        DocumentOrdinal ordinal) const {
+    const auto word_checker = [this, ordinal](const TermId word) {
+        return word_to_document_freqs_[word].Contains(ordinal);
     };
 
-    if (any_of(execution::par, query.minus_words.begin(),
-            query.minus_words.end(), word_checker)) {
+    if (any_of(policy, query.minus_words.begin(), query.minus_words.end(),
+            word_checker)) {
         vector<string_view> empty;
-        return {empty, documents_.at(document_id).status};
+        return {empty, documents_.GetStatus(ordinal)};
     }
 
-    vector<string_view> matched_words(query.plus_words.size());
-    auto words_end = copy_if(execution::par, query.plus_words.begin(),
-            query.plus_words.end(), matched_words.begin(), word_checker);
-    sort(execution::par, matched_words.begin(), words_end);
-    words_end = unique(execution::par, matched_words.begin(), words_end);
+    vector<TermId> matched_terms(query.plus_words.size());
+    const auto terms_end = copy_if(policy, query.plus_words.begin(),
+            query.plus_words.end(), matched_terms.begin(), word_checker);
+    vector<string_view> matched_words(distance(matched_terms.begin(), terms_end));
+    transform(policy, matched_terms.begin(), terms_end,
+            matched_words.begin(), [this](const TermId word) {
+                return dictionary_.GetTerm(word);
+            });
+    auto words_end = matched_words.end();
+    sort(policy, matched_words.begin(), words_end);
+    words_end = unique(policy, matched_words.begin(), words_end);
     matched_words.erase(words_end, matched_words.end());
 
-    return make_tuple(matched_words, documents_.at(document_id).status);
+    return make_tuple(matched_words, documents_.GetStatus(ordinal));
 }
 
 /**
@@ -304,8 +745,8 @@ SearchServer::MatchDocumentResult SearchServer::MatchDocument(
  *
  * @return Возвращает возвращает итератор на первый элемент
  */
-set<int>::iterator SearchServer::begin() {
-    return documents_ids_.begin();
+DocumentStore::IdIterator SearchServer::begin() const {
+    return documents_.begin();
 }
 
 /**
@@ -313,32 +754,36 @@ set<int>::iterator SearchServer::begin() {
  *
  * @return Возвращает возвращает итератор на элемент, следующий за последним элементом
  */
-set<int>::iterator SearchServer::end() {
-    return documents_ids_.end();
+DocumentStore::IdIterator SearchServer::end() const {
+    return documents_.end();
 }
 
 bool SearchServer::IsValidWord(string_view word) {
-    string str_word { word };
     // A valid word must not contain special characters
-    return none_of(str_word.begin(), str_word.end(), [](char c) {
-        return c >= '\0' && c < ' ';
-    });
+    return IsValidText(word);
 }
 
 /**
  * @brief Разбивает строку на слова и исключает стоп-слова
  *
- * @param text Строка, которую разбираем
- * @return Вектор слов, входящих в троку исключая стоп-слова
+ *  Разбор и проверка символов выполняются за один проход (SplitIntoWords),
+ *  стоп-слова удаляются из того же вектора.
+ *
+ * @param text  Строка, которую разбираем
+ * @param words Вектор слов, входящих в строку, исключая стоп-слова
+ *              (заполняется)
+ * @return false, если в строке есть недопустимые символы
  */
-vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
-    vector<string_view> words;
-    for (string_view word : SplitIntoWords(text)) {
-        if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
+bool SearchServer::SplitIntoWordsNoStop(string_view text,
+        vector<string_view> &words) const {
+    const bool is_valid = SplitIntoWords(text, words);
+    if (!stop_words_.empty()) {
+        words.erase(remove_if(words.begin(), words.end(),
+                [this](string_view word) {
+                    return IsStopWord(word);
+                }), words.end());
     }
-    return words;
+    return is_valid;
 }
 
 /**
@@ -358,41 +803,320 @@ int SearchServer::ComputeAverageRating(const vector<int> &ratings) {
 }
 
 /**
- * @brief Расчитываем IDF (inverse document frequency) слова
+ * @brief Получаем IDF (inverse document frequency) всех плюс-слов запроса
+ *
+ *  IDF берутся из таблицы inverse_document_freqs_ (таблица обновляется,
+ *  если после последнего запроса документы изменились).
+ *
+ * @param query Запрос (заполняется query.inverse_document_freqs)
+ */
+void SearchServer::ComputeInverseDocumentFreqs(Query &query) const {
+    SEARCH_METRICS_STAGE(PARSE);
+    UpdateInverseDocumentFreqTable();
+    query.inverse_document_freqs.resize(query.plus_words.size());
+    transform(query.plus_words.begin(), query.plus_words.end(),
+            query.inverse_document_freqs.begin(), [this](TermId term_id) {
+                return inverse_document_freqs_.Get(term_id);
+            });
+}
+
+void SearchServer::UpdateInverseDocumentFreqTable() const {
+    inverse_document_freqs_.Update(word_to_document_freqs_,
+            removed_term_counts_, GetDocumentCount());
+}
+
+void SearchServer::SetInverseDocumentFreqTolerance(double tolerance) {
+    inverse_document_freqs_.SetTolerance(tolerance);
+    epoch_.Advance();
+}
+
+void SearchServer::UpdateInverseDocumentFreqs() {
+    inverse_document_freqs_.Refresh(word_to_document_freqs_,
+            removed_term_counts_, GetDocumentCount());
+    epoch_.Advance();
+}
+
+/**
+ * @brief Разбирает запрос для многократного выполнения
+ *
+ *  Текст запроса копируется в запрос: по нему запрос разбирается заново,
+ *  если индекс изменится.
+ *
+ * @param raw_query Поисковые слова
+ * @return Разобранный запрос с IDF плюс-слов для текущей версии индекса
+ */
+SearchServer::PreparedQuery SearchServer::Prepare(string_view raw_query) const {
+    PreparedQuery prepared_query;
+    prepared_query.text_ = string(raw_query);
+    Revalidate(prepared_query);
+    return prepared_query;
+}
+
+void SearchServer::Revalidate(PreparedQuery &query) const {
+    if (IsCurrent(query)) {
+        return;
+    }
+    query.query_ = ParseQuery(query.text_);
+    ComputeInverseDocumentFreqs(query.query_);
+    query.epoch_ = epoch_.Get();
+}
+
+bool SearchServer::IsCurrent(const PreparedQuery &query) const {
+    return query.epoch_ == epoch_.Get();
+}
+
+/**
+ * @brief Слова запроса для выполнения разобранного запроса
+ *
+ *  Запрос, разобранный для другой версии индекса, не изменяется (его могут
+ *  выполнять другие потоки): текст разбирается заново во временный запрос.
+ *
+ * @param prepared_query Разобранный запрос
+ * @param stale_query    Временный запрос
+ * @return prepared_query.query_ или stale_query
+ */
+const SearchServer::Query& SearchServer::ResolveQuery(
+        const PreparedQuery &prepared_query, Query &stale_query) const {
+    if (IsCurrent(prepared_query)) {
+        return prepared_query.query_;
+    }
+    stale_query = ParseQuery(prepared_query.text_);
+    ComputeInverseDocumentFreqs(stale_query);
+    return stale_query;
+}
+
+/**
+ * @brief Количество частей, на которые делится диапазон при параллельной
+ *        обработке
  *
- * @param word Слово
- * @return IDF
+ * @param count         Количество элементов (внутренних номеров документов)
+ * @param min_part_size Минимальное количество элементов в одной части
+ * @return Количество частей (не меньше 1)
  */
-double SearchServer::ComputeWordInverseDocumentFreq(string_view word) const {
-    return log(
-            GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size())
-            / 2;
+size_t SearchServer::GetParallelPartCount(size_t count, size_t min_part_size) {
+    const size_t thread_count = max(1u, thread::hardware_concurrency());
+    return clamp<size_t>(count / min_part_size, 1,
+            min(MAX_PARALLEL_PART_COUNT, thread_count * 4));
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query,
-        DocumentStatus status) const {
-    return FindTopDocuments(raw_query,
-            [status](int document_id, DocumentStatus document_status,
-                    int rating) {
-                return document_status == status;
-            });
+        DocumentStatus status, size_t top_k, EvaluationMode mode) const {
+    return FindTopDocuments(raw_query, DocumentFilter(status), top_k, mode);
+}
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query,
+        const DocumentFilter &filter, size_t top_k,
+        EvaluationMode mode) const {
+    SEARCH_METRICS_COUNT(QUERIES, 1);
+    Query query = ParseQuery(raw_query, false);
+    ComputeInverseDocumentFreqs(query);
+    const FilterPredicate predicate = MakeFilterPredicate(filter);
+    return FindAllDocuments(query, [&predicate](DocumentOrdinal ordinal) {
+        return predicate(ordinal);
+    }, top_k, mode);
+}
+
+/**
+ * @brief Строит критерий поиска по фильтру
+ *
+ *  - только статус: критерий проверяет битовую карту статуса индекса
+ *    без копирования;
+ *  - диапазон рейтинга: документы диапазона отмечаются в битовой карте
+ *    запроса по индексу рейтингов, при заданном статусе карта пересекается
+ *    с картой статуса;
+ *  - без статуса и рейтинга проверяется только остаточный критерий.
+ *
+ * @param filter Фильтр документов
+ * @return Критерий поиска по внутреннему номеру документа
+ */
+SearchServer::FilterPredicate SearchServer::MakeFilterPredicate(
+        const DocumentFilter &filter) const {
+    SEARCH_METRICS_STAGE(PREDICATE);
+    FilterPredicate predicate(documents_, filter.GetResidual());
+    if (!filter.GetStatus() && !filter.HasRatingRange()) {
+        return predicate;
+    }
+    filter_index_.Update(documents_);
+    if (!filter.HasRatingRange()) {
+        predicate.bitmap_ = filter_index_.GetStatusBitmap(
+                *filter.GetStatus()).data();
+        return predicate;
+    }
+    vector<uint64_t> &bitmap = predicate.own_bitmap_;
+    bitmap.assign((documents_.GetOrdinalCount() + 63) / 64, 0);
+    filter_index_.SelectRatingRange(filter.GetMinRating(),
+            filter.GetMaxRating(), bitmap);
+    if (filter.GetStatus()) {
+        const vector<uint64_t> &status_bitmap = filter_index_.GetStatusBitmap(
+                *filter.GetStatus());
+        for (size_t i = 0; i < bitmap.size(); ++i) {
+            bitmap[i] &= status_bitmap[i];
+        }
+    }
+    predicate.bitmap_ = bitmap.data();
+    return predicate;
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
+vector<Document> SearchServer::FindTopDocuments(
+        const PreparedQuery &prepared_query, DocumentStatus status,
+        size_t top_k, EvaluationMode mode) const {
+    return FindTopDocuments(prepared_query, DocumentFilter(status), top_k,
+            mode);
+}
+
+vector<Document> SearchServer::FindTopDocuments(
+        const PreparedQuery &prepared_query, const DocumentFilter &filter,
+        size_t top_k, EvaluationMode mode) const {
+    SEARCH_METRICS_COUNT(QUERIES, 1);
+    Query stale_query;
+    const Query &query = ResolveQuery(prepared_query, stale_query);
+    const FilterPredicate predicate = MakeFilterPredicate(filter);
+    return FindAllDocuments(query, [&predicate](DocumentOrdinal ordinal) {
+        return predicate(ordinal);
+    }, top_k, mode);
+}
+
+vector<Document> SearchServer::FindTopDocuments(
+        const PreparedQuery &prepared_query) const {
+    return FindTopDocuments(prepared_query, DocumentStatus::ACTUAL);
+}
+
 /**
- * @brief Получение частот слов (IDF - inverse document frequency) по id документа
+ * @brief Получение частот слов (TF - term frequency) по id документа
  *
  * @param document_id id документа
- * @return контейнер слово - IDF
+ * @return Представление слово - TF над прямым индексом документа
  */
-const map<string_view, double>& SearchServer::GetWordFrequencies(
+WordFrequencies SearchServer::GetWordFrequencies(int document_id) const {
+    const DocumentOrdinal ordinal = documents_.Find(document_id);
+    if (ordinal == DocumentStore::NO_DOCUMENT) {
+        return {};
+    }
+    const size_t begin = GetDocumentWordsBegin(ordinal);
+    return WordFrequencies(dictionary_, word_to_document_freqs_, ordinal,
+            document_words_.data() + begin,
+            document_word_counts_.data() + begin,
+            document_word_ends_[ordinal] - begin,
+            documents_.GetTermFreq(ordinal, 1));
+}
+
+/**
+ * @brief Получение идентификаторов слов документа
+ *
+ * @param document_id id документа
+ * @return Диапазон идентификаторов слов документа (по возрастанию)
+ */
+SearchServer::TermRange SearchServer::GetDocumentTerms(
         int document_id) const {
-    if (document_to_word_freqs_.count(document_id)) {
-        return document_to_word_freqs_.at(document_id);
+    const DocumentOrdinal ordinal = documents_.Find(document_id);
+    if (ordinal == DocumentStore::NO_DOCUMENT) {
+        return {nullptr, nullptr};
+    }
+    return {document_words_.data() + GetDocumentWordsBegin(ordinal),
+            document_words_.data() + document_word_ends_[ordinal]};
+}
+
+/**
+ * @brief Записывает индекс поискового сервера в файл снапшота
+ *
+ *  Записываются стоп-слова, словарь, списки документов слов, данные
+ *  документов и слова документов (см. SnapshotSection).
+ *
+ * @param path Путь к файлу снапшота
+ */
+void SearchServer::SaveSnapshot(const string &path) const {
+    if (!removed_ordinals_.empty() || removed_word_count_ != 0) {
+        // в снапшот записывается индекс без записей и слов удалённых
+        // документов
+        SearchServer compacted = *this;
+        compacted.CompactIndex();
+        compacted.SaveSnapshot(path);
+        return;
+    }
+    SnapshotWriter writer(path);
+
+    vector<uint64_t> stop_word_ends;
+    uint64_t end = 0;
+    for (size_t i = 0; i < stop_words_.size(); ++i) {
+        end += stop_words_.GetWord(i).size();
+        stop_word_ends.push_back(end);
+    }
+    writer.WriteSection(SnapshotSection::STOP_WORD_ENDS, stop_word_ends);
+    writer.BeginSection(SnapshotSection::STOP_WORD_CHARS, sizeof(char));
+    for (size_t i = 0; i < stop_words_.size(); ++i) {
+        const string_view word = stop_words_.GetWord(i);
+        writer.Write(word.data(), word.size());
+    }
+    writer.EndSection();
+
+    dictionary_.SaveSnapshot(writer);
+    PostingList::SaveSnapshot(word_to_document_freqs_, writer);
+    documents_.SaveSnapshot(writer);
+    writer.WriteSection(SnapshotSection::DOCUMENT_WORD_ENDS,
+            document_word_ends_);
+    writer.WriteSection(SnapshotSection::DOCUMENT_WORDS, document_words_);
+    writer.WriteSection(SnapshotSection::DOCUMENT_WORD_COUNTS,
+            document_word_counts_);
+    writer.Finish();
+}
+
+/**
+ * @brief Открывает поисковый сервер из файла снапшота
+ *
+ *  Файл отображается в память; массивы индекса ссылаются на отображение,
+ *  поэтому открытие не зависит от размера индекса (создаются только
+ *  string_view слов словаря и описания списков документов), а несколько
+ *  процессов, открывших один снапшот, делят одну копию в кеше страниц.
+ *
+ * @param path  Путь к файлу снапшота
+ * @param check Проверка файла (FULL - с контрольной суммой всех данных)
+ * @return Поисковый сервер
+ */
+SearchServer SearchServer::OpenSnapshot(const string &path,
+        SnapshotCheck check) {
+    const SnapshotReader reader(path, check);
+    SearchServer search_server;
+    search_server.snapshot_ = reader.GetFile();
+
+    const CowVector<uint64_t> stop_word_ends = reader.GetSection<uint64_t>(
+            SnapshotSection::STOP_WORD_ENDS);
+    const CowVector<char> stop_word_chars = reader.GetSection<char>(
+            SnapshotSection::STOP_WORD_CHARS);
+    set<string, less<>> stop_words;
+    uint64_t begin = 0;
+    for (const uint64_t end : stop_word_ends) {
+        if (end < begin || end > stop_word_chars.size()) {
+            throw runtime_error("неверный формат стоп-слов в снапшоте"s);
+        }
+        stop_words.emplace(stop_word_chars.data() + begin, end - begin);
+        begin = end;
+    }
+    search_server.stop_words_ = StopWordSet(stop_words);
+
+    search_server.dictionary_ = TermDictionary::OpenSnapshot(reader);
+    search_server.word_to_document_freqs_ = PostingList::OpenSnapshot(reader);
+    search_server.documents_ = DocumentStore::OpenSnapshot(reader);
+    search_server.document_word_ends_ = reader.GetSection<uint64_t>(
+            SnapshotSection::DOCUMENT_WORD_ENDS);
+    search_server.document_words_ = reader.GetSection<TermId>(
+            SnapshotSection::DOCUMENT_WORDS);
+    search_server.document_word_counts_ =
+            reader.GetSection<QuantizedTermCount>(
+                    SnapshotSection::DOCUMENT_WORD_COUNTS);
+    if (search_server.word_to_document_freqs_.size()
+            != search_server.dictionary_.size()
+            || search_server.document_word_ends_.size()
+                    != search_server.documents_.GetOrdinalCount()
+            || search_server.document_word_counts_.size()
+                    != search_server.document_words_.size()
+            || (!search_server.document_word_ends_.empty()
+                    && search_server.document_word_ends_.back()
+                            != search_server.document_words_.size())) {
+        throw runtime_error("неверный формат индекса в снапшоте"s);
     }
-    static map<string_view, double> empty_map;
-    return empty_map;
+    return search_server;
 }
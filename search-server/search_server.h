@@ -4,28 +4,92 @@
 #include <cmath>
 #include <execution>
 #include <future>
-#include <list>
 #include <map>
+#include <memory>
+#include <numeric>
 #include <set>
 #include <stdexcept>
 #include <string>
 #include <tuple>
 #include <vector>
 
-#include "concurrent_map.h"
 #include "document.h"
+#include "document_filter.h"
+#include "document_store.h"
+#include "inverse_document_freq_table.h"
+#include "posting_list.h"
+#include "query_executor.h"
+#include "score_accumulator.h"
+#include "search_metrics.h"
+#include "snapshot.h"
+#include "stop_words.h"
 #include "string_processing.h"
+#include "term_dictionary.h"
+#include "top_documents.h"
+#include "word_frequencies.h"
 
 using namespace std;
 
-// максимальное количество документов в результате поиска
-const int MAX_RESULT_DOCUMENT_COUNT = 5;
-const int MAX_SUBMAP_COUNT = 100;     // максимальное кол-во потоков выполенения
+// количество документов в результате поиска по умолчанию
+const size_t MAX_RESULT_DOCUMENT_COUNT = 5;
+// максимальное количество частей, на которые делится диапазон документов
+// при параллельном поиске (на каждый поток выполнения - несколько частей)
+const size_t MAX_PARALLEL_PART_COUNT = 256;
+// минимальное количество документов в одной части
+const size_t MIN_PARALLEL_PART_SIZE = 1024;
+// минимальное количество документов в одной части пакета при параллельном
+// добавлении документов (AddDocuments)
+const size_t MIN_BATCH_PART_SIZE = 64;
+// относительная ошибка округления, на которую оценки релевантности при поиске
+// с отсечением (суммы в порядке оценок слов) могут отличаться от релевантности
+// (суммы в порядке слов запроса)
+const double PRUNING_ROUNDING_SLACK = 1e-12;
+// доля удалённых документов (от живых и удалённых), записи которых остаются
+// в списках документов слов, после которой списки очищаются от них
+const double DEFAULT_COMPACTION_THRESHOLD = 0.1;
+
+/**
+ * @brief Способ вычисления результатов поиска
+ */
+enum class EvaluationMode {
+    // релевантность считается для всех документов со словами запроса
+    EXHAUSTIVE,
+    // документы обходятся по возрастанию номера с отсечением (Block-Max MaxScore):
+    // документы, которые по оценке сверху не могут попасть в top_k,
+    // пропускаются. Результат совпадает с EXHAUSTIVE
+    PRUNED,
+};
+
+/**
+ * @brief Документ для пакетного добавления (SearchServer::AddDocuments)
+ */
+struct DocumentToAdd {
+    int id;
+    string_view text;
+    DocumentStatus status;
+    vector<int> ratings;
+};
+
+/**
+ * @brief Документ пакета, который не удалось добавить
+ */
+struct AddDocumentError {
+    size_t index;      // номер документа в пакете
+    int document_id;
+    string message;    // то же сообщение, что в исключении AddDocument
+};
+
+class ShardedSearchServer;
+class QueryResultCache;
+class VersionedSearchServer;
 
 class SearchServer {
 public:
     template<typename StringContainer>
     explicit SearchServer(const StringContainer &stop_words);
+    // стоп-слова с таблицей хеширования, построенной при компиляции
+    template<size_t N>
+    explicit SearchServer(const StaticStopWords<N> &stop_words);
 
     explicit SearchServer(string stop_words_text);
     explicit SearchServer(string_view stop_words_text);
@@ -33,32 +97,163 @@ public:
     void AddDocument(int document_id, string_view document,
             DocumentStatus status, const vector<int> &ratings);
 
+    // добавляет пакет документов: документы разбираются на слова по частям
+    // (при parallel_policy - параллельно), частичные индексы частей
+    // объединяются с индексом сервера за один проход. Документы с ошибками
+    // (неверный или повторный id, недопустимые символы) пропускаются,
+    // остальные добавляются так же, как AddDocument по очереди
+    vector<AddDocumentError> AddDocuments(
+            const vector<DocumentToAdd> &documents);
+    vector<AddDocumentError> AddDocuments(const execution::sequenced_policy&,
+            const vector<DocumentToAdd> &documents);
+    vector<AddDocumentError> AddDocuments(const execution::parallel_policy&,
+            const vector<DocumentToAdd> &documents);
+
+    // удаление документа отмечает его удалённым и обходит его слова, чтобы
+    // уменьшить количества документов со словами (время пропорционально
+    // количеству слов документа и не зависит от длины списков документов
+    // слов); записи удалённых документов убираются из списков пакетом, когда
+    // их доля превышает порог (см. SetCompactionThreshold). При
+    // parallel_policy списки разных слов очищаются параллельно.
+    // Внутренние номера документов не переиспользуются и при очистке не
+    // перенумеровываются: освобождаются записи списков и слова документа
+    // в прямом индексе, а его столбцы в DocumentStore и конец его слов
+    // в document_word_ends_ (около 28 байт на документ) остаются
+    // до пересоздания сервера
     void RemoveDocument(int document_id);
     void RemoveDocument(const execution::sequenced_policy&, int document_id);
     void RemoveDocument(const execution::parallel_policy&, int document_id);
 
+    // удаляет пакет документов так же, как RemoveDocument по очереди, но
+    // порог очистки списков проверяется один раз; id, которых нет
+    // на сервере, пропускаются
+    void RemoveDocuments(const vector<int> &document_ids);
+    void RemoveDocuments(const execution::sequenced_policy&,
+            const vector<int> &document_ids);
+    void RemoveDocuments(const execution::parallel_policy&,
+            const vector<int> &document_ids);
+
+    // policy - execution::seq, execution::par или пул потоков QueryExecutor
+    // (части поиска выполняются в потоках пула)
     vector<Document> FindTopDocuments(string_view raw_query) const;
     template<typename ExecutionPolicy>
     vector<Document> FindTopDocuments(const ExecutionPolicy &policy,
             string_view raw_query) const;
 
     // перегружает FindTopDocuments для поиска по статусу
+    // (top_k - максимальное количество документов в результате,
+    //  mode - способ вычисления результатов)
     vector<Document> FindTopDocuments(string_view raw_query,
-            DocumentStatus status) const;
+            DocumentStatus status, size_t top_k = MAX_RESULT_DOCUMENT_COUNT,
+            EvaluationMode mode = EvaluationMode::EXHAUSTIVE) const;
     template<typename ExecutionPolicy>
     vector<Document> FindTopDocuments(const ExecutionPolicy &policy,
-            string_view raw_query, DocumentStatus status) const;
+            string_view raw_query, DocumentStatus status, size_t top_k =
+                    MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
+
+    // поиск с фильтром: статус и диапазон рейтинга проверяются по битовым
+    // картам документов (DocumentFilterIndex), остаточный критерий - только
+    // для документов, прошедших остальные условия
+    vector<Document> FindTopDocuments(string_view raw_query,
+            const DocumentFilter &filter, size_t top_k =
+                    MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
+    template<typename ExecutionPolicy>
+    vector<Document> FindTopDocuments(const ExecutionPolicy &policy,
+            string_view raw_query, const DocumentFilter &filter,
+            size_t top_k = MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
 
     // возвращает отсортированный вектор документов по запросу
+    // (document_predicate(id документа, статус, рейтинг))
     template<typename DocumentPredicate>
     vector<Document> FindTopDocuments(string_view raw_query,
-            DocumentPredicate document_predicate) const;
+            DocumentPredicate document_predicate, size_t top_k =
+                    MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
     template<typename ExecutionPolicy, typename DocumentPredicate>
     vector<Document> FindTopDocuments(const ExecutionPolicy &policy,
-            string_view raw_query, DocumentPredicate document_predicate) const;
+            string_view raw_query, DocumentPredicate document_predicate,
+            size_t top_k = MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
+
+    // запрос, разобранный один раз (см. Prepare)
+    class PreparedQuery;
+
+    // разбирает запрос: идентификаторы слов и их IDF вычисляются один раз,
+    // затем запрос выполняется многократно без разбора текста. Запрос
+    // привязан к версии индекса (GetEpoch): после изменений сервера,
+    // присваивания ему другого сервера или на другом сервере он разбирается
+    // заново при каждом выполнении, пока не будет обновлён Revalidate
+    PreparedQuery Prepare(string_view raw_query) const;
+    // разбирает запрос заново, если индекс изменился после его разбора
+    void Revalidate(PreparedQuery &query) const;
+    // запрос разобран для текущей версии индекса этого сервера
+    bool IsCurrent(const PreparedQuery &query) const;
+
+    vector<Document> FindTopDocuments(const PreparedQuery &query) const;
+    template<typename ExecutionPolicy>
+    vector<Document> FindTopDocuments(const ExecutionPolicy &policy,
+            const PreparedQuery &query) const;
+    vector<Document> FindTopDocuments(const PreparedQuery &query,
+            DocumentStatus status, size_t top_k = MAX_RESULT_DOCUMENT_COUNT,
+            EvaluationMode mode = EvaluationMode::EXHAUSTIVE) const;
+    template<typename ExecutionPolicy>
+    vector<Document> FindTopDocuments(const ExecutionPolicy &policy,
+            const PreparedQuery &query, DocumentStatus status, size_t top_k =
+                    MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
+    vector<Document> FindTopDocuments(const PreparedQuery &query,
+            const DocumentFilter &filter, size_t top_k =
+                    MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
+    template<typename ExecutionPolicy>
+    vector<Document> FindTopDocuments(const ExecutionPolicy &policy,
+            const PreparedQuery &query, const DocumentFilter &filter,
+            size_t top_k = MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
+    template<typename DocumentPredicate>
+    vector<Document> FindTopDocuments(const PreparedQuery &query,
+            DocumentPredicate document_predicate, size_t top_k =
+                    MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
+    template<typename ExecutionPolicy, typename DocumentPredicate>
+    vector<Document> FindTopDocuments(const ExecutionPolicy &policy,
+            const PreparedQuery &query, DocumentPredicate document_predicate,
+            size_t top_k = MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
 
     size_t GetDocumentCount() const;
 
+    // номер версии индекса, уникальный среди всех серверов процесса:
+    // новый номер выдаётся при создании, копировании, перемещении
+    // и присваивании сервера и при каждом изменении документов
+    // (AddDocument, AddDocuments, RemoveDocument) и IDF слов
+    // (SetInverseDocumentFreqTolerance, UpdateInverseDocumentFreqs),
+    // поэтому совпадение номеров означает тот же индекс того же сервера
+    uint64_t GetEpoch() const {
+        return epoch_.Get();
+    }
+
+    // IDF слов хранятся в таблице и пересчитываются после изменений
+    // документов: полностью, если количество документов изменилось больше,
+    // чем на долю tolerance, иначе - только для слов изменившихся документов
+    // (0 - IDF всегда точные)
+    void SetInverseDocumentFreqTolerance(double tolerance);
+    // точно пересчитывает IDF всех слов
+    void UpdateInverseDocumentFreqs();
+
+    // доля удалённых документов, после которой записи удалённых документов
+    // убираются из списков документов слов (0 - убираются сразу)
+    void SetCompactionThreshold(double threshold);
+    // убирает из списков документов слов записи всех удалённых документов
+    // и слова удалённых документов из прямого индекса
+    void CompactIndex();
+
+    // объём памяти, занимаемой списками документов слов (в байтах)
+    size_t GetIndexMemoryUsage() const;
+
     using MatchDocumentResult = tuple<vector<string_view>, DocumentStatus>;
     MatchDocumentResult MatchDocument(string_view raw_query,
             int document_id) const;
@@ -66,22 +261,36 @@ public:
             string_view raw_query, int document_id) const;
     MatchDocumentResult MatchDocument(const execution::parallel_policy&,
             string_view raw_query, int document_id) const;
+    MatchDocumentResult MatchDocument(const PreparedQuery &query,
+            int document_id) const;
+    MatchDocumentResult MatchDocument(const execution::sequenced_policy&,
+            const PreparedQuery &query, int document_id) const;
+    MatchDocumentResult MatchDocument(const execution::parallel_policy&,
+            const PreparedQuery &query, int document_id) const;
 
     int GetDocumentId(int index) const;
 
-    set<int>::iterator begin();
-    set<int>::iterator end();
+    DocumentStore::IdIterator begin() const;
+    DocumentStore::IdIterator end() const;
 
-    const map<string_view, double>& GetWordFrequencies(int document_id) const;
+    // частоты слов документа (пустые, если документа нет): представление
+    // прямого индекса, действительное, пока сервер не изменяется
+    WordFrequencies GetWordFrequencies(int document_id) const;
 
-private:
+    // идентификаторы слов документа по возрастанию, без копирования
+    // ({nullptr, nullptr}, если документа нет)
+    using TermRange = pair<const TermId*, const TermId*>;
+    TermRange GetDocumentTerms(int document_id) const;
 
-    list<string> all_words_;
+    // записывает индекс поискового сервера в файл снапшота
+    void SaveSnapshot(const string &path) const;
+    // открывает поисковый сервер из снапшота: файл отображается в память,
+    // поиск читает индекс прямо из него (данные копируются, только если
+    // сервер изменяется)
+    static SearchServer OpenSnapshot(const string &path, SnapshotCheck check =
+            SnapshotCheck::FULL);
 
-    struct DocumentData {
-        int rating;             // ср.рейтинг
-        DocumentStatus status;  // статус
-    };
+private:
 
     struct QueryWord {
         string_view data;
@@ -89,45 +298,291 @@ private:
         bool is_stop;
     };
 
+    // слова запроса, которые есть в словаре (слова, которых нет в словаре,
+    // не могут ни найти документ, ни исключить его). Плюс-слова упорядочены
+    // по тексту слова: в этом порядке суммируется релевантность, поэтому она
+    // не зависит от идентификаторов слов (у шардов ShardedSearchServer
+    // словари разные, а релевантность должна совпадать до бита)
     struct Query {
-        vector<string_view> plus_words;
-        vector<string_view> minus_words;
+        vector<TermId> plus_words;
+        vector<TermId> minus_words;
+        // IDF плюс-слов (заполняет ComputeInverseDocumentFreqs)
+        vector<double> inverse_document_freqs;
+    };
+
+    // стоп слова (проверка слова - совершенное хеширование)
+    StopWordSet stop_words_;
+
+    // документы в поисковом сервере (id документа, ср.рейтинг, статус
+    // по внутреннему номеру документа)
+    DocumentStore documents_;
+    // словарь всех слов документов
+    TermDictionary dictionary_;
+    // индекс слово -> документы (номер элемента - идентификатор слова)
+    vector<PostingList> word_to_document_freqs_;
+    // IDF слов (по идентификатору слова)
+    InverseDocumentFreqTable inverse_document_freqs_;
+    // битовые карты статусов и индекс рейтингов для DocumentFilter
+    DocumentFilterIndex filter_index_;
+    // удалённые документы, записи которых ещё остаются в списках документов
+    // слов, и количество таких записей в списке каждого слова
+    // (по идентификатору слова; слов за концом массива - 0)
+    vector<DocumentOrdinal> removed_ordinals_;
+    vector<uint32_t> removed_term_counts_;
+    // см. SetCompactionThreshold
+    double compaction_threshold_ = DEFAULT_COMPACTION_THRESHOLD;
+    // индекс документ -> слова: слова документа с внутренним номером ordinal
+    // и количества их вхождений в документ - элементы с номерами
+    // [document_word_ends_[ordinal - 1], document_word_ends_[ordinal])
+    // массивов document_words_ и document_word_counts_ (количества
+    // квантованы до 16 бит, см. QuantizeTermCount)
+    CowVector<uint64_t> document_word_ends_;
+    CowVector<TermId> document_words_;
+    CowVector<QuantizedTermCount> document_word_counts_;
+    // количество элементов document_words_, принадлежащих удалённым
+    // документам, записи которых уже убраны из списков документов слов
+    size_t removed_word_count_ = 0;
+
+    // отображённый в память файл снапшота, из которого открыт сервер
+    shared_ptr<const MappedFile> snapshot_;
+
+    /**
+     * @brief Номер версии индекса (см. GetEpoch)
+     *
+     *  Номера выдаёт общий для процесса атомарный счётчик, поэтому номер
+     *  не повторяется ни у другого сервера, ни у сервера, созданного
+     *  по тому же адресу. Копирование и присваивание выдают новый номер
+     *  (перемещение - и источнику, содержимое которого изменилось), так что
+     *  специальные функции SearchServer остаются по умолчанию.
+     */
+    class Epoch {
+    public:
+        Epoch() :
+                value_(Next()) {
+        }
+        Epoch(const Epoch&) :
+                value_(Next()) {
+        }
+        Epoch(Epoch &&other) noexcept :
+                value_(Next()) {
+            other.Advance();
+        }
+        Epoch& operator=(const Epoch&) {
+            Advance();
+            return *this;
+        }
+        Epoch& operator=(Epoch &&other) noexcept {
+            Advance();
+            other.Advance();
+            return *this;
+        }
+
+        uint64_t Get() const {
+            return value_;
+        }
+        // новый номер после изменения индекса
+        void Advance() {
+            value_ = Next();
+        }
+
+    private:
+        uint64_t value_;
+
+        static uint64_t Next();
     };
 
-    // стоп слова
-    set<string> stop_words_;
+    Epoch epoch_;
 
-    // документы в поисковом сервере ({id документа, информация о документе (ср.рейтинг, статус)})
-    map<int, DocumentData> documents_;
-    set<int> documents_ids_;
-    map<string_view, map<int, double>> word_to_document_freqs_;
-    map<int, map<string_view, double>> document_to_word_freqs_;
+    SearchServer() = default;
+
+    // номер первого слова документа в document_words_
+    size_t GetDocumentWordsBegin(DocumentOrdinal ordinal) const {
+        return ordinal == 0 ? 0 : document_word_ends_[ordinal - 1];
+    }
 
     static bool IsValidWord(string_view word);
 
     template<typename StringContainer>
-    static set<string> MakeUniqueNonEmptyStrings(
+    static set<string, less<>> MakeUniqueNonEmptyStrings(
             const StringContainer &strings);
 
     bool IsStopWord(string_view word) const;
 
-    vector<string_view> SplitIntoWordsNoStop(string_view text) const;
+    // разбирает текст на слова без стоп-слов в words; false - в тексте
+    // есть недопустимые символы
+    bool SplitIntoWordsNoStop(string_view text,
+            vector<string_view> &words) const;
 
     static int ComputeAverageRating(const vector<int> &ratings);
 
+    // количество документов со словом (без удалённых)
+    size_t GetDocumentFreq(TermId term_id) const {
+        const size_t removed_count =
+                term_id < removed_term_counts_.size() ?
+                        removed_term_counts_[term_id] : 0;
+        return word_to_document_freqs_[term_id].size() - removed_count;
+    }
+
+    // учитывает удаление документа (отмеченного в documents_) в счётчиках
+    // записей удалённых документов и таблице IDF
+    void MarkDocumentRemoved(DocumentOrdinal ordinal);
+
+    // очищает списки, если доля удалённых документов превысила порог
+    template<typename ExecutionPolicy>
+    void CompactIndexIfNeeded(const ExecutionPolicy &policy);
+
+    template<typename ExecutionPolicy>
+    void CompactIndex(const ExecutionPolicy &policy);
+    // убирает из прямого индекса слова удалённых документов
+    void CompactDocumentWords();
+
+    template<typename ExecutionPolicy>
+    void RemoveDocumentsBatch(const ExecutionPolicy &policy,
+            const vector<int> &document_ids);
+
+    template<typename ExecutionPolicy>
+    vector<AddDocumentError> AddDocumentsInParts(const ExecutionPolicy &policy,
+            const vector<DocumentToAdd> &documents, size_t part_count);
+
     QueryWord ParseQueryWord(string_view text) const;
 
     Query ParseQuery(string_view text, bool skip_sort = false) const;
 
-    double ComputeWordInverseDocumentFreq(string_view word) const;
+    void ComputeInverseDocumentFreqs(Query &query) const;
+
+    // обновляет таблицу IDF, если документы изменились
+    void UpdateInverseDocumentFreqTable() const;
+
+    // разобранный запрос prepared_query, если он действителен, иначе -
+    // запрос, заново разобранный в stale_query
+    const Query& ResolveQuery(const PreparedQuery &prepared_query,
+            Query &stale_query) const;
+
+    // слова запроса, которые есть в документе с внутренним номером ordinal
+    // (пусто, если в документе есть минус-слово)
+    template<typename ExecutionPolicy>
+    MatchDocumentResult MatchQuery(const ExecutionPolicy &policy,
+            const Query &query, DocumentOrdinal ordinal) const;
+
+    /**
+     * @brief Критерий поиска по DocumentFilter: проверяет бит документа
+     *        в битовой карте, построенной для запроса, затем остаточный
+     *        критерий
+     */
+    class FilterPredicate {
+    public:
+        FilterPredicate(const DocumentStore &documents,
+                const DocumentFilter::Residual &residual) :
+                documents_(&documents), residual_(&residual) {
+        }
+        FilterPredicate(const FilterPredicate&) = delete;
+        FilterPredicate& operator=(const FilterPredicate&) = delete;
+        FilterPredicate(FilterPredicate&&) = default;
+
+        bool operator()(DocumentOrdinal ordinal) const {
+            if (bitmap_ != nullptr
+                    && ((bitmap_[ordinal / 64] >> (ordinal % 64)) & 1) == 0) {
+                return false;
+            }
+            return !*residual_
+                    || (*residual_)(documents_->GetId(ordinal),
+                            documents_->GetStatus(ordinal),
+                            documents_->GetRating(ordinal));
+        }
+
+    private:
+        friend class SearchServer;
+
+        const DocumentStore *documents_;
+        const DocumentFilter::Residual *residual_;
+        // отобранные документы (nullptr - все): битовая карта статуса
+        // из filter_index_ или own_bitmap_
+        const uint64_t *bitmap_ = nullptr;
+        vector<uint64_t> own_bitmap_;
+    };
+
+    // критерий поиска по фильтру (действителен, пока существует filter)
+    FilterPredicate MakeFilterPredicate(const DocumentFilter &filter) const;
+
+    // критерий поиска по внутреннему номеру документа для критерия
+    // document_predicate(id документа, статус, рейтинг)
+    template<typename DocumentPredicate>
+    auto MakeOrdinalPredicate(DocumentPredicate &document_predicate) const {
+        return [this, &document_predicate](DocumentOrdinal ordinal) {
+            return document_predicate(documents_.GetId(ordinal),
+                    documents_.GetStatus(ordinal),
+                    documents_.GetRating(ordinal));
+        };
+    }
 
+    // (здесь и далее document_predicate(внутренний номер документа))
     template<typename DocumentPredicate>
     vector<Document> FindAllDocuments(const Query &query,
-            DocumentPredicate document_predicate) const;
+            DocumentPredicate document_predicate, size_t top_k,
+            EvaluationMode mode) const;
 
     template<typename ExecutionPolicy, typename DocumentPredicate>
     vector<Document> FindAllDocuments(const ExecutionPolicy &policy,
-            const Query &query, DocumentPredicate document_predicate) const;
+            const Query &query, DocumentPredicate document_predicate,
+            size_t top_k, EvaluationMode mode) const;
+
+    template<typename DocumentPredicate>
+    void FindDocumentsInRange(const Query &query,
+            DocumentPredicate &document_predicate, DocumentOrdinal first,
+            DocumentOrdinal last, EvaluationMode mode,
+            TopDocuments &top_documents) const;
+
+    template<typename DocumentPredicate>
+    void FindDocumentsInRangeExhaustive(const Query &query,
+            DocumentPredicate &document_predicate, DocumentOrdinal first,
+            DocumentOrdinal last, TopDocuments &top_documents) const;
+
+    template<typename DocumentPredicate>
+    void FindDocumentsInRangePruned(const Query &query,
+            DocumentPredicate &document_predicate, DocumentOrdinal first,
+            DocumentOrdinal last, TopDocuments &top_documents) const;
+
+    static size_t GetParallelPartCount(size_t count, size_t min_part_size =
+            MIN_PARALLEL_PART_SIZE);
+
+    // шардированный сервер разбирает запрос в каждом шарде и подставляет
+    // в запросы IDF, вычисленные по всем шардам
+    friend class ShardedSearchServer;
+    // кеш результатов строит ключ по разобранному запросу и выполняет его
+    // без повторного разбора
+    friend class QueryResultCache;
+    // сервер с версиями обновляет таблицу IDF до публикации версии
+    friend class VersionedSearchServer;
+};
+
+/**
+ * @brief Запрос, разобранный сервером один раз (SearchServer::Prepare)
+ *
+ *  Хранит текст запроса, идентификаторы плюс- и минус-слов (по ним списки
+ *  документов слов берутся без поиска в словаре), IDF плюс-слов, а также
+ *  сервер и версию его индекса, для которых запрос разобран: проверка
+ *  действительности - два сравнения. Не изменяется при выполнении, поэтому
+ *  один запрос можно выполнять из нескольких потоков одновременно.
+ */
+class SearchServer::PreparedQuery {
+public:
+    PreparedQuery() = default;
+
+    const string& GetText() const {
+        return text_;
+    }
+    uint64_t GetEpoch() const {
+        return epoch_;
+    }
+
+private:
+    friend class SearchServer;
+
+    string text_;
+    // версия индекса, для которой разобран запрос (0 - не разобран;
+    // серверы выдают номера с 1)
+    uint64_t epoch_ = 0;
+    Query query_;
 };
 
 // Шаблонные функции
@@ -137,57 +592,48 @@ SearchServer::SearchServer(const StringContainer &stop_words) :
         stop_words_(MakeUniqueNonEmptyStrings(stop_words)) {
 }
 
+template<size_t N>
+SearchServer::SearchServer(const StaticStopWords<N> &stop_words) :
+        stop_words_(stop_words) {
+}
+
 /**
- * @brief Ищет 5 документов с наибольшей релевантностью
+ * @brief Ищет top_k документов с наибольшей релевантностью
  *
  * Ищет по поисковым словам и критерию, который определяется функцией
  * (функциональный объект, который поступает на вход)
  *
  * @param raw_query   Поисковые слова (слова, которые ищем)
  * @tparam document_predicate Критерий поиска (функция)
+ * @param top_k       Максимальное количество документов в результате
+ * @param mode        Способ вычисления результатов
  * @return Результат поиска (вектор структур(id документа, релевантность, рейтинг))
  */
 template<typename DocumentPredicate>
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query,
-        DocumentPredicate document_predicate) const {
+        DocumentPredicate document_predicate, size_t top_k,
+        EvaluationMode mode) const {
+    SEARCH_METRICS_COUNT(QUERIES, 1);
     Query query = ParseQuery(raw_query, false);
-    if (!IsValidWord(raw_query)) {
-        throw invalid_argument("--!!!"s);
-    }
-    vector<Document> documents = FindAllDocuments(query, document_predicate);
-
-    sort(documents.begin(), documents.end(),
-            [](const Document &lhs, const Document &rhs) {
-                return rhs < lhs;
-            });
-    if (documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
-    return documents;
+    ComputeInverseDocumentFreqs(query);
+    return FindAllDocuments(query, MakeOrdinalPredicate(document_predicate),
+            top_k, mode);
 }
 
 template<typename ExecutionPolicy, typename DocumentPredicate>
 vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy &policy,
-        string_view raw_query, DocumentPredicate document_predicate) const {
+        string_view raw_query, DocumentPredicate document_predicate,
+        size_t top_k, EvaluationMode mode) const {
 
     if (is_same_v<decay_t<ExecutionPolicy>, execution::sequenced_policy>) {
-        return FindTopDocuments(raw_query, document_predicate);
-    } else if (is_same_v<decay_t<ExecutionPolicy>, execution::parallel_policy>) {
-        const auto query = ParseQuery(raw_query, false);
-
-        vector<Document> matched_documents = FindAllDocuments(policy, query,
-                document_predicate);
-
-        sort(policy, matched_documents.begin(), matched_documents.end(),
-                [](const Document &lhs, const Document &rhs) {
-                    return rhs < lhs;
-                });
-        //оставляем только MAX_RESULT_DOCUMENT_COUNT первых результатов
-        if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-            matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-        }
-
-        return matched_documents;
+        return FindTopDocuments(raw_query, document_predicate, top_k, mode);
+    } else if (is_same_v<decay_t<ExecutionPolicy>, execution::parallel_policy>
+            || is_same_v<decay_t<ExecutionPolicy>, QueryExecutor>) {
+        SEARCH_METRICS_COUNT(QUERIES, 1);
+        auto query = ParseQuery(raw_query, false);
+        ComputeInverseDocumentFreqs(query);
+        return FindAllDocuments(policy, query,
+                MakeOrdinalPredicate(document_predicate), top_k, mode);
     } else {
         throw runtime_error("invalid parameter passed");
     }
@@ -195,12 +641,41 @@ vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy &policy,
 
 template<typename ExecutionPolicy>
 vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy &policy,
-        string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(policy, raw_query,
-            [status](int document_id, DocumentStatus document_status,
-                    int rating) {
-                return document_status == status;
-            });
+        string_view raw_query, DocumentStatus status, size_t top_k,
+        EvaluationMode mode) const {
+    return FindTopDocuments(policy, raw_query, DocumentFilter(status), top_k,
+            mode);
+}
+
+/**
+ * @brief Ищет top_k документов, отобранных фильтром
+ *
+ *  Битовая карта документов фильтра строится один раз для запроса, поиск
+ *  проверяет бит документа вместо вызова критерия.
+ *
+ * @param raw_query Поисковые слова (слова, которые ищем)
+ * @param filter    Фильтр документов
+ * @param top_k     Максимальное количество документов в результате
+ * @param mode      Способ вычисления результатов
+ * @return Результат поиска (вектор структур(id документа, релевантность, рейтинг))
+ */
+template<typename ExecutionPolicy>
+vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy &policy,
+        string_view raw_query, const DocumentFilter &filter, size_t top_k,
+        EvaluationMode mode) const {
+    if constexpr (is_same_v<decay_t<ExecutionPolicy>,
+            execution::sequenced_policy>) {
+        return FindTopDocuments(raw_query, filter, top_k, mode);
+    } else {
+        SEARCH_METRICS_COUNT(QUERIES, 1);
+        Query query = ParseQuery(raw_query, false);
+        ComputeInverseDocumentFreqs(query);
+        const FilterPredicate predicate = MakeFilterPredicate(filter);
+        return FindAllDocuments(policy, query,
+                [&predicate](DocumentOrdinal ordinal) {
+                    return predicate(ordinal);
+                }, top_k, mode);
+    }
 }
 
 template<typename ExecutionPolicy>
@@ -209,6 +684,80 @@ vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy &policy,
     return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
+/**
+ * @brief Ищет top_k документов по разобранному запросу
+ *
+ *  Текст запроса не разбирается, если запрос действителен для текущей версии
+ *  индекса (см. IsCurrent).
+ *
+ * @param prepared_query     Разобранный запрос (SearchServer::Prepare)
+ * @tparam document_predicate Критерий поиска (функция)
+ * @param top_k              Максимальное количество документов в результате
+ * @param mode               Способ вычисления результатов
+ * @return Результат поиска (вектор структур(id документа, релевантность, рейтинг))
+ */
+template<typename DocumentPredicate>
+vector<Document> SearchServer::FindTopDocuments(
+        const PreparedQuery &prepared_query,
+        DocumentPredicate document_predicate, size_t top_k,
+        EvaluationMode mode) const {
+    SEARCH_METRICS_COUNT(QUERIES, 1);
+    Query stale_query;
+    return FindAllDocuments(ResolveQuery(prepared_query, stale_query),
+            MakeOrdinalPredicate(document_predicate), top_k, mode);
+}
+
+template<typename ExecutionPolicy, typename DocumentPredicate>
+vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy &policy,
+        const PreparedQuery &prepared_query,
+        DocumentPredicate document_predicate, size_t top_k,
+        EvaluationMode mode) const {
+    if constexpr (is_same_v<decay_t<ExecutionPolicy>,
+            execution::sequenced_policy>) {
+        return FindTopDocuments(prepared_query, document_predicate, top_k,
+                mode);
+    } else {
+        SEARCH_METRICS_COUNT(QUERIES, 1);
+        Query stale_query;
+        return FindAllDocuments(policy,
+                ResolveQuery(prepared_query, stale_query),
+                MakeOrdinalPredicate(document_predicate), top_k, mode);
+    }
+}
+
+template<typename ExecutionPolicy>
+vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy &policy,
+        const PreparedQuery &prepared_query, DocumentStatus status,
+        size_t top_k, EvaluationMode mode) const {
+    return FindTopDocuments(policy, prepared_query, DocumentFilter(status),
+            top_k, mode);
+}
+
+template<typename ExecutionPolicy>
+vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy &policy,
+        const PreparedQuery &prepared_query, const DocumentFilter &filter,
+        size_t top_k, EvaluationMode mode) const {
+    if constexpr (is_same_v<decay_t<ExecutionPolicy>,
+            execution::sequenced_policy>) {
+        return FindTopDocuments(prepared_query, filter, top_k, mode);
+    } else {
+        SEARCH_METRICS_COUNT(QUERIES, 1);
+        Query stale_query;
+        const Query &query = ResolveQuery(prepared_query, stale_query);
+        const FilterPredicate predicate = MakeFilterPredicate(filter);
+        return FindAllDocuments(policy, query,
+                [&predicate](DocumentOrdinal ordinal) {
+                    return predicate(ordinal);
+                }, top_k, mode);
+    }
+}
+
+template<typename ExecutionPolicy>
+vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy &policy,
+        const PreparedQuery &prepared_query) const {
+    return FindTopDocuments(policy, prepared_query, DocumentStatus::ACTUAL);
+}
+
 /**
  * @brief Проверяет слова из входного контейнера на отсутствие пустых элементов и
  *  недопустимых символов - затем преобразует в set
@@ -218,16 +767,15 @@ vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy &policy,
  * @return set слов
  */
 template<typename StringContainer>
-set<string> SearchServer::MakeUniqueNonEmptyStrings(
+set<string, less<>> SearchServer::MakeUniqueNonEmptyStrings(
         const StringContainer &strings) {
-    set<string> non_empty_strings;
+    set<string, less<>> non_empty_strings;
     for (string_view word : strings) {
-        string str { word };
-        if (!str.empty()) {
-            if (!IsValidWord(str)) {
+        if (!word.empty()) {
+            if (!IsValidWord(word)) {
                 throw invalid_argument("недопустимые символы !!!"s);
             }
-            non_empty_strings.insert(str);
+            non_empty_strings.emplace(word);
         }
     }
     return non_empty_strings;
@@ -240,116 +788,339 @@ set<string> SearchServer::MakeUniqueNonEmptyStrings(
  * (функциональный объект, который поступает на вход)
  *
  * @param query Слова поискового запроса
- * @tparam document_predicate Критерий поиска (функция)
- * @return Вектор документов (id документа, релевантность, ср.рейтинг)
+ * @tparam document_predicate Критерий поиска (функция от внутреннего номера
+ *                            документа)
+ * @param top_k Максимальное количество документов в результате
+ * @param mode  Способ вычисления результатов
+ * @return top_k документов с наибольшей релевантностью
+ *         (id документа, релевантность, ср.рейтинг)
  */
 template<typename DocumentPredicate>
 vector<Document> SearchServer::FindAllDocuments(
         const SearchServer::Query &query,
-        DocumentPredicate document_predicate) const {
+        DocumentPredicate document_predicate, size_t top_k,
+        EvaluationMode mode) const {
+    TopDocuments top_documents(top_k);
+    FindDocumentsInRange(query, document_predicate, 0,
+            documents_.GetOrdinalCount(), mode, top_documents);
+    SEARCH_METRICS_STAGE(TOP_K);
+    return top_documents.Extract();
+}
 
-    map<int, double> document_to_relevance;
-    for (string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+template<typename ExecutionPolicy, typename DocumentPredicate>
+vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy &policy,
+        const SearchServer::Query &query, DocumentPredicate document_predicate,
+        size_t top_k, EvaluationMode mode) const {
+
+    if constexpr (is_same_v<decay_t<ExecutionPolicy>,
+            execution::sequenced_policy>) {
+        return FindAllDocuments(query, document_predicate, top_k, mode);
+    } else if constexpr (is_same_v<decay_t<ExecutionPolicy>,
+            execution::parallel_policy>
+            || is_same_v<decay_t<ExecutionPolicy>, QueryExecutor>) {
+        // делим диапазон внутренних номеров документов на непересекающиеся части:
+        // каждый поток считает релевантность документов своей части в собственном
+        // накопителе и отбирает свои top_k документов, поэтому блокировки не нужны
+        const size_t ordinal_count = documents_.GetOrdinalCount();
+        const size_t part_count = GetParallelPartCount(ordinal_count);
+        vector<TopDocuments> parts(part_count, TopDocuments(top_k));
+        ParallelFor(policy, part_count,
+                [this, &query, &document_predicate, &parts, ordinal_count,
+                        part_count, mode](size_t part) {
+                    FindDocumentsInRange(query, document_predicate,
+                            ordinal_count * part / part_count,
+                            ordinal_count * (part + 1) / part_count, mode,
+                            parts[part]);
+                });
+
+        SEARCH_METRICS_STAGE(TOP_K);
+        TopDocuments top_documents(top_k);
+        for (const TopDocuments &part : parts) {
+            top_documents.Merge(part);
+        }
+        return top_documents.Extract();
+    } else {
+        throw runtime_error("invalid parameter passed");
+    }
+}
+
+/**
+ * @brief Ищет документы с внутренними номерами из диапазона [first, last)
+ *
+ * @param query Слова поискового запроса
+ * @tparam document_predicate Критерий поиска (функция от внутреннего номера
+ *                            документа)
+ * @param first Первый внутренний номер документа диапазона
+ * @param last  Номер документа, следующий за последним номером диапазона
+ * @param mode  Способ вычисления результатов
+ * @param top_documents Отбор лучших документов
+ */
+template<typename DocumentPredicate>
+void SearchServer::FindDocumentsInRange(const SearchServer::Query &query,
+        DocumentPredicate &document_predicate, DocumentOrdinal first,
+        DocumentOrdinal last, EvaluationMode mode,
+        TopDocuments &top_documents) const {
+    if (mode == EvaluationMode::PRUNED) {
+        FindDocumentsInRangePruned(query, document_predicate, first, last,
+                top_documents);
+    } else {
+        FindDocumentsInRangeExhaustive(query, document_predicate, first, last,
+                top_documents);
+    }
+}
+
+/**
+ * @brief Полный поиск документов с внутренними номерами из диапазона [first, last)
+ *
+ *  Документы из списков минус-слов сначала исключаются в плотном накопителе
+ *  текущего потока, затем в нём накапливается релевантность остальных
+ *  документов из списков плюс-слов; они отбираются в top_documents.
+ */
+template<typename DocumentPredicate>
+void SearchServer::FindDocumentsInRangeExhaustive(
+        const SearchServer::Query &query,
+        DocumentPredicate &document_predicate, DocumentOrdinal first,
+        DocumentOrdinal last, TopDocuments &top_documents) const {
+    ScoreAccumulator::Lease accumulator;
+    accumulator->Reset(first, last - first);
+
+    // документы с минус-словами исключаются до обхода списков плюс-слов,
+    // поэтому релевантность им не накапливается
+    {
+        SEARCH_METRICS_STAGE(MINUS_WORDS);
+        for (const TermId word : query.minus_words) {
+            word_to_document_freqs_[word].ForEachInRange(first, last,
+                    [&accumulator](DocumentOrdinal ordinal, uint32_t) {
+                        accumulator->Exclude(ordinal);
+                    });
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(
-                word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(
-                word)) {
-            const DocumentData &document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status,
-                    document_data.rating)) {
-                document_to_relevance[document_id] += term_freq
-                        * inverse_document_freq;
+    }
+
+    {
+        SEARCH_METRICS_STAGE(POSTINGS);
+        for (size_t i = 0; i < query.plus_words.size(); ++i) {
+            if (GetDocumentFreq(query.plus_words[i]) == 0) {
+                continue;
             }
+            const PostingList &postings =
+                    word_to_document_freqs_[query.plus_words[i]];
+            const double inverse_document_freq =
+                    query.inverse_document_freqs[i];
+            [[maybe_unused]] const size_t scanned = postings.ForEachInRange(
+                    first, last,
+                    [this, &accumulator, inverse_document_freq](
+                            DocumentOrdinal ordinal, uint32_t term_count) {
+                        accumulator->Add(ordinal,
+                                documents_.GetTermFreq(ordinal, term_count)
+                                        * inverse_document_freq);
+                    });
+            SEARCH_METRICS_COUNT(POSTINGS_SCANNED, scanned);
         }
     }
 
-    for (string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+    // критерий поиска проверяется один раз для каждого найденного документа
+    // (а не для каждой его записи в списках плюс-слов); записи удалённых
+    // документов, ещё остающиеся в списках, исключаются здесь же
+    {
+        SEARCH_METRICS_STAGE(PREDICATE);
+        accumulator->ExcludeIf(
+                [this, &document_predicate](DocumentOrdinal ordinal) {
+                    return documents_.IsRemoved(ordinal)
+                            || !document_predicate(ordinal);
+                });
+    }
+
+    SEARCH_METRICS_STAGE(TOP_K);
+    [[maybe_unused]] size_t scored = 0;
+    accumulator->ForEachScored(
+            [this, &top_documents, &scored](DocumentOrdinal ordinal,
+                    double relevance) {
+                top_documents.Add( { documents_.GetId(ordinal), relevance,
+                        documents_.GetRating(ordinal) });
+                ++scored;
+            });
+    SEARCH_METRICS_COUNT(DOCUMENTS_SCORED, scored);
+}
+
+/**
+ * @brief Поиск с отсечением документов с внутренними номерами из диапазона [first, last)
+ *
+ *  Списки документов плюс-слов обходятся одновременно по возрастанию номера
+ *  документа (Block-Max MaxScore). Для каждого слова известна оценка сверху его
+ *  вклада в релевантность (максимальный TF * IDF) - во всём списке и в каждом
+ *  блоке списка.
+ *  - слова упорядочиваются по оценке; слова с наименьшими оценками, сумма
+ *    которых меньше релевантности худшего из отобранных документов, сами по себе
+ *    не могут привести документ в результат ("необязательные" слова), поэтому
+ *    кандидаты берутся только из списков остальных ("обязательных") слов;
+ *  - для кандидата необязательные слова проверяются, пока вклад найденных слов
+ *    плюс оценка (по блокам) непроверенных может достичь порога.
+ *  Релевантность документа суммируется в том же порядке слов, что и при полном
+ *  поиске, а оценки (суммы в другом порядке) сравниваются с порогом,
+ *  уменьшенным на ошибку округления (PRUNING_ROUNDING_SLACK), поэтому
+ *  результаты совпадают.
+ */
+template<typename DocumentPredicate>
+void SearchServer::FindDocumentsInRangePruned(const SearchServer::Query &query,
+        DocumentPredicate &document_predicate, DocumentOrdinal first,
+        DocumentOrdinal last, TopDocuments &top_documents) const {
+    struct TermCursor {
+        PostingList::Cursor cursor;
+        double inverse_document_freq;
+        double max_relevance;  // оценка сверху вклада слова в релевантность
+        size_t index;          // номер слова в запросе
+    };
+    constexpr DocumentOrdinal END = PostingList::Cursor::END;
+    // время обхода списков - без вложенных этапов (минус-слова, критерий
+    // поиска, отбор лучших), которые замеряются для каждого кандидата
+    SEARCH_METRICS_STAGE(POSTINGS);
+
+    // курсоры плюс-слов в порядке слов запроса
+    vector<TermCursor> terms;
+    terms.reserve(query.plus_words.size());
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        if (GetDocumentFreq(query.plus_words[i]) == 0) {
             continue;
         }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
-        }
+        const PostingList &postings =
+                word_to_document_freqs_[query.plus_words[i]];
+        const double inverse_document_freq = query.inverse_document_freqs[i];
+        terms.push_back( { PostingList::Cursor(postings, first, last),
+                inverse_document_freq, postings.GetMaxTermFreq()
+                        * inverse_document_freq, terms.size() });
+    }
+    vector<PostingList::Cursor> minus_cursors;
+    for (const TermId word : query.minus_words) {
+        minus_cursors.emplace_back(word_to_document_freqs_[word], first, last);
     }
 
-    vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back(
-                { document_id, relevance, documents_.at(document_id).rating });
+    // курсоры по возрастанию оценки вклада слова и суммы оценок
+    // max_relevance_sums[i] = сумма оценок order[0] ... order[i - 1]
+    vector<TermCursor*> order(terms.size());
+    transform(terms.begin(), terms.end(), order.begin(), [](TermCursor &term) {
+        return &term;
+    });
+    stable_sort(order.begin(), order.end(),
+            [](const TermCursor *lhs, const TermCursor *rhs) {
+                return lhs->max_relevance < rhs->max_relevance;
+            });
+    vector<double> max_relevance_sums(order.size() + 1, 0.0);
+    for (size_t i = 0; i < order.size(); ++i) {
+        max_relevance_sums[i + 1] = max_relevance_sums[i]
+                + order[i]->max_relevance;
     }
-    return matched_documents;
-}
+    // order[0] ... order[first_essential - 1] - необязательные слова
+    size_t first_essential = 0;
 
-template<typename ExecutionPolicy, typename DocumentPredicate>
-vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy &policy,
-        const SearchServer::Query &query,
-        DocumentPredicate document_predicate) const {
+    // оценки по блокам необязательных слов и их суммы
+    vector<double> block_max_relevance_sums(order.size() + 1, 0.0);
+    // курсоры слов, найденных в документе-кандидате
+    vector<const TermCursor*> matched;
+    matched.reserve(terms.size());
 
-    if (is_same_v<decay_t<ExecutionPolicy>, execution::sequenced_policy>) {
-        return FindAllDocuments(query, document_predicate);
-    } else if (is_same_v<decay_t<ExecutionPolicy>, execution::parallel_policy>) {
+    while (true) {
+        // оценки сравниваются с порогом, уменьшенным на ошибку округления:
+        // документ, релевантность которого равна порогу, не отсекается,
+        // как и при полном поиске
+        const double min_relevance =
+                top_documents.GetMinCompetitiveRelevance();
+        const double threshold = isfinite(min_relevance) ?
+                min_relevance - abs(min_relevance) * PRUNING_ROUNDING_SLACK :
+                min_relevance;
+        while (first_essential < order.size()
+                && max_relevance_sums[first_essential + 1] < threshold) {
+            ++first_essential;
+        }
+        if (first_essential == order.size()) {
+            break;
+        }
 
-        ConcurrentMap<int, double> document_to_relevance_par(MAX_SUBMAP_COUNT);
-        const double documents_count = GetDocumentCount();
+        // кандидат - ближайший документ из списков обязательных слов
+        DocumentOrdinal candidate = END;
+        for (size_t i = first_essential; i < order.size(); ++i) {
+            candidate = min(candidate, order[i]->cursor.GetOrdinal());
+        }
+        if (candidate == END) {
+            break;
+        }
 
-        // собираем вектор плюс слов
-        vector<string_view> plus_words(query.plus_words.size());
-        transform(query.plus_words.begin(), query.plus_words.end(),
-                plus_words.begin(), [](auto &word) {
-                    return word;
-                });
+        matched.clear();
+        double relevance_bound = 0.0;
+        for (size_t i = first_essential; i < order.size(); ++i) {
+            if (order[i]->cursor.GetOrdinal() == candidate) {
+                relevance_bound += documents_.GetTermFreq(candidate,
+                        order[i]->cursor.GetTermCount())
+                        * order[i]->inverse_document_freq;
+                matched.push_back(order[i]);
+            }
+        }
 
-        for_each(policy, plus_words.begin(), plus_words.end(),
-                [this, &document_to_relevance_par, documents_count,
-                        document_predicate](auto &word) {
-                    if (word_to_document_freqs_.count(word) == 0) {
-                        return;
-                    }
-                    // проходим по всем документам содержащим плюс слова
-                    // считаем IDF для слова из запроса
-                    // считаем IDF-TF для документа
-                    const double inverse_document_freq =
-                            ComputeWordInverseDocumentFreq(word);
-                    for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(
-                            word)) {
-                        // добавляем только документы удовлетворяющие предикату
-                        const auto &document = documents_.at(document_id);
-                        if (document_predicate(document_id, document.status,
-                                document.rating)) {
-                            document_to_relevance_par[document_id].ref_to_value +=
-                                    term_freq * inverse_document_freq;
-                        }
-                    }
-                });
+        bool is_competitive = relevance_bound
+                + max_relevance_sums[first_essential] >= threshold;
+        if (is_competitive && first_essential > 0) {
+            for (size_t i = 0; i < first_essential; ++i) {
+                block_max_relevance_sums[i + 1] = block_max_relevance_sums[i]
+                        + order[i]->cursor.GetBlockMaxTermFreq(candidate)
+                                * order[i]->inverse_document_freq;
+            }
+            // проверяем необязательные слова от больших оценок к меньшим
+            for (size_t i = first_essential; i-- > 0;) {
+                if (relevance_bound + block_max_relevance_sums[i + 1]
+                        < threshold) {
+                    is_competitive = false;
+                    break;
+                }
+                PostingList::Cursor &cursor = order[i]->cursor;
+                cursor.Advance(candidate);
+                if (cursor.GetOrdinal() == candidate) {
+                    relevance_bound += documents_.GetTermFreq(candidate,
+                            cursor.GetTermCount())
+                            * order[i]->inverse_document_freq;
+                    matched.push_back(order[i]);
+                }
+            }
+        }
 
-        map<int, double> document_to_relevance =
-                document_to_relevance_par.BuildOrdinaryMap();
-
-        // здесь не параллелим, чтобы не было гонки
-        for_each(query.minus_words.begin(), query.minus_words.end(),
-                [this, &document_to_relevance](auto &word) {
-                    if (word_to_document_freqs_.count(word) == 0) {
-                        return;
-                    }
-                    // проходим по всем документам содержащим минус-слово
-                    for (const auto [document_id, _] : word_to_document_freqs_.at(
-                            word)) {
-                        document_to_relevance.erase(document_id);
-                    }
-                });
+        SEARCH_METRICS_COUNT(POSTINGS_SCANNED, matched.size());
+        // удалённый документ (его записи ещё остаются в списках) пропускается
+        if (is_competitive && !documents_.IsRemoved(candidate)) {
+            bool is_excluded = false;
+            {
+                SEARCH_METRICS_STAGE(MINUS_WORDS);
+                is_excluded = any_of(minus_cursors.begin(),
+                        minus_cursors.end(),
+                        [candidate](PostingList::Cursor &cursor) {
+                            cursor.Advance(candidate);
+                            return cursor.GetOrdinal() == candidate;
+                        });
+            }
+            bool is_matched = false;
+            if (!is_excluded) {
+                SEARCH_METRICS_STAGE(PREDICATE);
+                is_matched = document_predicate(candidate);
+            }
+            if (is_matched) {
+                SEARCH_METRICS_STAGE(TOP_K);
+                SEARCH_METRICS_COUNT(DOCUMENTS_SCORED, 1);
+                sort(matched.begin(), matched.end(),
+                        [](const TermCursor *lhs, const TermCursor *rhs) {
+                            return lhs->index < rhs->index;
+                        });
+                double relevance = 0.0;
+                for (const TermCursor *term : matched) {
+                    relevance += documents_.GetTermFreq(candidate,
+                            term->cursor.GetTermCount())
+                            * term->inverse_document_freq;
+                }
+                top_documents.Add( { documents_.GetId(candidate), relevance,
+                        documents_.GetRating(candidate) });
+            }
+        }
 
-        vector<Document> matched_documents;
-        matched_documents.reserve(document_to_relevance.size());
-        for (const auto& [document_id, relevance] : document_to_relevance) {
-            // формируем вектор документов на выдачу
-            matched_documents.push_back(Document { document_id, relevance,
-                    documents_.at(document_id).rating });
+        for (size_t i = first_essential; i < order.size(); ++i) {
+            if (order[i]->cursor.GetOrdinal() == candidate) {
+                order[i]->cursor.Next();
+            }
         }
-        return matched_documents;
-    } else {
-        throw runtime_error("invalid parameter passed");
     }
 }
@@ -0,0 +1,161 @@
+#include <cmath>
+#include <stdexcept>
+
+#include "sharded_search_server.h"
+#include "string_processing.h"
+
+using namespace std;
+
+ShardedSearchServer::ShardedSearchServer(size_t shard_count,
+        string stop_words_text) :
+        ShardedSearchServer(shard_count, SplitIntoWords(stop_words_text)) {
+}
+
+ShardedSearchServer::ShardedSearchServer(size_t shard_count,
+        string_view stop_words_text) :
+        ShardedSearchServer(shard_count, SplitIntoWords(stop_words_text)) {
+}
+
+/**
+ * @brief Добавляет документ в шард документа
+ *
+ * @param document_id id документа
+ * @param document    Текст документа
+ * @param status      Статус документа
+ * @param ratings     Рейтинги слов
+ */
+void ShardedSearchServer::AddDocument(int document_id, string_view document,
+        DocumentStatus status, const vector<int> &ratings) {
+    shards_[GetShardIndex(document_id)].AddDocument(document_id, document,
+            status, ratings);
+}
+
+/**
+ * @brief Добавляет пакет документов
+ *
+ *  Пакет делится по шардам (документы с одинаковым id попадают в один шард,
+ *  поэтому повторные id находит AddDocuments шарда), шарды заполняются
+ *  параллельно.
+ *
+ * @param documents Пакет документов
+ * @return Ошибки добавления документов в порядке пакета
+ */
+vector<AddDocumentError> ShardedSearchServer::AddDocuments(
+        const vector<DocumentToAdd> &documents) {
+    vector<vector<DocumentToAdd>> shard_documents(shards_.size());
+    // номера документов шарда в пакете
+    vector<vector<size_t>> shard_indexes(shards_.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const size_t shard = GetShardIndex(documents[i].id);
+        shard_documents[shard].push_back(documents[i]);
+        shard_indexes[shard].push_back(i);
+    }
+
+    vector<vector<AddDocumentError>> shard_errors(shards_.size());
+    ParallelFor(execution::par, shards_.size(),
+            [this, &shard_documents, &shard_errors](size_t shard) {
+                shard_errors[shard] = shards_[shard].AddDocuments(
+                        execution::seq, shard_documents[shard]);
+            });
+
+    vector<AddDocumentError> errors;
+    for (size_t shard = 0; shard < shards_.size(); ++shard) {
+        for (AddDocumentError &error : shard_errors[shard]) {
+            error.index = shard_indexes[shard][error.index];
+            errors.push_back(move(error));
+        }
+    }
+    sort(errors.begin(), errors.end(),
+            [](const AddDocumentError &lhs, const AddDocumentError &rhs) {
+                return lhs.index < rhs.index;
+            });
+    return errors;
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    shards_[GetShardIndex(document_id)].RemoveDocument(document_id);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query,
+        DocumentStatus status, size_t top_k, EvaluationMode mode) const {
+    return FindTopDocuments(execution::par, raw_query, status, top_k, mode);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query,
+        const DocumentFilter &filter, size_t top_k, EvaluationMode mode) const {
+    return FindTopDocuments(execution::par, raw_query, filter, top_k, mode);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(
+        string_view raw_query) const {
+    return FindTopDocuments(execution::par, raw_query);
+}
+
+SearchServer::MatchDocumentResult ShardedSearchServer::MatchDocument(
+        string_view raw_query, int document_id) const {
+    return shards_[GetShardIndex(document_id)].MatchDocument(raw_query,
+            document_id);
+}
+
+WordFrequencies ShardedSearchServer::GetWordFrequencies(
+        int document_id) const {
+    return shards_[GetShardIndex(document_id)].GetWordFrequencies(document_id);
+}
+
+size_t ShardedSearchServer::GetDocumentCount() const {
+    size_t document_count = 0;
+    for (const SearchServer &shard : shards_) {
+        document_count += shard.GetDocumentCount();
+    }
+    return document_count;
+}
+
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+    // отрицательные id тоже попадают в какой-то шард: AddDocument шарда
+    // сообщит об ошибке, RemoveDocument ничего не удалит
+    return static_cast<unsigned int>(document_id) % shards_.size();
+}
+
+/**
+ * @brief Разбирает запрос в каждом шарде и вычисляет IDF плюс-слов
+ *
+ *  IDF слова вычисляется по количеству документов во всех шардах
+ *  и количеству документов со словом во всех шардах так же, как в одном
+ *  SearchServer (InverseDocumentFreqTable::Compute).
+ *
+ * @param raw_query Поисковые слова
+ * @return Запросы шардов (по номеру шарда)
+ */
+vector<SearchServer::Query> ShardedSearchServer::ParseQuery(
+        string_view raw_query) const {
+    // разбор последовательный: при неверном запросе исключение бросается
+    // до параллельного поиска
+    vector<SearchServer::Query> queries;
+    queries.reserve(shards_.size());
+    for (const SearchServer &shard : shards_) {
+        queries.push_back(shard.ParseQuery(raw_query, false));
+    }
+
+    map<string_view, size_t> document_freqs;
+    for (size_t shard = 0; shard < shards_.size(); ++shard) {
+        const SearchServer &server = shards_[shard];
+        for (const TermId word : queries[shard].plus_words) {
+            document_freqs[server.dictionary_.GetTerm(word)] +=
+                    server.GetDocumentFreq(word);
+        }
+    }
+
+    const size_t document_count = GetDocumentCount();
+    for (size_t shard = 0; shard < shards_.size(); ++shard) {
+        const SearchServer &server = shards_[shard];
+        SearchServer::Query &query = queries[shard];
+        query.inverse_document_freqs.resize(query.plus_words.size());
+        for (size_t i = 0; i < query.plus_words.size(); ++i) {
+            query.inverse_document_freqs[i] =
+                    InverseDocumentFreqTable::Compute(document_count,
+                            document_freqs[server.dictionary_.GetTerm(
+                                    query.plus_words[i])]);
+        }
+    }
+    return queries;
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <execution>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "document.h"
+#include "query_executor.h"
+#include "search_metrics.h"
+#include "search_server.h"
+#include "top_documents.h"
+
+using namespace std;
+
+/**
+ * @brief Поисковый сервер, документы которого разделены между несколькими
+ *        независимыми поисковыми серверами (шардами)
+ *
+ *  Документ хранится в шарде с номером document_id % (количество шардов).
+ *  FindTopDocuments выполняется во всех шардах параллельно (в каждом шарде -
+ *  последовательно), лучшие документы шардов объединяются. IDF слов запроса
+ *  вычисляется по количеству документов со словом во всех шардах, поэтому
+ *  результаты совпадают с результатами одного SearchServer с теми же
+ *  документами. MatchDocument, RemoveDocument и GetWordFrequencies
+ *  обращаются только к шарду документа.
+ */
+class ShardedSearchServer {
+public:
+    template<typename StringContainer>
+    ShardedSearchServer(size_t shard_count, const StringContainer &stop_words);
+
+    ShardedSearchServer(size_t shard_count, string stop_words_text);
+    ShardedSearchServer(size_t shard_count, string_view stop_words_text);
+
+    void AddDocument(int document_id, string_view document,
+            DocumentStatus status, const vector<int> &ratings);
+
+    // добавляет пакет документов: документы каждого шарда добавляются
+    // его AddDocuments, шарды заполняются параллельно
+    vector<AddDocumentError> AddDocuments(
+            const vector<DocumentToAdd> &documents);
+
+    void RemoveDocument(int document_id);
+
+    // без policy шарды обрабатываются через execution::par, policy -
+    // execution::par или пул потоков QueryExecutor
+    vector<Document> FindTopDocuments(string_view raw_query) const;
+    template<typename ExecutionPolicy>
+    vector<Document> FindTopDocuments(const ExecutionPolicy &policy,
+            string_view raw_query) const;
+
+    vector<Document> FindTopDocuments(string_view raw_query,
+            DocumentStatus status, size_t top_k = MAX_RESULT_DOCUMENT_COUNT,
+            EvaluationMode mode = EvaluationMode::EXHAUSTIVE) const;
+    template<typename ExecutionPolicy>
+    vector<Document> FindTopDocuments(const ExecutionPolicy &policy,
+            string_view raw_query, DocumentStatus status, size_t top_k =
+                    MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
+
+    // фильтр проверяется по битовым картам каждого шарда
+    vector<Document> FindTopDocuments(string_view raw_query,
+            const DocumentFilter &filter, size_t top_k =
+                    MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
+    template<typename ExecutionPolicy>
+    vector<Document> FindTopDocuments(const ExecutionPolicy &policy,
+            string_view raw_query, const DocumentFilter &filter,
+            size_t top_k = MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
+
+    template<typename DocumentPredicate>
+    vector<Document> FindTopDocuments(string_view raw_query,
+            DocumentPredicate document_predicate, size_t top_k =
+                    MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
+    template<typename ExecutionPolicy, typename DocumentPredicate>
+    vector<Document> FindTopDocuments(const ExecutionPolicy &policy,
+            string_view raw_query, DocumentPredicate document_predicate,
+            size_t top_k = MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
+
+    SearchServer::MatchDocumentResult MatchDocument(string_view raw_query,
+            int document_id) const;
+
+    WordFrequencies GetWordFrequencies(int document_id) const;
+
+    size_t GetDocumentCount() const;
+
+    size_t GetShardCount() const {
+        return shards_.size();
+    }
+
+private:
+    vector<SearchServer> shards_;
+
+    size_t GetShardIndex(int document_id) const;
+
+    // разбирает запрос в каждом шарде и подставляет в запросы шардов IDF,
+    // вычисленные по количеству документов во всех шардах
+    vector<SearchServer::Query> ParseQuery(string_view raw_query) const;
+
+    // поиск во всех шардах; make_predicate(шард) - критерий поиска шарда
+    // по внутреннему номеру документа
+    template<typename ExecutionPolicy, typename MakePredicate>
+    vector<Document> FindInShards(const ExecutionPolicy &policy,
+            string_view raw_query, MakePredicate make_predicate, size_t top_k,
+            EvaluationMode mode) const;
+};
+
+// Шаблонные функции
+
+template<typename StringContainer>
+ShardedSearchServer::ShardedSearchServer(size_t shard_count,
+        const StringContainer &stop_words) {
+    if (shard_count == 0) {
+        throw invalid_argument("количество шардов должно быть больше нуля"s);
+    }
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.emplace_back(stop_words);
+    }
+}
+
+/**
+ * @brief Ищет top_k документов с наибольшей релевантностью во всех шардах
+ *
+ *  Каждый шард отбирает свои top_k документов, отборы шардов объединяются.
+ *
+ * @param raw_query      Поисковые слова (слова, которые ищем)
+ * @tparam make_predicate Критерий поиска шарда (функция от шарда)
+ * @param top_k          Максимальное количество документов в результате
+ * @param mode           Способ вычисления результатов
+ * @return Результат поиска (вектор структур(id документа, релевантность, рейтинг))
+ */
+template<typename ExecutionPolicy, typename MakePredicate>
+vector<Document> ShardedSearchServer::FindInShards(
+        const ExecutionPolicy &policy, string_view raw_query,
+        MakePredicate make_predicate, size_t top_k,
+        EvaluationMode mode) const {
+    SEARCH_METRICS_COUNT(QUERIES, 1);
+    const vector<SearchServer::Query> queries = ParseQuery(raw_query);
+
+    vector<TopDocuments> parts(shards_.size(), TopDocuments(top_k));
+    ParallelFor(policy, shards_.size(),
+            [this, &queries, &make_predicate, &parts, mode](size_t shard) {
+                const SearchServer &server = shards_[shard];
+                auto predicate = make_predicate(server);
+                server.FindDocumentsInRange(queries[shard], predicate, 0,
+                        server.documents_.GetOrdinalCount(), mode,
+                        parts[shard]);
+            });
+
+    SEARCH_METRICS_STAGE(TOP_K);
+    TopDocuments top_documents(top_k);
+    for (const TopDocuments &part : parts) {
+        top_documents.Merge(part);
+    }
+    return top_documents.Extract();
+}
+
+template<typename ExecutionPolicy, typename DocumentPredicate>
+vector<Document> ShardedSearchServer::FindTopDocuments(
+        const ExecutionPolicy &policy, string_view raw_query,
+        DocumentPredicate document_predicate, size_t top_k,
+        EvaluationMode mode) const {
+    return FindInShards(policy, raw_query,
+            [&document_predicate](const SearchServer &server) {
+                return server.MakeOrdinalPredicate(document_predicate);
+            }, top_k, mode);
+}
+
+template<typename DocumentPredicate>
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query,
+        DocumentPredicate document_predicate, size_t top_k,
+        EvaluationMode mode) const {
+    return FindTopDocuments(execution::par, raw_query, document_predicate,
+            top_k, mode);
+}
+
+template<typename ExecutionPolicy>
+vector<Document> ShardedSearchServer::FindTopDocuments(
+        const ExecutionPolicy &policy, string_view raw_query,
+        DocumentStatus status, size_t top_k, EvaluationMode mode) const {
+    return FindTopDocuments(policy, raw_query, DocumentFilter(status), top_k,
+            mode);
+}
+
+template<typename ExecutionPolicy>
+vector<Document> ShardedSearchServer::FindTopDocuments(
+        const ExecutionPolicy &policy, string_view raw_query,
+        const DocumentFilter &filter, size_t top_k,
+        EvaluationMode mode) const {
+    return FindInShards(policy, raw_query,
+            [&filter](const SearchServer &server) {
+                return server.MakeFilterPredicate(filter);
+            }, top_k, mode);
+}
+
+template<typename ExecutionPolicy>
+vector<Document> ShardedSearchServer::FindTopDocuments(
+        const ExecutionPolicy &policy, string_view raw_query) const {
+    return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
+}
@@ -0,0 +1,280 @@
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash_functions.h"
+#include "snapshot.h"
+
+using namespace std;
+
+namespace {
+
+constexpr char SNAPSHOT_MAGIC[8] = {'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P'};
+// версия формата (увеличивается при любом изменении раскладки данных)
+constexpr uint32_t SNAPSHOT_VERSION = 2;
+// записывается как есть: при другом порядке байтов не совпадёт
+constexpr uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+// выравнивание разделов (не меньше размера строки кеша)
+constexpr uint64_t SNAPSHOT_ALIGNMENT = 64;
+
+constexpr size_t SECTION_COUNT = static_cast<size_t>(SnapshotSection::COUNT);
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t section_count;
+    uint32_t reserved;
+    uint64_t file_size;
+    uint64_t checksum;  // FNV-1a данных разделов, затем таблицы разделов
+};
+
+uint64_t Align(uint64_t position) {
+    return (position + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT
+            * SNAPSHOT_ALIGNMENT;
+}
+
+// FNV-1a
+constexpr uint64_t CHECKSUM_SEED = FNV1A_BASIS;
+
+uint64_t UpdateChecksum(uint64_t checksum, const char *data, size_t size) {
+    return HashFnv1a(string_view(data, size), checksum);
+}
+
+// временный файл для записи снапшота path: в том же каталоге (rename
+// атомарен только в пределах файловой системы), имя уникально для процесса
+// и записи
+string MakeTempPath(const string &path) {
+    static atomic<uint64_t> last_number = 0;
+    return path + ".tmp."s + to_string(getpid()) + '.'
+            + to_string(last_number.fetch_add(1, memory_order_relaxed) + 1);
+}
+
+// сбрасывает данные файла на диск
+bool SyncFile(const string &path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    const bool is_synced = fsync(fd) == 0;
+    return close(fd) == 0 && is_synced;
+}
+
+// сбрасывает на диск каталог файла path (запись о переименовании)
+void SyncDirectory(const string &path) {
+    const size_t slash = path.rfind('/');
+    const string directory = slash == string::npos ? "."s :
+            slash == 0 ? "/"s : path.substr(0, slash);
+    const int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+// начало данных разделов
+constexpr uint64_t DATA_OFFSET = (sizeof(SnapshotHeader)
+        + SECTION_COUNT * sizeof(SnapshotSectionEntry)
+        + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+
+}  // namespace
+
+/**
+ * @brief Файл, отображённый в память только для чтения
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const string &path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw runtime_error("не удалось открыть файл снапшота "s + path);
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0) {
+            close(fd);
+            throw runtime_error("не удалось открыть файл снапшота "s + path);
+        }
+        size_ = static_cast<size_t>(file_stat.st_size);
+        if (size_ > 0) {
+            void *data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED) {
+                close(fd);
+                throw runtime_error(
+                        "не удалось отобразить в память файл снапшота "s + path);
+            }
+            data_ = static_cast<const char*>(data);
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (data_) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+    const char* data() const {
+        return data_;
+    }
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+SnapshotWriter::SnapshotWriter(const string &path) :
+        path_(path), temp_path_(MakeTempPath(path)), out_(temp_path_,
+                ios::binary | ios::trunc), sections_(SECTION_COUNT,
+                SnapshotSectionEntry { 0, 0, 0 }), checksum_(CHECKSUM_SEED) {
+    if (!out_) {
+        throw runtime_error("не удалось создать файл снапшота "s + path);
+    }
+    // место под заголовок и таблицу разделов
+    const string placeholder(DATA_OFFSET, '\0');
+    out_.write(placeholder.data(), placeholder.size());
+    position_ = DATA_OFFSET;
+}
+
+void SnapshotWriter::BeginSection(SnapshotSection section,
+        size_t element_size) {
+    const string padding(Align(position_) - position_, '\0');
+    WriteBytes(padding.data(), padding.size());
+    current_section_ = section;
+    sections_[static_cast<size_t>(section)] = {element_size, position_, 0};
+}
+
+void SnapshotWriter::EndSection() {
+    SnapshotSectionEntry &entry = sections_[static_cast<size_t>(current_section_)];
+    entry.size = position_ - entry.offset;
+    current_section_ = SnapshotSection::COUNT;
+}
+
+void SnapshotWriter::Finish() {
+    const char *table = reinterpret_cast<const char*>(sections_.data());
+    const size_t table_size = sections_.size() * sizeof(SnapshotSectionEntry);
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.section_count = static_cast<uint32_t>(SECTION_COUNT);
+    header.file_size = position_;
+    header.checksum = UpdateChecksum(checksum_, table, table_size);
+
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_.write(table, table_size);
+    out_.close();
+    if (!out_ || !SyncFile(temp_path_)) {
+        throw runtime_error("ошибка записи файла снапшота "s + path_);
+    }
+    if (rename(temp_path_.c_str(), path_.c_str()) != 0) {
+        throw runtime_error("не удалось заменить файл снапшота "s + path_);
+    }
+    is_finished_ = true;
+    SyncDirectory(path_);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    if (!is_finished_) {
+        out_.close();
+        remove(temp_path_.c_str());
+    }
+}
+
+void SnapshotWriter::WriteBytes(const char *data, size_t size) {
+    out_.write(data, size);
+    if (!out_) {
+        throw runtime_error("ошибка записи файла снапшота "s + path_);
+    }
+    checksum_ = UpdateChecksum(checksum_, data, size);
+    position_ += size;
+}
+
+/**
+ * @brief Открывает снапшот и проверяет его заголовок и таблицу разделов
+ *
+ * @param path  Путь к файлу снапшота
+ * @param check Нужно ли проверять контрольную сумму всех данных
+ */
+SnapshotReader::SnapshotReader(const string &path, SnapshotCheck check) :
+        file_(make_shared<MappedFile>(path)) {
+    const char *data = file_->data();
+    const size_t size = file_->size();
+    if (size < DATA_OFFSET) {
+        throw runtime_error("неверный формат файла снапшота "s + path);
+    }
+    SnapshotHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0
+            || header.byte_order != SNAPSHOT_BYTE_ORDER
+            || header.section_count != SECTION_COUNT) {
+        throw runtime_error("неверный формат файла снапшота "s + path);
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        throw runtime_error("неподдерживаемая версия файла снапшота "s + path);
+    }
+    if (header.file_size != size) {
+        throw runtime_error("файл снапшота повреждён (неверный размер) "s + path);
+    }
+
+    const auto *sections =
+            reinterpret_cast<const SnapshotSectionEntry*>(data
+                    + sizeof(SnapshotHeader));
+    for (size_t i = 0; i < SECTION_COUNT; ++i) {
+        const SnapshotSectionEntry &entry = sections[i];
+        if (entry.size == 0) {
+            continue;
+        }
+        if (entry.element_size == 0 || entry.size % entry.element_size != 0
+                || entry.offset % SNAPSHOT_ALIGNMENT != 0
+                || entry.offset < DATA_OFFSET || entry.offset > size
+                || entry.size > size - entry.offset) {
+            throw runtime_error(
+                    "файл снапшота повреждён (неверная таблица разделов) "s
+                            + path);
+        }
+    }
+
+    if (check == SnapshotCheck::FULL) {
+        uint64_t checksum = UpdateChecksum(CHECKSUM_SEED, data + DATA_OFFSET,
+                size - DATA_OFFSET);
+        checksum = UpdateChecksum(checksum,
+                reinterpret_cast<const char*>(sections),
+                SECTION_COUNT * sizeof(SnapshotSectionEntry));
+        if (checksum != header.checksum) {
+            throw runtime_error(
+                    "файл снапшота повреждён (неверная контрольная сумма) "s
+                            + path);
+        }
+    }
+}
+
+pair<const char*, size_t> SnapshotReader::GetSectionData(
+        SnapshotSection section, size_t element_size) const {
+    const auto *sections =
+            reinterpret_cast<const SnapshotSectionEntry*>(file_->data()
+                    + sizeof(SnapshotHeader));
+    const SnapshotSectionEntry &entry =
+            sections[static_cast<size_t>(section)];
+    if (entry.size == 0) {
+        return {nullptr, 0};
+    }
+    if (entry.element_size != element_size) {
+        throw runtime_error("неверный формат файла снапшота"s);
+    }
+    return {file_->data() + entry.offset, entry.size / element_size};
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cow_vector.h"
+
+using namespace std;
+
+/**
+ * @brief Разделы файла снапшота поискового сервера
+ *
+ *  Каждый раздел - плоский массив элементов одного типа. Ссылки между
+ *  разделами - индексы элементов, а не указатели, поэтому файл можно
+ *  отображать в память по любому адресу.
+ */
+enum class SnapshotSection : uint32_t {
+    STOP_WORD_ENDS,            // конец каждого стоп-слова в STOP_WORD_CHARS
+    STOP_WORD_CHARS,
+    TERM_ENDS,                 // конец каждого слова словаря в TERM_CHARS
+    TERM_CHARS,
+    TERM_SLOTS,                // хеш-таблица словаря
+    POSTING_LIST_HEADERS,      // описания списков документов слов
+    POSTING_BLOCKS,
+    POSTING_PACKED,
+    POSTING_TAIL_ORDINALS,
+    POSTING_TAIL_COUNTS,
+    DOCUMENT_IDS,
+    DOCUMENT_RATINGS,
+    DOCUMENT_STATUSES,
+    DOCUMENT_INVERSE_WORD_COUNTS,
+    DOCUMENT_ID_TO_ORDINAL,
+    DOCUMENT_WORD_ENDS,        // конец слов каждого документа в DOCUMENT_WORDS
+    DOCUMENT_WORDS,
+    DOCUMENT_WORD_COUNTS,
+    COUNT,
+};
+
+/**
+ * @brief Проверка снапшота при открытии
+ */
+enum class SnapshotCheck {
+    // проверяются только заголовок и границы разделов: открытие не читает
+    // данные, страницы файла подгружаются при первом обращении
+    HEADER,
+    // дополнительно проверяется контрольная сумма всех данных
+    FULL,
+};
+
+class MappedFile;
+
+// запись таблицы разделов файла снапшота
+struct SnapshotSectionEntry {
+    uint64_t element_size;
+    uint64_t offset;  // смещение от начала файла
+    uint64_t size;    // размер в байтах
+};
+
+/**
+ * @brief Запись файла снапшота
+ *
+ *  Формат файла:
+ *  - заголовок (сигнатура, версия, порядок байтов, размер файла,
+ *    контрольная сумма данных),
+ *  - таблица разделов (SnapshotSection::COUNT записей: размер элемента,
+ *    смещение и размер раздела),
+ *  - данные разделов, каждый раздел выровнен на SNAPSHOT_ALIGNMENT байт.
+ *  Разделы пишутся потоком, заголовок и таблица - в Finish.
+ *  Файл пишется во временный файл в том же каталоге, который Finish
+ *  сбрасывает на диск (fsync) и переименовывает в path. Прежний файл path
+ *  не изменяется до переименования: снапшот, отображённый в память этим
+ *  или другим процессом (в том числе сервером, который сохраняется),
+ *  остаётся целым, а при ошибке записи остаётся прежний снапшот.
+ *  Временный файл незавершённой записи удаляется деструктором.
+ */
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const string &path);
+    ~SnapshotWriter();
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    template<typename T>
+    void WriteSection(SnapshotSection section, const T *data, size_t count) {
+        BeginSection(section, sizeof(T));
+        Write(data, count);
+        EndSection();
+    }
+    template<typename T>
+    void WriteSection(SnapshotSection section, const CowVector<T> &values) {
+        WriteSection(section, values.data(), values.size());
+    }
+    template<typename T>
+    void WriteSection(SnapshotSection section, const vector<T> &values) {
+        WriteSection(section, values.data(), values.size());
+    }
+
+    // раздел, данные которого дописываются несколькими вызовами Write
+    void BeginSection(SnapshotSection section, size_t element_size);
+    template<typename T>
+    void Write(const T *data, size_t count) {
+        static_assert(is_trivially_copyable_v<T>);
+        WriteBytes(reinterpret_cast<const char*>(data), count * sizeof(T));
+    }
+    void EndSection();
+
+    // дописывает заголовок и таблицу разделов, закрывает файл
+    // и заменяет им файл path
+    void Finish();
+
+private:
+    string path_;
+    string temp_path_;
+    ofstream out_;
+    bool is_finished_ = false;
+    vector<SnapshotSectionEntry> sections_;
+    SnapshotSection current_section_ = SnapshotSection::COUNT;
+    uint64_t position_ = 0;
+    uint64_t checksum_;
+
+    void WriteBytes(const char *data, size_t size);
+};
+
+/**
+ * @brief Чтение файла снапшота, отображённого в память
+ *
+ *  Разделы возвращаются как CowVector, ссылающиеся на отображение: данные
+ *  не копируются. Отображение живёт, пока жив хотя бы один указатель из GetFile.
+ */
+class SnapshotReader {
+public:
+    SnapshotReader(const string &path, SnapshotCheck check);
+
+    template<typename T>
+    CowVector<T> GetSection(SnapshotSection section) const {
+        static_assert(is_trivially_copyable_v<T>);
+        const auto [data, size] = GetSectionData(section, sizeof(T));
+        return CowVector<T>::View(reinterpret_cast<const T*>(data), size);
+    }
+
+    shared_ptr<const MappedFile> GetFile() const {
+        return file_;
+    }
+
+private:
+    shared_ptr<const MappedFile> file_;
+
+    // начало данных раздела и количество элементов
+    pair<const char*, size_t> GetSectionData(SnapshotSection section,
+            size_t element_size) const;
+};
@@ -0,0 +1,31 @@
+#include "stop_words.h"
+
+using namespace std;
+
+/**
+ * @brief Строит набор стоп-слов
+ *
+ * @param words Стоп-слова (без повторов)
+ */
+StopWordSet::StopWordSet(const set<string, less<>> &words) {
+    vector<string_view> word_views;
+    word_views.reserve(words.size());
+    for (const string &word : words) {
+        AddWord(word);
+        word_views.push_back(word);
+    }
+    if (word_views.empty()) {
+        return;
+    }
+    slots_.resize(word_views.size());
+    displacements_.resize(stop_word_hash::GetBucketCount(word_views.size()));
+    vector<size_t> bucket_ends(displacements_.size() + 1);
+    vector<uint32_t> order(word_views.size());
+    seed_ = stop_word_hash::Build(word_views, slots_, displacements_,
+            bucket_ends, order);
+}
+
+void StopWordSet::AddWord(string_view word) {
+    chars_ += word;
+    word_ends_.push_back(static_cast<uint32_t>(chars_.size()));
+}
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "hash_functions.h"
+
+using namespace std;
+
+/**
+ * @brief Минимальная совершенная хеш-функция стоп-слов (hash and displace)
+ *
+ *  Слова делятся по хешу на корзины (в среднем два слова в корзине). Для каждой
+ *  корзины, начиная с самых больших, подбирается смещение d: слово с хешем h
+ *  попадает в ячейку MixBits(h + d * STEP) % (количество слов), ячейки слов
+ *  корзины должны быть свободны. В результате у каждого слова своя ячейка,
+ *  и проверка слова - один хеш слова, одно смещение корзины и одно сравнение
+ *  с единственным словом ячейки.
+ *  Построение написано как constexpr-шаблон над массивами (std::array или
+ *  vector), поэтому один и тот же код строит таблицу и при компиляции
+ *  (StaticStopWords), и при запуске (StopWordSet).
+ */
+namespace stop_word_hash {
+
+// номер слова в пустой ячейке
+constexpr uint32_t NO_WORD = numeric_limits<uint32_t>::max();
+// наибольшее количество слов в корзине (при большем - другое зерно хеша)
+constexpr size_t MAX_BUCKET_SIZE = 16;
+// наибольшее смещение корзины (при большем - другое зерно хеша)
+constexpr uint32_t MAX_DISPLACEMENT = 1u << 16;
+// количество зёрен хеша, которые пробуются при построении
+constexpr uint64_t MAX_SEED_COUNT = 64;
+constexpr uint64_t STEP = GOLDEN_RATIO_STEP;
+
+constexpr size_t GetBucketCount(size_t word_count) {
+    return word_count / 2 + 1;
+}
+
+// FNV-1a с зерном seed
+constexpr uint64_t Hash(string_view word, uint64_t seed) {
+    return HashFnv1a(word, FNV1A_BASIS ^ (seed * STEP));
+}
+
+constexpr size_t GetSlot(uint64_t hash, uint32_t displacement,
+        size_t slot_count) {
+    return MixBits(hash + displacement * STEP) % slot_count;
+}
+
+/**
+ * @brief Пробует построить таблицу с зерном хеша seed
+ *
+ * @param words         Слова (без повторов)
+ * @param seed          Зерно хеша
+ * @param slots         Номер слова по ячейке (размер - количество слов)
+ * @param displacements Смещения корзин (размер - GetBucketCount)
+ * @param bucket_ends   Рабочий массив размера GetBucketCount + 1
+ * @param order         Рабочий массив размера количества слов (номера слов,
+ *                      упорядоченные по корзинам)
+ * @return true, если таблица построена
+ */
+template<typename Words, typename Slots, typename Displacements,
+        typename Ends, typename Order>
+constexpr bool TryBuild(const Words &words, uint64_t seed, Slots &slots,
+        Displacements &displacements, Ends &bucket_ends, Order &order) {
+    const size_t word_count = slots.size();
+    const size_t bucket_count = displacements.size();
+    for (size_t i = 0; i < word_count; ++i) {
+        slots[i] = NO_WORD;
+    }
+    for (size_t i = 0; i <= bucket_count; ++i) {
+        bucket_ends[i] = 0;
+    }
+    for (size_t i = 0; i < bucket_count; ++i) {
+        displacements[i] = 0;
+    }
+
+    // сортировка подсчётом номеров слов по корзинам: слова корзины b -
+    // order[bucket_ends[b]] ... order[bucket_ends[b + 1] - 1]
+    size_t max_bucket_size = 0;
+    for (size_t i = 0; i < word_count; ++i) {
+        const size_t size =
+                ++bucket_ends[Hash(words[i], seed) % bucket_count + 1];
+        max_bucket_size = size > max_bucket_size ? size : max_bucket_size;
+    }
+    if (max_bucket_size > MAX_BUCKET_SIZE) {
+        return false;
+    }
+    for (size_t i = 0; i < bucket_count; ++i) {
+        bucket_ends[i + 1] += bucket_ends[i];
+    }
+    for (size_t i = 0; i < word_count; ++i) {
+        order[bucket_ends[Hash(words[i], seed) % bucket_count]++] =
+                static_cast<uint32_t>(i);
+    }
+    // теперь bucket_ends[b] - конец корзины b
+
+    for (size_t size = max_bucket_size; size > 0; --size) {
+        for (size_t bucket = 0; bucket < bucket_count; ++bucket) {
+            const size_t first = bucket == 0 ? 0 : bucket_ends[bucket - 1];
+            if (bucket_ends[bucket] - first != size) {
+                continue;
+            }
+            array<uint64_t, MAX_BUCKET_SIZE> hashes { };
+            for (size_t i = 0; i < size; ++i) {
+                hashes[i] = Hash(words[order[first + i]], seed);
+            }
+
+            bool is_placed = false;
+            for (uint32_t d = 0; d < MAX_DISPLACEMENT && !is_placed; ++d) {
+                array<size_t, MAX_BUCKET_SIZE> bucket_slots { };
+                is_placed = true;
+                for (size_t i = 0; i < size && is_placed; ++i) {
+                    bucket_slots[i] = GetSlot(hashes[i], d, word_count);
+                    if (slots[bucket_slots[i]] != NO_WORD) {
+                        is_placed = false;
+                    }
+                    for (size_t j = 0; j < i && is_placed; ++j) {
+                        if (bucket_slots[j] == bucket_slots[i]) {
+                            is_placed = false;
+                        }
+                    }
+                }
+                if (is_placed) {
+                    for (size_t i = 0; i < size; ++i) {
+                        slots[bucket_slots[i]] = order[first + i];
+                    }
+                    displacements[bucket] = d;
+                }
+            }
+            if (!is_placed) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Строит таблицу, перебирая зёрна хеша
+ *
+ * @return Зерно хеша, с которым таблица построена
+ */
+template<typename Words, typename Slots, typename Displacements,
+        typename Ends, typename Order>
+constexpr uint64_t Build(const Words &words, Slots &slots,
+        Displacements &displacements, Ends &bucket_ends, Order &order) {
+    for (uint64_t seed = 0; seed < MAX_SEED_COUNT; ++seed) {
+        if (TryBuild(words, seed, slots, displacements, bucket_ends, order)) {
+            return seed;
+        }
+    }
+    throw logic_error("не удалось построить хеш-функцию стоп-слов"s);
+}
+
+}  // namespace stop_word_hash
+
+/**
+ * @brief Набор стоп-слов, заданный при компиляции
+ *
+ *  Таблица совершенного хеширования строится constexpr-конструктором:
+ *      constexpr StaticStopWords<2> STOP_WORDS({ "and"sv, "with"sv });
+ *      SearchServer search_server(STOP_WORDS);
+ *  Пустые и повторяющиеся слова, а также слова с управляющими символами -
+ *  ошибка компиляции. Набор можно передать в конструктор SearchServer
+ *  (и ShardedSearchServer) как контейнер стоп-слов: таблица копируется без
+ *  повторного построения.
+ */
+template<size_t N>
+class StaticStopWords {
+public:
+    constexpr explicit StaticStopWords(const array<string_view, N> &words) :
+            words_(words) {
+        for (size_t i = 0; i < N; ++i) {
+            if (words_[i].empty()) {
+                throw invalid_argument("пустое стоп-слово !!!"s);
+            }
+            for (const char c : words_[i]) {
+                if (static_cast<unsigned char>(c) < ' ') {
+                    throw invalid_argument("недопустимые символы !!!"s);
+                }
+            }
+            for (size_t j = 0; j < i; ++j) {
+                if (words_[j] == words_[i]) {
+                    throw invalid_argument("повторяющееся стоп-слово !!!"s);
+                }
+            }
+        }
+        array<size_t, BUCKET_COUNT + 1> bucket_ends { };
+        array<uint32_t, N> order { };
+        seed_ = stop_word_hash::Build(words_, slots_, displacements_,
+                bucket_ends, order);
+    }
+
+    constexpr bool Contains(string_view word) const {
+        if constexpr (N == 0) {
+            return false;
+        } else {
+            const uint64_t hash = stop_word_hash::Hash(word, seed_);
+            const uint32_t index = slots_[stop_word_hash::GetSlot(hash,
+                    displacements_[hash % BUCKET_COUNT], N)];
+            return words_[index] == word;
+        }
+    }
+
+    constexpr size_t size() const {
+        return N;
+    }
+
+    constexpr auto begin() const {
+        return words_.begin();
+    }
+    constexpr auto end() const {
+        return words_.end();
+    }
+
+private:
+    static constexpr size_t BUCKET_COUNT = stop_word_hash::GetBucketCount(N);
+
+    array<string_view, N> words_;
+    array<uint32_t, N> slots_ { };
+    array<uint32_t, BUCKET_COUNT> displacements_ { };
+    uint64_t seed_ = 0;
+
+    friend class StopWordSet;
+};
+
+/**
+ * @brief Набор стоп-слов поискового сервера
+ *
+ *  Слова хранятся подряд в одной строке (в порядке возрастания или в порядке
+ *  StaticStopWords), проверка
+ *  слова - по минимальной совершенной хеш-функции (см. stop_word_hash), без
+ *  выделения памяти. Таблица строится при создании набора или копируется из
+ *  StaticStopWords.
+ */
+class StopWordSet {
+public:
+    StopWordSet() = default;
+    // words - слова без повторов
+    explicit StopWordSet(const set<string, less<>> &words);
+    template<size_t N>
+    explicit StopWordSet(const StaticStopWords<N> &words);
+
+    bool Contains(string_view word) const {
+        if (slots_.empty()) {
+            return false;
+        }
+        const uint64_t hash = stop_word_hash::Hash(word, seed_);
+        return GetWord(slots_[stop_word_hash::GetSlot(hash,
+                displacements_[hash % displacements_.size()], slots_.size())])
+                == word;
+    }
+
+    size_t size() const {
+        return word_ends_.size();
+    }
+    bool empty() const {
+        return word_ends_.empty();
+    }
+
+    // слово с номером index
+    string_view GetWord(size_t index) const {
+        const size_t begin = index == 0 ? 0 : word_ends_[index - 1];
+        return string_view(chars_).substr(begin, word_ends_[index] - begin);
+    }
+
+private:
+    string chars_;
+    vector<uint32_t> word_ends_;
+    vector<uint32_t> slots_;
+    vector<uint32_t> displacements_;
+    uint64_t seed_ = 0;
+
+    void AddWord(string_view word);
+};
+
+template<size_t N>
+StopWordSet::StopWordSet(const StaticStopWords<N> &words) :
+        slots_(words.slots_.begin(), words.slots_.end()),
+        displacements_(words.displacements_.begin(),
+                words.displacements_.end()), seed_(words.seed_) {
+    for (string_view word : words) {
+        AddWord(word);
+    }
+}
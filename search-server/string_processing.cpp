@@ -1,11 +1,166 @@
-#include <iostream>
+#include <algorithm>
+#include <cstdint>
 #include <string>
 #include <vector>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+// AVX2-вариант компилируется отдельно (атрибут target) и выбирается при
+// запуске, если процессор его поддерживает
+#if defined(__SSE2__) && defined(__GNUC__) \
+        && (defined(__x86_64__) || defined(__i386__))
+#define SPLIT_INTO_WORDS_AVX2
+#include <immintrin.h>
+#endif
+
 #include "string_processing.h"
 
 using namespace std;
 
+namespace {
+
+/**
+ * @brief Добавляет слова, которые заканчиваются пробелами блока текста
+ *
+ * @param spaces     Маска пробелов блока (бит i - символ first + i)
+ * @param first      Номер первого символа блока в тексте
+ * @param text       Текст
+ * @param word_start Номер первого символа текущего слова
+ * @param words      Слова
+ */
+inline void AddWordsBeforeSpaces(uint32_t spaces, size_t first,
+        string_view text, size_t &word_start, vector<string_view> &words) {
+    while (spaces != 0) {
+        const size_t space = first + __builtin_ctz(spaces);
+        if (space > word_start) {
+            words.push_back(text.substr(word_start, space - word_start));
+        }
+        word_start = space + 1;
+        spaces &= spaces - 1;
+    }
+}
+
+/**
+ * @brief Разбирает символы текста с номерами [first, text.size()) по одному
+ *
+ * @return false, если среди символов есть управляющие
+ */
+bool SplitTail(string_view text, size_t first, size_t word_start,
+        vector<string_view> &words) {
+    bool is_valid = true;
+    for (size_t i = first; i < text.size(); ++i) {
+        const unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c == ' ') {
+            if (i > word_start) {
+                words.push_back(text.substr(word_start, i - word_start));
+            }
+            word_start = i + 1;
+        } else if (c < ' ') {
+            is_valid = false;
+        }
+    }
+    if (text.size() > word_start) {
+        words.push_back(text.substr(word_start));
+    }
+    return is_valid;
+}
+
+// разбор по одному символу (компилируется всегда: с ним сравниваются
+// векторные варианты)
+bool SplitScalar(string_view text, vector<string_view> &words) {
+    return SplitTail(text, 0, 0, words);
+}
+
+#ifdef __SSE2__
+/**
+ * @brief Разбирает текст блоками по 16 символов (SSE2)
+ *
+ *  В каждом блоке одним сравнением находятся пробелы (маска пробелов),
+ *  другим - управляющие символы (беззнаковый min(c, 31) == c).
+ */
+bool SplitSse2(string_view text, vector<string_view> &words) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i max_control = _mm_set1_epi8(' ' - 1);
+    __m128i control = _mm_setzero_si128();
+    size_t word_start = 0;
+    size_t i = 0;
+    for (; i + sizeof(__m128i) <= text.size(); i += sizeof(__m128i)) {
+        const __m128i chunk = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(text.data() + i));
+        control = _mm_or_si128(control,
+                _mm_cmpeq_epi8(_mm_min_epu8(chunk, max_control), chunk));
+        AddWordsBeforeSpaces(
+                static_cast<uint32_t>(_mm_movemask_epi8(
+                        _mm_cmpeq_epi8(chunk, space))), i, text, word_start,
+                words);
+    }
+    const bool is_valid = _mm_movemask_epi8(control) == 0;
+    return SplitTail(text, i, word_start, words) && is_valid;
+}
+#endif
+
+#ifdef SPLIT_INTO_WORDS_AVX2
+// то же, что SplitSse2, блоками по 32 символа
+__attribute__((target("avx2")))
+bool SplitAvx2(string_view text, vector<string_view> &words) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i max_control = _mm256_set1_epi8(' ' - 1);
+    __m256i control = _mm256_setzero_si256();
+    size_t word_start = 0;
+    size_t i = 0;
+    for (; i + sizeof(__m256i) <= text.size(); i += sizeof(__m256i)) {
+        const __m256i chunk = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(text.data() + i));
+        control = _mm256_or_si256(control,
+                _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, max_control), chunk));
+        AddWordsBeforeSpaces(
+                static_cast<uint32_t>(_mm256_movemask_epi8(
+                        _mm256_cmpeq_epi8(chunk, space))), i, text, word_start,
+                words);
+    }
+    const bool is_valid = _mm256_movemask_epi8(control) == 0;
+    return SplitTail(text, i, word_start, words) && is_valid;
+}
+#endif
+
+using SplitFunction = bool (*)(string_view, vector<string_view>&);
+
+/**
+ * @brief Функция разбора варианта
+ *
+ * @param variant Вариант разбора
+ * @return Функция или nullptr, если вариант недоступен в этой сборке или
+ *         на этом процессоре
+ */
+SplitFunction GetSplitFunction(SplitVariant variant) {
+    switch (variant) {
+    case SplitVariant::SCALAR:
+        return SplitScalar;
+    case SplitVariant::SSE2:
+#ifdef __SSE2__
+        return SplitSse2;
+#else
+        return nullptr;
+#endif
+    case SplitVariant::AVX2:
+#ifdef SPLIT_INTO_WORDS_AVX2
+        if (__builtin_cpu_supports("avx2")) {
+            return SplitAvx2;
+        }
+#endif
+        return nullptr;
+    }
+    return nullptr;
+}
+
+// выбирает вариант разбора по возможностям процессора
+SplitFunction SelectSplitFunction() {
+    return GetSplitFunction(GetSplitVariants().back());
+}
+
+}  // namespace
+
 /**
  * @brief Разбирает строку на слова
  *
@@ -14,19 +169,42 @@ using namespace std;
  */
 vector<string_view> SplitIntoWords(string_view text) {
     vector<string_view> output;
-    size_t first = 0;
-
-    while (first < text.size()) {
-        const auto second = text.find_first_of(" ", first);
-
-        if (first != second)
-            output.emplace_back(text.substr(first, second - first));
+    SplitIntoWords(text, output);
+    return output;
+}
 
-        if (second == string_view::npos)
-            break;
+/**
+ * @brief Разбирает строку на слова и проверяет символы строки
+ *
+ * @param text  Строка
+ * @param words Вектор слов (заполняется)
+ * @return true, если в строке нет управляющих символов
+ */
+bool SplitIntoWords(string_view text, vector<string_view> &words) {
+    static const SplitFunction split_function = SelectSplitFunction();
+    words.clear();
+    return split_function(text, words);
+}
 
-        first = second + 1;
+vector<SplitVariant> GetSplitVariants() {
+    vector<SplitVariant> variants;
+    for (SplitVariant variant : {SplitVariant::SCALAR, SplitVariant::SSE2,
+            SplitVariant::AVX2}) {
+        if (GetSplitFunction(variant) != nullptr) {
+            variants.push_back(variant);
+        }
     }
+    return variants;
+}
 
-    return output;
+bool SplitIntoWords(SplitVariant variant, string_view text,
+        vector<string_view> &words) {
+    words.clear();
+    return GetSplitFunction(variant)(text, words);
+}
+
+bool IsValidText(string_view text) {
+    return none_of(text.begin(), text.end(), [](char c) {
+        return static_cast<unsigned char>(c) < ' ';
+    });
 }
@@ -6,3 +6,26 @@
 using namespace std;
 
 vector<string_view> SplitIntoWords(string_view text);
+
+// разбирает текст на слова (разделитель - пробел) за один проход и заодно
+// проверяет, что в тексте нет управляющих символов (коды 0-31). Слова
+// записываются в words (прежнее содержимое удаляется, память вектора
+// переиспользуется). Возвращает false, если управляющие символы есть
+// (слова при этом всё равно разобраны)
+bool SplitIntoWords(string_view text, vector<string_view> &words);
+
+// true, если в тексте нет управляющих символов (коды 0-31)
+bool IsValidText(string_view text);
+
+// варианты разбора SplitIntoWords (используется последний доступный)
+enum class SplitVariant {
+    SCALAR, SSE2, AVX2
+};
+
+// варианты, доступные в этой сборке на этом процессоре (по возрастанию);
+// нужны для проверки, что все варианты разбирают текст одинаково
+vector<SplitVariant> GetSplitVariants();
+
+// SplitIntoWords указанным вариантом (вариант должен быть доступен)
+bool SplitIntoWords(SplitVariant variant, string_view text,
+        vector<string_view> &words);
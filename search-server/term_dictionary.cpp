@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "hash_functions.h"
+#include "term_dictionary.h"
+
+using namespace std;
+
+TermDictionary::TermDictionary(const TermDictionary &other) {
+    *this = other;
+}
+
+/**
+ * @brief Копирование словаря
+ *
+ *  string_view другого словаря указывают в его блоки памяти, поэтому слова
+ *  заново добавляются в собственные блоки (идентификаторы сохраняются).
+ */
+TermDictionary& TermDictionary::operator=(const TermDictionary &other) {
+    if (this != &other) {
+        chunks_.clear();
+        chunk_used_ = chunk_capacity_ = 0;
+        terms_.clear();
+        terms_.reserve(other.terms_.size());
+        for (string_view word : other.terms_) {
+            terms_.push_back(Store(word));
+        }
+        slots_ = other.slots_;
+    }
+    return *this;
+}
+
+/**
+ * @brief Добавляет слово в словарь
+ *
+ * @param word Слово
+ * @return Идентификатор слова (новый или ранее выданный)
+ */
+TermId TermDictionary::Intern(string_view word) {
+    // держим заполненность хеш-таблицы не больше 1/2
+    if ((terms_.size() + 1) * 2 > slots_.size()) {
+        Rehash(max<size_t>(16, slots_.size() * 2));
+    }
+    const size_t mask = slots_.size() - 1;
+    for (size_t slot = Hash(word) & mask;; slot = (slot + 1) & mask) {
+        if (slots_[slot] == NO_TERM) {
+            const TermId term_id = static_cast<TermId>(terms_.size());
+            terms_.push_back(Store(word));
+            slots_.Modify()[slot] = term_id;
+            return term_id;
+        }
+        if (terms_[slots_[slot]] == word) {
+            return slots_[slot];
+        }
+    }
+}
+
+/**
+ * @brief Ищет слово в словаре
+ *
+ * @param word Слово
+ * @return Идентификатор слова или NO_TERM
+ */
+TermId TermDictionary::Find(string_view word) const {
+    if (slots_.empty()) {
+        return NO_TERM;
+    }
+    const size_t mask = slots_.size() - 1;
+    for (size_t slot = Hash(word) & mask;; slot = (slot + 1) & mask) {
+        if (slots_[slot] == NO_TERM || terms_[slots_[slot]] == word) {
+            return slots_[slot];
+        }
+    }
+}
+
+// FNV-1a (старшие биты подмешаны в младшие, по которым выбирается ячейка)
+uint64_t TermDictionary::Hash(string_view word) {
+    const uint64_t hash = HashFnv1a(word);
+    return hash ^ (hash >> 32);
+}
+
+/**
+ * @brief Копирует символы слова в блок памяти словаря
+ *
+ *  Слово целиком лежит в одном блоке. Если места в последнем блоке не хватает,
+ *  заводится новый блок (размером не меньше длины слова).
+ */
+string_view TermDictionary::Store(string_view word) {
+    if (chunk_capacity_ - chunk_used_ < word.size()) {
+        chunk_capacity_ = max(ARENA_CHUNK_SIZE, word.size());
+        chunks_.push_back(make_unique<char[]>(chunk_capacity_));
+        chunk_used_ = 0;
+    }
+    if (word.empty()) {
+        return {};
+    }
+    char *data = chunks_.back().get() + chunk_used_;
+    memcpy(data, word.data(), word.size());
+    chunk_used_ += word.size();
+    return {data, word.size()};
+}
+
+void TermDictionary::Rehash(size_t slot_count) {
+    vector<TermId> slots(slot_count, NO_TERM);
+    const size_t mask = slot_count - 1;
+    for (TermId term_id = 0; term_id < terms_.size(); ++term_id) {
+        size_t slot = Hash(terms_[term_id]) & mask;
+        while (slots[slot] != NO_TERM) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = term_id;
+    }
+    slots_ = move(slots);
+}
+
+/**
+ * @brief Записывает словарь в снапшот
+ *
+ *  Слова записываются подряд (с концами слов), хеш-таблица - как есть.
+ */
+void TermDictionary::SaveSnapshot(SnapshotWriter &writer) const {
+    vector<uint64_t> term_ends;
+    term_ends.reserve(terms_.size());
+    uint64_t end = 0;
+    for (string_view word : terms_) {
+        end += word.size();
+        term_ends.push_back(end);
+    }
+    writer.WriteSection(SnapshotSection::TERM_ENDS, term_ends);
+    writer.BeginSection(SnapshotSection::TERM_CHARS, sizeof(char));
+    for (string_view word : terms_) {
+        writer.Write(word.data(), word.size());
+    }
+    writer.EndSection();
+    writer.WriteSection(SnapshotSection::TERM_SLOTS, slots_);
+}
+
+/**
+ * @brief Открывает словарь из снапшота
+ *
+ *  Строится только массив string_view на слова в отображённом файле.
+ */
+TermDictionary TermDictionary::OpenSnapshot(const SnapshotReader &reader) {
+    const CowVector<uint64_t> term_ends = reader.GetSection<uint64_t>(
+            SnapshotSection::TERM_ENDS);
+    const CowVector<char> chars = reader.GetSection<char>(
+            SnapshotSection::TERM_CHARS);
+    TermDictionary dictionary;
+    dictionary.slots_ = reader.GetSection<TermId>(SnapshotSection::TERM_SLOTS);
+    const size_t slot_count = dictionary.slots_.size();
+    if ((slot_count & (slot_count - 1)) != 0
+            || term_ends.size() * 2 > slot_count
+            || (!term_ends.empty() && term_ends.back() != chars.size())) {
+        throw runtime_error("неверный формат словаря в снапшоте"s);
+    }
+    dictionary.terms_.reserve(term_ends.size());
+    uint64_t begin = 0;
+    for (const uint64_t end : term_ends) {
+        if (end < begin) {
+            throw runtime_error("неверный формат словаря в снапшоте"s);
+        }
+        dictionary.terms_.emplace_back(chars.data() + begin, end - begin);
+        begin = end;
+    }
+    return dictionary;
+}
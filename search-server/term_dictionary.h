@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cow_vector.h"
+#include "snapshot.h"
+
+using namespace std;
+
+// плотный идентификатор слова в словаре поискового сервера
+using TermId = uint32_t;
+
+/**
+ * @brief Словарь слов (терминов) поискового сервера
+ *
+ *  Каждое уникальное слово хранится один раз в непрерывных блоках памяти
+ *  (блоки не перевыделяются, поэтому string_view на слова остаются валидными
+ *  всё время жизни словаря) и получает плотный идентификатор TermId (0, 1, 2, ...).
+ *  Поиск слова - хеш-таблица с открытой адресацией, в которой хранятся
+ *  только идентификаторы слов, а сравнение идёт по string_view.
+ *  Словарь, открытый из снапшота, ссылается на символы слов и хеш-таблицу
+ *  в отображённом файле.
+ */
+class TermDictionary {
+public:
+    // идентификатор отсутствующего в словаре слова
+    static constexpr TermId NO_TERM = numeric_limits<TermId>::max();
+
+    TermDictionary() = default;
+    TermDictionary(const TermDictionary &other);
+    TermDictionary& operator=(const TermDictionary &other);
+    TermDictionary(TermDictionary&&) = default;
+    TermDictionary& operator=(TermDictionary&&) = default;
+
+    // добавляет слово в словарь (если его ещё нет) и возвращает его идентификатор
+    TermId Intern(string_view word);
+
+    // возвращает идентификатор слова или NO_TERM, если слова нет в словаре
+    TermId Find(string_view word) const;
+
+    // возвращает слово по идентификатору
+    string_view GetTerm(TermId term_id) const {
+        return terms_[term_id];
+    }
+
+    size_t size() const {
+        return terms_.size();
+    }
+
+    // записывает словарь в снапшот
+    void SaveSnapshot(SnapshotWriter &writer) const;
+    // открывает словарь из снапшота (без копирования слов)
+    static TermDictionary OpenSnapshot(const SnapshotReader &reader);
+
+private:
+    // размер блока памяти, в котором хранятся символы слов
+    static constexpr size_t ARENA_CHUNK_SIZE = 64 * 1024;
+
+    vector<unique_ptr<char[]>> chunks_;  // блоки с символами слов
+    size_t chunk_used_ = 0;              // занято символов в последнем блоке
+    size_t chunk_capacity_ = 0;          // размер последнего блока
+
+    vector<string_view> terms_;          // слово по идентификатору
+    CowVector<TermId> slots_;            // хеш-таблица (NO_TERM - пустая ячейка)
+
+    static uint64_t Hash(string_view word);
+
+    string_view Store(string_view word);
+    void Rehash(size_t slot_count);
+};
@@ -1,11 +1,39 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <ctime>
 #include <execution>
+#include <filesystem>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <optional>
 #include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
 
+#include "concurrent_map.h"
+#include "process_queries.h"
+#include "query_executor.h"
+#include "query_result_cache.h"
+#include "remove_duplicates.h"
+#include "request_queue.h"
+#include "request_statistics.h"
+#include "search_metrics.h"
 #include "search_server.h"
+#include "stop_words.h"
+#include "sharded_search_server.h"
+#include "string_processing.h"
+#include "versioned_search_server.h"
 #include "log_duration.h"
+#include "test_example_functions.h"
 
 using namespace std;
 
@@ -55,28 +83,2055 @@ vector<string> GenerateQueries(mt19937 &generator,
 }
 template<typename ExecutionPolicy>
 void Test(string mark, const SearchServer &search_server,
-        const vector<string> &queries, ExecutionPolicy &&policy) {
+        const vector<string> &queries, ExecutionPolicy &&policy,
+        EvaluationMode mode = EvaluationMode::EXHAUSTIVE) {
     LOG_DURATION(mark);
     double total_relevance = 0;
     for (const string_view query : queries) {
         for (const auto &document : search_server.FindTopDocuments(policy,
-                query)) {
+                query, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT,
+                mode)) {
             total_relevance += document.relevance;
         }
     }
     cout << total_relevance << endl;
 }
+// стоп-слова с таблицей хеширования, построенной при компиляции
+constexpr StaticStopWords<3> STATIC_STOP_WORDS( { "and"sv, "with"sv, "in"sv });
+static_assert(STATIC_STOP_WORDS.Contains("with"sv));
+static_assert(!STATIC_STOP_WORDS.Contains("within"sv));
+
+// количество запросов, которые читатели выполнили за время duration
+// (или пока is_running не станет false)
+size_t CountQueries(const VersionedSearchServer &server,
+        const vector<string> &queries, size_t reader_count,
+        chrono::steady_clock::duration duration,
+        const atomic<bool> &is_running) {
+    const auto deadline = chrono::steady_clock::now() + duration;
+    atomic<size_t> query_count = 0;
+    vector<thread> readers;
+    for (size_t i = 0; i < reader_count; ++i) {
+        readers.emplace_back([&, i] {
+            for (size_t j = i; is_running
+                    && chrono::steady_clock::now() < deadline; ++j) {
+                server.FindTopDocuments(queries[j % queries.size()]);
+                ++query_count;
+            }
+        });
+    }
+    for (thread &reader : readers) {
+        reader.join();
+    }
+    return query_count;
+}
+// поиск в VersionedSearchServer во время добавления документов и без него
+void TestConcurrentIngestion(const vector<DocumentToAdd> &batch,
+        const string &stop_words, const vector<string> &queries) {
+    const size_t reader_count = max(2u, thread::hardware_concurrency());
+    const size_t part_size = 500;
+    VersionedSearchServer server(stop_words);
+    server.AddDocuments( { batch.begin(), batch.begin() + batch.size() / 2 });
+
+    atomic<bool> is_ingesting = true;
+    const auto start = chrono::steady_clock::now();
+    thread writer([&] {
+        for (size_t i = batch.size() / 2; i < batch.size(); i += part_size) {
+            server.AddDocuments( { batch.begin() + i, batch.begin()
+                    + min(i + part_size, batch.size()) });
+        }
+        is_ingesting = false;
+    });
+    const size_t ingestion_queries = CountQueries(server, queries,
+            reader_count, chrono::hours(1), is_ingesting);
+    writer.join();
+    const auto duration = chrono::steady_clock::now() - start;
+    const atomic<bool> is_running = true;
+    const size_t steady_queries = CountQueries(server, queries, reader_count,
+            duration, is_running);
+
+    const auto milliseconds = max<int64_t>(1,
+            chrono::duration_cast<chrono::milliseconds>(duration).count());
+    const VersionedSearchServer::Stats stats = server.GetStats();
+    cerr << "versioned ingestion: "s << milliseconds << " ms, queries/s: "s
+            << ingestion_queries * 1000 / milliseconds
+            << " (without ingestion: "s
+            << steady_queries * 1000 / milliseconds << "), versions: "s
+            << stats.versions << ", copies: "s << stats.copies << endl;
+    cout << "documents after ingestion: "s << server.GetDocumentCount()
+            << endl;
+}
+
+void AssertImpl(bool value, const string &expr_str, const string &file,
+        const string &func, unsigned line, const string &hint) {
+    if (!value) {
+        cerr << file << "("s << line << "): "s << func << ": "s;
+        cerr << "ASSERT("s << expr_str << ") failed."s;
+        if (!hint.empty()) {
+            cerr << " Hint: "s << hint;
+        }
+        cerr << endl;
+        abort();
+    }
+}
+
+// документы с id в произвольном порядке (в том числе удалённые и добавленные
+// заново): поиск документа по id, обход id по возрастанию, снапшот
+void TestDocumentIdsInRandomOrder() {
+    mt19937 generator(3);
+    vector<int> ids(5000);
+    for (int &id : ids) {
+        id = uniform_int_distribution(0, numeric_limits<int>::max())(generator);
+    }
+    sort(ids.begin(), ids.end());
+    ids.erase(unique(ids.begin(), ids.end()), ids.end());
+    shuffle(ids.begin(), ids.end(), generator);
+
+    SearchServer server("and"s);
+    for (const int id : ids) {
+        server.AddDocument(id, "cat and dog"sv, DocumentStatus::ACTUAL, { 1 });
+    }
+    vector<int> removed_ids;
+    for (size_t i = 0; i < ids.size(); i += 3) {
+        removed_ids.push_back(ids[i]);
+    }
+    server.RemoveDocuments(removed_ids);
+    vector<DocumentToAdd> batch;
+    for (size_t i = 0; i < removed_ids.size(); i += 2) {
+        batch.push_back( { removed_ids[i], "cat"sv, DocumentStatus::ACTUAL,
+                { 1 } });
+    }
+    batch.push_back( { ids[1], "dog"sv, DocumentStatus::ACTUAL, { 1 } });
+    const vector<AddDocumentError> errors = server.AddDocuments(batch);
+    ASSERT_EQUAL(errors.size(), 1u);
+    ASSERT_EQUAL(errors[0].document_id, ids[1]);
+
+    set<int> expected(ids.begin(), ids.end());
+    for (size_t i = 1; i < removed_ids.size(); i += 2) {
+        expected.erase(removed_ids[i]);
+    }
+    ASSERT_EQUAL(vector<int>(server.begin(), server.end()),
+            vector<int>(expected.begin(), expected.end()));
+    ASSERT_EQUAL(server.GetDocumentCount(), expected.size());
+    ASSERT_EQUAL(get<0>(server.MatchDocument("dog"sv, removed_ids[0])).size(),
+            0u);
+    ASSERT_EQUAL(get<0>(server.MatchDocument("cat"sv, removed_ids[0])).size(),
+            1u);
+    ASSERT_EQUAL(get<0>(server.MatchDocument("cat"sv, removed_ids[1])).size(),
+            0u);
+    ASSERT_EQUAL(get<0>(server.MatchDocument("dog"sv, ids[1])).size(), 1u);
+
+    const string path = (filesystem::temp_directory_path()
+            / "search_server_test_ids.snapshot"s).string();
+    server.SaveSnapshot(path);
+    {
+        const SearchServer opened = SearchServer::OpenSnapshot(path);
+        ASSERT_EQUAL(vector<int>(opened.begin(), opened.end()),
+                vector<int>(expected.begin(), expected.end()));
+        ASSERT_EQUAL(get<0>(opened.MatchDocument("cat"sv, ids[2])).size(), 1u);
+    }
+    filesystem::remove(path);
+}
+
+// документ тестового набора
+struct TestDocument {
+    int id;
+    string text;
+    DocumentStatus status;
+    int rating;
+};
+
+// случайный набор документов из слов dictionary (статусы и рейтинги
+// случайные, id - по возрастанию с пропусками)
+vector<TestDocument> GenerateTestDocuments(mt19937 &generator,
+        const vector<string> &dictionary, int document_count,
+        int max_word_count) {
+    vector<TestDocument> documents;
+    int id = 0;
+    for (int i = 0; i < document_count; ++i) {
+        id += uniform_int_distribution(1, 3)(generator);
+        documents.push_back( { id, GenerateQuery(generator, dictionary,
+                uniform_int_distribution(1, max_word_count)(generator)),
+                static_cast<DocumentStatus>(uniform_int_distribution(0, 3)(
+                        generator)), uniform_int_distribution(-5, 5)(
+                        generator) });
+    }
+    return documents;
+}
+
+void AddTestDocuments(SearchServer &server,
+        const vector<TestDocument> &documents) {
+    for (const TestDocument &document : documents) {
+        server.AddDocument(document.id, document.text, document.status,
+                { document.rating });
+    }
+}
+
+// поиск перебором всех документов по определению TF-IDF
+// (document_predicate(id документа, статус, рейтинг))
+template<typename DocumentPredicate>
+vector<Document> FindTopDocumentsNaive(const vector<TestDocument> &documents,
+        const set<string, less<>> &stop_words, string_view raw_query,
+        DocumentPredicate document_predicate,
+        size_t top_k = MAX_RESULT_DOCUMENT_COUNT) {
+    set<string_view> plus_words;
+    set<string_view> minus_words;
+    for (string_view word : SplitIntoWords(raw_query)) {
+        const bool is_minus = word[0] == '-';
+        if (is_minus) {
+            word.remove_prefix(1);
+        }
+        if (stop_words.count(word) == 0) {
+            (is_minus ? minus_words : plus_words).insert(word);
+        }
+    }
+    vector<map<string_view, int>> word_counts(documents.size());
+    vector<int> document_word_counts(documents.size());
+    map<string_view, int> document_freqs;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        for (const string_view word : SplitIntoWords(documents[i].text)) {
+            if (stop_words.count(word) == 0) {
+                if (word_counts[i][word]++ == 0) {
+                    ++document_freqs[word];
+                }
+                ++document_word_counts[i];
+            }
+        }
+    }
+    vector<Document> found;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const TestDocument &document = documents[i];
+        if (!document_predicate(document.id, document.status,
+                document.rating)) {
+            continue;
+        }
+        bool has_minus_word = false;
+        for (const string_view word : minus_words) {
+            has_minus_word = has_minus_word || word_counts[i].count(word) > 0;
+        }
+        if (has_minus_word) {
+            continue;
+        }
+        bool has_plus_word = false;
+        double relevance = 0;
+        for (const string_view word : plus_words) {
+            const auto it = word_counts[i].find(word);
+            if (it != word_counts[i].end()) {
+                has_plus_word = true;
+                relevance += it->second * (1.0 / document_word_counts[i])
+                        * log(documents.size() * 1.0 / document_freqs[word]);
+            }
+        }
+        if (has_plus_word) {
+            found.push_back( { document.id, relevance, document.rating });
+        }
+    }
+    sort(found.begin(), found.end(), TopDocuments::IsBetter);
+    if (found.size() > top_k) {
+        found.resize(top_k);
+    }
+    return found;
+}
+
+vector<Document> FindTopDocumentsNaive(const vector<TestDocument> &documents,
+        const set<string, less<>> &stop_words, string_view raw_query,
+        DocumentStatus status, size_t top_k = MAX_RESULT_DOCUMENT_COUNT) {
+    return FindTopDocumentsNaive(documents, stop_words, raw_query,
+            [status](int, DocumentStatus document_status, int) {
+                return document_status == status;
+            }, top_k);
+}
+
+// отбор top_k документов в куче совпадает с полной сортировкой
+void TestTopDocumentsMatchFullSort() {
+    mt19937 generator(4);
+    const vector<string> dictionary = GenerateDictionary(generator, 40, 3);
+    const set<string, less<>> stop_words = { dictionary[0], dictionary[1] };
+    const vector<TestDocument> documents = GenerateTestDocuments(generator,
+            dictionary, 300, 12);
+    SearchServer server(stop_words);
+    AddTestDocuments(server, documents);
+    for (int i = 0; i < 50; ++i) {
+        const string query = GenerateQuery(generator, dictionary, 4, 0.2);
+        for (const size_t top_k : { 0u, 1u, 5u, 20u, 1000u }) {
+            for (const DocumentStatus status : { DocumentStatus::ACTUAL,
+                    DocumentStatus::BANNED }) {
+                ASSERT_EQUAL_HINT(server.FindTopDocuments(query, status, top_k),
+                        FindTopDocumentsNaive(documents, stop_words, query,
+                                status, top_k), query);
+            }
+        }
+    }
+}
+
+// накопители релевантности потоков переиспользуются запросами к серверам
+// разного размера, параллельный поиск делит документы между накопителями
+void TestScoreAccumulatorReuse() {
+    mt19937 generator(5);
+    const vector<string> dictionary = GenerateDictionary(generator, 60, 3);
+    const set<string, less<>> stop_words = { dictionary[0] };
+    const vector<TestDocument> large_documents = GenerateTestDocuments(
+            generator, dictionary, 5000, 10);
+    const vector<TestDocument> small_documents = GenerateTestDocuments(
+            generator, dictionary, 50, 10);
+    SearchServer large_server(stop_words);
+    AddTestDocuments(large_server, large_documents);
+    SearchServer small_server(stop_words);
+    AddTestDocuments(small_server, small_documents);
+    const QueryExecutor executor(3);
+    for (int i = 0; i < 30; ++i) {
+        const string query = GenerateQuery(generator, dictionary, 3, 0.2);
+        const vector<Document> large_expected = FindTopDocumentsNaive(
+                large_documents, stop_words, query, DocumentStatus::ACTUAL);
+        const vector<Document> small_expected = FindTopDocumentsNaive(
+                small_documents, stop_words, query, DocumentStatus::ACTUAL);
+        ASSERT_EQUAL(large_server.FindTopDocuments(query), large_expected);
+        ASSERT_EQUAL(small_server.FindTopDocuments(query), small_expected);
+        ASSERT_EQUAL(large_server.FindTopDocuments(execution::par, query),
+                large_expected);
+        ASSERT_EQUAL(small_server.FindTopDocuments(execution::par, query),
+                small_expected);
+        ASSERT_EQUAL(large_server.FindTopDocuments(executor, query),
+                large_expected);
+    }
+}
+
+// поиск с отсечением возвращает те же документы, что и полный поиск
+// (списки документов слов - из нескольких блоков, частые и редкие слова)
+void TestPrunedMatchesExhaustive() {
+    mt19937 generator(6);
+    vector<string> dictionary = GenerateDictionary(generator, 200, 5);
+    // частые слова встречаются в тексте документов многократно
+    vector<string> skewed_dictionary = dictionary;
+    for (int i = 0; i < 10; ++i) {
+        skewed_dictionary.insert(skewed_dictionary.end(), dictionary.begin(),
+                dictionary.begin() + 5);
+    }
+    const set<string, less<>> stop_words = { dictionary[0] };
+    vector<TestDocument> documents = GenerateTestDocuments(generator,
+            skewed_dictionary, 3000, 30);
+    SearchServer server(stop_words);
+    AddTestDocuments(server, documents);
+    vector<int> removed_ids;
+    for (size_t i = 0; i < documents.size(); i += 7) {
+        removed_ids.push_back(documents[i].id);
+    }
+    server.SetCompactionThreshold(1.0);
+    server.RemoveDocuments(removed_ids);
+    documents.erase(remove_if(documents.begin(), documents.end(),
+            [&removed_ids](const TestDocument &document) {
+                return binary_search(removed_ids.begin(), removed_ids.end(),
+                        document.id);
+            }), documents.end());
+
+    const auto is_even = [](int document_id, DocumentStatus, int) {
+        return document_id % 2 == 0;
+    };
+    for (int i = 0; i < 60; ++i) {
+        const string query = GenerateQuery(generator, skewed_dictionary,
+                uniform_int_distribution(1, 8)(generator), 0.1);
+        for (const size_t top_k : { 1u, 5u, 50u }) {
+            const vector<Document> expected = server.FindTopDocuments(query,
+                    DocumentStatus::ACTUAL, top_k, EvaluationMode::EXHAUSTIVE);
+            ASSERT_EQUAL_HINT(expected, FindTopDocumentsNaive(documents,
+                    stop_words, query, DocumentStatus::ACTUAL, top_k), query);
+            ASSERT_EQUAL_HINT(server.FindTopDocuments(query,
+                    DocumentStatus::ACTUAL, top_k, EvaluationMode::PRUNED),
+                    expected, query);
+            ASSERT_EQUAL_HINT(server.FindTopDocuments(execution::par, query,
+                    DocumentStatus::ACTUAL, top_k, EvaluationMode::PRUNED),
+                    expected, query);
+            ASSERT_EQUAL_HINT(server.FindTopDocuments(query, is_even, top_k,
+                    EvaluationMode::PRUNED), server.FindTopDocuments(query,
+                    is_even, top_k, EvaluationMode::EXHAUSTIVE), query);
+        }
+    }
+
+    // документы из 4 разных слов словаря из 6 слов: у многих документов
+    // релевантность равна релевантности худшего отобранного, и порядок
+    // решают рейтинг и id
+    const vector<string> small_dictionary(dictionary.begin() + 1,
+            dictionary.begin() + 7);
+    SearchServer tie_server(stop_words);
+    for (int id = 0; id < 2000; ++id) {
+        vector<string> words = small_dictionary;
+        shuffle(words.begin(), words.end(), generator);
+        tie_server.AddDocument(id, words[0] + ' ' + words[1] + ' ' + words[2]
+                + ' ' + words[3], DocumentStatus::ACTUAL,
+                { uniform_int_distribution(0, 3)(generator) });
+    }
+    for (int i = 0; i < 100; ++i) {
+        const string query = GenerateQuery(generator, small_dictionary,
+                uniform_int_distribution(1, 5)(generator), 0.2);
+        for (const size_t top_k : { 1u, 7u, 100u }) {
+            ASSERT_EQUAL_HINT(tie_server.FindTopDocuments(query,
+                    DocumentStatus::ACTUAL, top_k, EvaluationMode::PRUNED),
+                    tie_server.FindTopDocuments(query, DocumentStatus::ACTUAL,
+                            top_k, EvaluationMode::EXHAUSTIVE), query);
+        }
+    }
+}
+
+// курсор списка документов с неполным последним блоком: Next, Advance
+// и GetBlockMaxTermFreq с номерами документов внутри неполного блока и за
+// концом списка (в том числе после того, как курсор закончился)
+void TestPostingListCursor() {
+    using Cursor = PostingList::Cursor;
+    constexpr size_t BLOCK_SIZE = PostingList::POSTING_BLOCK_SIZE;
+    for (const size_t size : { size_t(5), BLOCK_SIZE, 2 * BLOCK_SIZE + 5 }) {
+        PostingList postings;
+        vector<DocumentOrdinal> ordinals;
+        vector<uint32_t> counts;
+        for (size_t i = 0; i < size; ++i) {
+            ordinals.push_back(static_cast<DocumentOrdinal>(3 * i + 1));
+            counts.push_back(static_cast<uint32_t>(i % 7 + 1));
+            postings.Append(ordinals.back(), counts.back(),
+                    counts.back() / 10.0);
+        }
+        const string hint = "size "s + to_string(size);
+
+        Cursor cursor(postings, 0, Cursor::END);
+        for (size_t i = 0; i < size; ++i) {
+            ASSERT_EQUAL_HINT(cursor.GetOrdinal(), ordinals[i], hint);
+            ASSERT_EQUAL_HINT(cursor.GetTermCount(), counts[i], hint);
+            cursor.Next();
+        }
+        ASSERT_EQUAL_HINT(cursor.GetOrdinal(), Cursor::END, hint);
+
+        // диапазон [first, last) - весь список или до середины последнего
+        // блока
+        for (const DocumentOrdinal last : { Cursor::END,
+                ordinals.back() - 6 }) {
+            for (const DocumentOrdinal step : { 1u, 2u, 50u, 200u, 1000u }) {
+                Cursor advancing(postings, 1, last);
+                for (DocumentOrdinal target = 1;
+                        target <= ordinals.back() + 2 * step; target += step) {
+                    const size_t index = lower_bound(ordinals.begin(),
+                            ordinals.end(), target) - ordinals.begin();
+                    const bool is_found = index < size
+                            && ordinals[index] < last;
+                    // максимальный TF блока записи index
+                    double block_max = 0.0;
+                    const size_t block_begin = index / BLOCK_SIZE * BLOCK_SIZE;
+                    if (index < size && ordinals[block_begin] < last) {
+                        for (size_t i = block_begin; i < min(size, block_begin
+                                + BLOCK_SIZE); ++i) {
+                            block_max = max(block_max, counts[i] / 10.0);
+                        }
+                    }
+                    ASSERT_EQUAL_HINT(advancing.GetBlockMaxTermFreq(target),
+                            block_max, hint);
+                    advancing.Advance(target);
+                    ASSERT_EQUAL_HINT(advancing.GetOrdinal(), is_found ?
+                            ordinals[index] : Cursor::END, hint);
+                    if (is_found) {
+                        ASSERT_EQUAL_HINT(advancing.GetTermCount(),
+                                counts[index], hint);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// все варианты SplitIntoWords (скалярный, SSE2, AVX2) разбирают текст так
+// же, как посимвольный разбор, в том числе когда пробелы и управляющие
+// символы попадают на границы блоков по 16 и 32 символа
+void TestSplitIntoWordsVariants() {
+    const auto split_naive = [](string_view text) {
+        vector<string_view> words;
+        size_t word_start = 0;
+        for (size_t i = 0; i <= text.size(); ++i) {
+            if (i == text.size() || text[i] == ' ') {
+                if (i > word_start) {
+                    words.push_back(text.substr(word_start, i - word_start));
+                }
+                word_start = i + 1;
+            }
+        }
+        return words;
+    };
+    const vector<SplitVariant> variants = GetSplitVariants();
+    ASSERT(!variants.empty() && variants.front() == SplitVariant::SCALAR);
+
+    // один особый символ в каждой позиции текстов длиной до 3 блоков AVX2
+    // ('\x1f' - последний управляющий, '\x7f' и старше - допустимые)
+    const string special = " \0\t\x1f\x7f\x80\xff"s;
+    vector<string> texts;
+    for (size_t length = 0; length <= 3 * 32 + 1; ++length) {
+        texts.push_back(string(length, 'a'));
+        for (size_t position = 0; position < length; ++position) {
+            for (const char c : special) {
+                string text(length, 'a');
+                text[position] = c;
+                texts.push_back(move(text));
+            }
+        }
+    }
+    // случайные тексты с несколькими пробелами подряд
+    mt19937 generator(14);
+    const string alphabet = "ab  -\n\x01\x1f\x20\x80\xff"s;
+    for (int i = 0; i < 2000; ++i) {
+        string text(uniform_int_distribution(0, 200)(generator), 'a');
+        for (char &c : text) {
+            c = alphabet[uniform_int_distribution<size_t>(0,
+                    alphabet.size() - 1)(generator)];
+        }
+        texts.push_back(move(text));
+    }
+
+    vector<string_view> words;
+    for (const string &text : texts) {
+        const vector<string_view> expected = split_naive(text);
+        const bool is_valid = none_of(text.begin(), text.end(), [](char c) {
+            return static_cast<unsigned char>(c) < ' ';
+        });
+        for (const SplitVariant variant : variants) {
+            const string hint = "variant "s
+                    + to_string(static_cast<int>(variant)) + ", length "s
+                    + to_string(text.size());
+            ASSERT_EQUAL_HINT(SplitIntoWords(variant, text, words), is_valid,
+                    hint);
+            ASSERT_EQUAL_HINT(words, expected, hint);
+        }
+        ASSERT_EQUAL(SplitIntoWords(text, words), is_valid);
+        ASSERT_EQUAL(words, expected);
+    }
+}
+
+// набор стоп-слов, построенный при запуске: слова большого набора
+// находятся, другие слова (в том числе начала и продолжения стоп-слов) - нет;
+// пустой набор; набор, построенный заново при открытии снапшота
+void TestStopWordSet() {
+    ASSERT(StopWordSet().empty());
+    ASSERT(!StopWordSet().Contains(""sv));
+    ASSERT(!StopWordSet(set<string, less<>> { }).Contains("a"sv));
+
+    mt19937 generator(15);
+    const vector<string> dictionary = GenerateDictionary(generator, 20'000, 8);
+    const set<string, less<>> unique_words(dictionary.begin(),
+            dictionary.end());
+    // стоп-слова - каждое второе слово
+    set<string, less<>> stop_words;
+    bool is_stop_word = true;
+    for (const string &word : unique_words) {
+        if (is_stop_word) {
+            stop_words.insert(word);
+        }
+        is_stop_word = !is_stop_word;
+    }
+    const StopWordSet stop_word_set(stop_words);
+    ASSERT_EQUAL(stop_word_set.size(), stop_words.size());
+    size_t index = 0;
+    for (const string &word : stop_words) {
+        ASSERT_EQUAL(string(stop_word_set.GetWord(index++)), word);
+    }
+    ASSERT(!stop_word_set.Contains(""sv));
+    for (const string &word : unique_words) {
+        for (const string &candidate : { word, word.substr(1), word + 'a',
+                word.substr(0, word.size() - 1) }) {
+            ASSERT_EQUAL_HINT(stop_word_set.Contains(candidate),
+                    stop_words.count(candidate) == 1, candidate);
+        }
+    }
+
+    const filesystem::path directory = filesystem::temp_directory_path()
+            / "search_server_stop_words_test"s;
+    filesystem::remove_all(directory);
+    filesystem::create_directories(directory);
+    const string path = (directory / "index.snapshot"s).string();
+    const vector<string> words(unique_words.begin(), unique_words.end());
+    const vector<TestDocument> documents = GenerateTestDocuments(generator,
+            words, 500, 10);
+    SearchServer server(stop_words);
+    AddTestDocuments(server, documents);
+    server.SaveSnapshot(path);
+    const SearchServer opened = SearchServer::OpenSnapshot(path);
+    for (int i = 0; i < 100; ++i) {
+        const string query = GenerateQuery(generator, words, 5);
+        ASSERT_EQUAL_HINT(opened.FindTopDocuments(query),
+                server.FindTopDocuments(query), query);
+        const int document_id = documents[i].id;
+        ASSERT_EQUAL_HINT(get<0>(opened.MatchDocument(query, document_id)),
+                get<0>(server.MatchDocument(query, document_id)), query);
+    }
+    for (const TestDocument &document : documents) {
+        const vector<string_view> matched_words = get<0>(
+                opened.MatchDocument(document.text, document.id));
+        for (const string_view word : matched_words) {
+            ASSERT_HINT(stop_words.count(word) == 0, string(word));
+        }
+    }
+    filesystem::remove_all(directory);
+}
+
+// сохранение снапшота поверх файла, из которого открыт сервер: открытый
+// сервер продолжает работать с прежним файлом, новый файл открывается;
+// неудачная запись не оставляет временных файлов
+void TestSnapshotResave() {
+    const filesystem::path directory = filesystem::temp_directory_path()
+            / "search_server_snapshot_test"s;
+    filesystem::remove_all(directory);
+    filesystem::create_directories(directory);
+    const string path = (directory / "index.snapshot"s).string();
+
+    mt19937 generator(8);
+    const vector<string> dictionary = GenerateDictionary(generator, 100, 4);
+    const set<string, less<>> stop_words = { dictionary[0] };
+    const vector<TestDocument> documents = GenerateTestDocuments(generator,
+            dictionary, 2000, 10);
+    SearchServer server(stop_words);
+    AddTestDocuments(server, documents);
+    vector<string> queries;
+    for (int i = 0; i < 30; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, 3, 0.2));
+    }
+    const auto check = [&queries](const SearchServer &lhs,
+            const SearchServer &rhs, const string &hint) {
+        ASSERT_EQUAL_HINT(lhs.GetDocumentCount(), rhs.GetDocumentCount(),
+                hint);
+        for (const string &query : queries) {
+            ASSERT_EQUAL_HINT(lhs.FindTopDocuments(query),
+                    rhs.FindTopDocuments(query), hint + ": "s + query);
+        }
+    };
+
+    server.SaveSnapshot(path);
+    SearchServer opened = SearchServer::OpenSnapshot(path);
+    check(opened, server, "opened"s);
+    opened.SaveSnapshot(path);
+    check(opened, server, "after saving over its own file"s);
+    check(SearchServer::OpenSnapshot(path), server, "reopened"s);
+
+    // изменённый сервер (данные скопированы из отображения) сохраняется
+    // поверх файла, который ещё отображён другим сервером
+    const SearchServer mapped = SearchServer::OpenSnapshot(path);
+    opened.AddDocument(documents.back().id + 1, dictionary[1] + ' '
+            + dictionary[2], DocumentStatus::ACTUAL, { 5 });
+    opened.RemoveDocument(documents.front().id);
+    opened.SaveSnapshot(path);
+    check(mapped, server, "mapped while replaced"s);
+    check(SearchServer::OpenSnapshot(path), opened, "modified"s);
+
+    // заменить каталог файлом нельзя: запись не удаётся, временный файл
+    // удаляется
+    const string directory_path = (directory / "directory"s).string();
+    filesystem::create_directory(directory_path);
+    bool is_thrown = false;
+    try {
+        server.SaveSnapshot(directory_path);
+    } catch (const runtime_error&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown);
+    ASSERT(filesystem::is_directory(directory_path));
+    vector<string> files;
+    for (const auto &entry : filesystem::directory_iterator(directory)) {
+        files.push_back(entry.path().filename().string());
+    }
+    sort(files.begin(), files.end());
+    ASSERT_EQUAL(files, vector<string>( { "directory"s, "index.snapshot"s }));
+    filesystem::remove_all(directory);
+}
+
+// результаты ShardedSearchServer совпадают с результатами одного
+// SearchServer с теми же документами до бита релевантности: по статусу,
+// критерию-функции и фильтру, при полном поиске и поиске с отсечением,
+// в том числе после удаления документов
+void TestShardedMatchesSingleServer() {
+    mt19937 generator(10);
+    const vector<string> dictionary = GenerateDictionary(generator, 150, 4);
+    const set<string, less<>> stop_words = { dictionary[0], dictionary[1] };
+    const vector<TestDocument> documents = GenerateTestDocuments(generator,
+            dictionary, 3000, 15);
+    SearchServer server(stop_words);
+    ShardedSearchServer sharded_server(4, stop_words);
+    // половина документов добавляется по одному, половина - пакетом
+    vector<DocumentToAdd> batch;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const TestDocument &document = documents[i];
+        if (i % 2 == 0) {
+            server.AddDocument(document.id, document.text, document.status,
+                    { document.rating });
+            sharded_server.AddDocument(document.id, document.text,
+                    document.status, { document.rating });
+        } else {
+            batch.push_back( { document.id, document.text, document.status,
+                    { document.rating } });
+        }
+    }
+    ASSERT(server.AddDocuments(batch).empty());
+    ASSERT(sharded_server.AddDocuments(batch).empty());
+
+    const auto assert_same = [](const vector<Document> &sharded_found,
+            const vector<Document> &found, const string &hint) {
+        ASSERT_EQUAL_HINT(sharded_found, found, hint);
+        for (size_t i = 0; i < found.size(); ++i) {
+            ASSERT_HINT(sharded_found[i].relevance == found[i].relevance,
+                    hint);
+        }
+    };
+    const auto is_odd_rated = [](int document_id, DocumentStatus,
+            int rating) {
+        return document_id % 3 != 0 && rating % 2 != 0;
+    };
+    const DocumentFilter filter = DocumentFilter(DocumentStatus::ACTUAL)
+            .SetRatingRange(-2, 3);
+    const auto check = [&](const string &stage) {
+        ASSERT_EQUAL(sharded_server.GetDocumentCount(),
+                server.GetDocumentCount());
+        for (int i = 0; i < 40; ++i) {
+            const string query = GenerateQuery(generator, dictionary,
+                    uniform_int_distribution(1, 6)(generator), 0.15);
+            const string hint = stage + ": "s + query;
+            assert_same(sharded_server.FindTopDocuments(query),
+                    server.FindTopDocuments(query), hint);
+            for (const EvaluationMode mode : { EvaluationMode::EXHAUSTIVE,
+                    EvaluationMode::PRUNED }) {
+                for (const size_t top_k : { size_t(1), size_t(5),
+                        size_t(50) }) {
+                    for (const DocumentStatus status : {
+                            DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                        assert_same(sharded_server.FindTopDocuments(query,
+                                status, top_k, mode), server.FindTopDocuments(
+                                query, status, top_k, mode), hint);
+                    }
+                    assert_same(sharded_server.FindTopDocuments(query,
+                            is_odd_rated, top_k, mode),
+                            server.FindTopDocuments(query, is_odd_rated,
+                                    top_k, mode), hint);
+                    assert_same(sharded_server.FindTopDocuments(query, filter,
+                            top_k, mode), server.FindTopDocuments(query,
+                            filter, top_k, mode), hint);
+                }
+            }
+            const int document_id = documents[uniform_int_distribution<
+                    size_t>(0, documents.size() - 1)(generator)].id;
+            ASSERT_HINT(sharded_server.MatchDocument(query, document_id)
+                    == server.MatchDocument(query, document_id), hint);
+        }
+    };
+    check("added"s);
+    for (size_t i = 0; i < documents.size(); i += 4) {
+        server.RemoveDocument(documents[i].id);
+        sharded_server.RemoveDocument(documents[i].id);
+    }
+    check("removed"s);
+}
+
+// VersionedSearchServer: читатели во время изменений видят опубликованные
+// версии целиком (документы версии - результат первых изменений, поиск
+// в версии совпадает с поиском в сервере после тех же изменений), версии
+// у читателя не идут назад; версия, которую держит читатель, не изменяется
+// (запасная копия создаётся копированием); итоговый индекс совпадает
+// с индексом, построенным напрямую
+void TestVersionedSearchServer() {
+    mt19937 generator(17);
+    const vector<string> dictionary = GenerateDictionary(generator, 100, 4);
+    const vector<TestDocument> documents = GenerateTestDocuments(generator,
+            dictionary, 600, 8);
+    const string query = GenerateQuery(generator, dictionary, 4);
+    const auto any_document = [](int, DocumentStatus, int) {
+        return true;
+    };
+    const auto assert_same = [](const vector<Document> &lhs,
+            const vector<Document> &rhs, const string &hint) {
+        ASSERT_EQUAL_HINT(lhs, rhs, hint);
+        for (size_t i = 0; i < rhs.size(); ++i) {
+            ASSERT_HINT(lhs[i].relevance == rhs[i].relevance, hint);
+        }
+    };
+    // изменение i добавляет документ i, каждое третье ещё и удаляет
+    // документ i - 2 (одной версией)
+    const auto apply = [&documents](size_t i, SearchServer &server) {
+        const TestDocument &document = documents[i];
+        server.AddDocument(document.id, document.text, document.status,
+                { document.rating });
+        if (i % 3 == 2) {
+            server.RemoveDocument(documents[i - 2].id);
+        }
+    };
+    map<int, size_t> document_indexes;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        document_indexes[documents[i].id] = i;
+    }
+
+    VersionedSearchServer server(""s);
+    atomic<bool> is_writing = true;
+    thread writer([&] {
+        for (size_t i = 0; i < documents.size(); ++i) {
+            server.Update([&apply, i](SearchServer &search_server) {
+                apply(i, search_server);
+            });
+        }
+        is_writing = false;
+    });
+    // результаты поиска, которые читатели видели после изменения (номер
+    // последнего изменения версии)
+    vector<map<size_t, vector<Document>>> reader_results(3);
+    vector<thread> readers;
+    for (auto &results : reader_results) {
+        readers.emplace_back([&, &results = results] {
+            size_t last_update = 0;
+            while (is_writing) {
+                const VersionedSearchServer::Version version =
+                        server.GetVersion();
+                if (version->GetDocumentCount() == 0) {
+                    continue;
+                }
+                set<size_t> indexes;
+                for (const int document_id : *version) {
+                    indexes.insert(document_indexes.at(document_id));
+                }
+                // документ последнего изменения ещё не удалён
+                const size_t update = *indexes.rbegin();
+                ASSERT(update >= last_update);
+                last_update = update;
+                for (size_t i = 0; i <= update; ++i) {
+                    const bool is_removed = i + 2 <= update
+                            && (i + 2) % 3 == 2;
+                    ASSERT_EQUAL_HINT(indexes.count(i) == 1, !is_removed,
+                            "update "s + to_string(update));
+                }
+                results.emplace(update, version->FindTopDocuments(query,
+                        any_document, 50));
+            }
+        });
+    }
+    writer.join();
+    for (thread &reader : readers) {
+        reader.join();
+    }
+
+    SearchServer direct_server(""s);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        apply(i, direct_server);
+        const vector<Document> expected = direct_server.FindTopDocuments(
+                query, any_document, 50);
+        for (const auto &results : reader_results) {
+            const auto found = results.find(i);
+            if (found != results.end()) {
+                assert_same(found->second, expected,
+                        "update "s + to_string(i));
+            }
+        }
+    }
+    const VersionedSearchServer::Version version = server.GetVersion();
+    ASSERT(equal(version->begin(), version->end(), direct_server.begin(),
+            direct_server.end()));
+    for (int i = 0; i < 30; ++i) {
+        const string other_query = GenerateQuery(generator, dictionary, 3,
+                0.2);
+        assert_same(server.FindTopDocuments(other_query, any_document),
+                direct_server.FindTopDocuments(other_query, any_document),
+                other_query);
+    }
+
+    // запасная копия, которую держит читатель дольше MAX_SPARE_WAIT,
+    // не изменяется: писатель копирует текущую версию
+    VersionedSearchServer held_server(""s);
+    held_server.AddDocument(1, "cat"sv, DocumentStatus::ACTUAL, { 1 });
+    held_server.AddDocument(2, "dog"sv, DocumentStatus::ACTUAL, { 1 });
+    const uint64_t copies = held_server.GetStats().copies;
+    VersionedSearchServer::Version held = held_server.GetVersion();
+    held_server.AddDocument(3, "cat dog"sv, DocumentStatus::ACTUAL, { 1 });
+    held_server.AddDocument(4, "cat"sv, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(held_server.GetStats().copies, copies + 1);
+    ASSERT_EQUAL(held->GetDocumentCount(), 2u);
+    ASSERT_EQUAL(held->FindTopDocuments("cat"sv).size(), 1u);
+    held.reset();
+    // отпущенная копия снова используется без копирования
+    held_server.AddDocument(5, "dog"sv, DocumentStatus::ACTUAL, { 1 });
+    held_server.AddDocument(6, "cat"sv, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(held_server.GetStats().copies, copies + 1);
+    ASSERT_EQUAL(held_server.GetDocumentCount(), 6u);
+    ASSERT_EQUAL(held_server.FindTopDocuments("cat"sv).size(), 4u);
+}
+
+// ConcurrentMap<int, Value>: несколько потоков одновременно вызывают Add,
+// operator[] и erase, ещё один поток - BuildSortedVector. Общие ключи потоки
+// только увеличивают, остальные ключи изменяет и удаляет один поток, поэтому
+// итоговый словарь совпадает с std::map, в котором изменения выполнены
+// последовательно; снимки во время изменений упорядочены, без повторов,
+// значения общих ключей в них не больше итоговых (приращения положительны)
+template<typename Value>
+void CheckConcurrentMapAgainstMap() {
+    constexpr int SHARED_KEY_COUNT = 32;
+    constexpr int OWN_KEY_COUNT = 500;
+    constexpr size_t THREAD_COUNT = 4;
+    ConcurrentMap<int, Value> concurrent_map(7);
+    map<int, Value> expected;
+
+    // изменения потока: (вид, ключ, приращение)
+    enum class Operation {
+        ADD, ACCESS, ERASE
+    };
+    vector<vector<tuple<Operation, int, Value>>> thread_operations(
+            THREAD_COUNT);
+    for (size_t t = 0; t < THREAD_COUNT; ++t) {
+        mt19937 generator(18 + t);
+        const int own_first = SHARED_KEY_COUNT
+                + static_cast<int>(t) * OWN_KEY_COUNT;
+        for (int i = 0; i < 20'000; ++i) {
+            const bool is_shared = uniform_int_distribution(0, 1)(generator)
+                    == 0;
+            const int key = is_shared ?
+                    uniform_int_distribution(0, SHARED_KEY_COUNT - 1)(
+                            generator) :
+                    own_first + uniform_int_distribution(0,
+                            OWN_KEY_COUNT - 1)(generator);
+            const Value delta = static_cast<Value>(uniform_int_distribution(1,
+                    100)(generator));
+            const int kind = uniform_int_distribution(0, 4)(generator);
+            const Operation operation = !is_shared && kind == 0 ?
+                    Operation::ERASE :
+                    (kind % 2 == 0 ? Operation::ADD : Operation::ACCESS);
+            thread_operations[t].emplace_back(operation, key, delta);
+            if (operation == Operation::ERASE) {
+                expected.erase(key);
+            } else {
+                expected[key] += delta;
+            }
+        }
+    }
+
+    atomic<size_t> running_count = THREAD_COUNT;
+    thread reader([&] {
+        while (running_count > 0) {
+            const vector<pair<int, Value>> snapshot =
+                    concurrent_map.BuildSortedVector();
+            for (size_t i = 0; i < snapshot.size(); ++i) {
+                const auto& [key, value] = snapshot[i];
+                ASSERT(i == 0 || snapshot[i - 1].first < key);
+                if (key < SHARED_KEY_COUNT) {
+                    ASSERT_HINT(value <= expected.at(key), to_string(key));
+                }
+            }
+        }
+    });
+    vector<thread> writers;
+    for (const auto &operations : thread_operations) {
+        writers.emplace_back([&concurrent_map, &operations, &running_count] {
+            for (const auto& [operation, key, delta] : operations) {
+                if (operation == Operation::ADD) {
+                    concurrent_map.Add(key, delta);
+                } else if (operation == Operation::ACCESS) {
+                    concurrent_map[key].ref_to_value += delta;
+                } else {
+                    concurrent_map.erase(key);
+                }
+            }
+            --running_count;
+        });
+    }
+    for (thread &writer : writers) {
+        writer.join();
+    }
+    reader.join();
+
+    const vector<pair<int, Value>> expected_items(expected.begin(),
+            expected.end());
+    ASSERT(concurrent_map.BuildSortedVector() == expected_items);
+    ASSERT(concurrent_map.BuildOrdinaryMap() == expected);
+}
+
+void TestConcurrentMap() {
+    CheckConcurrentMapAgainstMap<int64_t>();
+    CheckConcurrentMapAgainstMap<double>();
+}
+
+// гистограмма задержек: задержки меньше 16 нс хранятся точно, процентиль -
+// верхняя граница корзины (не больше наибольшей задержки), погрешность -
+// не больше 1/8 задержки
+void TestLatencyHistogram() {
+    using Duration = LatencyHistogram::Duration;
+    LatencyHistogram empty;
+    ASSERT_EQUAL(empty.GetCount(), 0u);
+    ASSERT(empty.GetPercentile(0.5) == Duration(0));
+    ASSERT(empty.GetMax() == Duration(0));
+
+    LatencyHistogram exact;
+    for (int latency = 15; latency >= 0; --latency) {
+        exact.Add(Duration(latency));
+    }
+    exact.Add(Duration(-5));  // отрицательная задержка считается нулевой
+    ASSERT_EQUAL(exact.GetCount(), 17u);
+    // задержка номер ceil(fraction * 17) по возрастанию
+    ASSERT(exact.GetPercentile(0.0) == Duration(0));
+    ASSERT(exact.GetPercentile(0.1) == Duration(0));
+    ASSERT(exact.GetPercentile(0.15) == Duration(1));
+    ASSERT(exact.GetPercentile(0.5) == Duration(7));
+    ASSERT(exact.GetPercentile(0.9) == Duration(14));
+    ASSERT(exact.GetPercentile(1.0) == Duration(15));
+    ASSERT(exact.GetMax() == Duration(15));
+
+    // корзины [16, 17], [18, 19], ..., [960, 1023], [1024, 1151]
+    const auto percentile_of_first = [](int64_t first, int64_t second) {
+        LatencyHistogram histogram;
+        histogram.Add(Duration(first));
+        histogram.Add(Duration(second));
+        return histogram.GetPercentile(0.5).count();
+    };
+    ASSERT_EQUAL(percentile_of_first(16, 18), 17);
+    ASSERT_EQUAL(percentile_of_first(17, 18), 17);
+    ASSERT_EQUAL(percentile_of_first(16, 16), 16);
+    ASSERT_EQUAL(percentile_of_first(960, 2000), 1023);
+    ASSERT_EQUAL(percentile_of_first(1023, 2000), 1023);
+    ASSERT_EQUAL(percentile_of_first(1024, 2000), 1151);
+    ASSERT_EQUAL(percentile_of_first(1024, 1100), 1100);
+
+    mt19937_64 generator(19);
+    for (int i = 0; i < 10'000; ++i) {
+        const int64_t latency = static_cast<int64_t>(generator()
+                >> (i % 60 + 4));
+        const int64_t upper = percentile_of_first(latency,
+                numeric_limits<int64_t>::max());
+        ASSERT_HINT(upper >= latency && upper - latency <= latency / 8,
+                to_string(latency));
+    }
+}
+
+// статистика запросов: пустое окно, заполнение и сдвиг окна (в статистике
+// только последние запросы), количество запросов с пустым результатом,
+// процентили задержек окна, запись из нескольких потоков
+void TestRequestStatistics() {
+    using Duration = LatencyHistogram::Duration;
+    RequestStatistics statistics(4);
+    RequestStatistics::Stats stats = statistics.GetStats();
+    ASSERT_EQUAL(stats.request_count, 0u);
+    ASSERT_EQUAL(stats.no_result_count, 0u);
+    ASSERT_EQUAL(stats.queries_per_second, 0.0);
+    ASSERT_EQUAL(stats.latencies.GetCount(), 0u);
+    ASSERT_EQUAL(statistics.GetNoResultRequests(), 0u);
+    ASSERT_EQUAL(RequestStatistics(0).GetWindowSize(), 1u);
+
+    // запрос i: задержка i нс, результат пустой у каждого третьего
+    for (int i = 0; i < 10; ++i) {
+        statistics.AddRequest(i % 3 == 0, Duration(i));
+        stats = statistics.GetStats();
+        const int first = max(0, i - 3);
+        int no_result_count = 0;
+        for (int j = first; j <= i; ++j) {
+            no_result_count += j % 3 == 0 ? 1 : 0;
+        }
+        const string hint = "request "s + to_string(i);
+        ASSERT_EQUAL_HINT(stats.request_count, static_cast<uint64_t>(i
+                - first + 1), hint);
+        ASSERT_EQUAL_HINT(stats.no_result_count,
+                static_cast<uint64_t>(no_result_count), hint);
+        ASSERT_EQUAL_HINT(statistics.GetNoResultRequests(),
+                stats.no_result_count, hint);
+        ASSERT_HINT(stats.latencies.GetPercentile(0.0) == Duration(first),
+                hint);
+        ASSERT_HINT(stats.latencies.GetMax() == Duration(i), hint);
+        ASSERT_HINT(stats.queries_per_second >= 0.0, hint);
+    }
+    ASSERT(stats.latencies.GetPercentile(0.5) == Duration(7));
+
+    constexpr size_t THREAD_COUNT = 4;
+    constexpr int REQUEST_COUNT = 2000;
+    RequestStatistics shared_statistics(THREAD_COUNT * REQUEST_COUNT);
+    vector<thread> threads;
+    for (size_t t = 0; t < THREAD_COUNT; ++t) {
+        threads.emplace_back([&shared_statistics] {
+            for (int i = 0; i < REQUEST_COUNT; ++i) {
+                shared_statistics.AddRequest(i % 4 == 0, Duration(i));
+            }
+        });
+    }
+    for (thread &writer : threads) {
+        writer.join();
+    }
+    stats = shared_statistics.GetStats();
+    ASSERT_EQUAL(stats.request_count, THREAD_COUNT * REQUEST_COUNT);
+    ASSERT_EQUAL(stats.no_result_count, THREAD_COUNT * REQUEST_COUNT / 4);
+    ASSERT(stats.latencies.GetMax() == Duration(REQUEST_COUNT - 1));
+}
+
+// очередь запросов: запросы с пустым результатом среди последних
+// REQUEST_WINDOW_SIZE запросов всех перегрузок AddFindRequest
+void TestRequestQueue() {
+    SearchServer search_server("and in at"s);
+    RequestQueue request_queue(search_server);
+    search_server.AddDocument(1, "curly cat curly tail"sv,
+            DocumentStatus::ACTUAL, { 7, 2, 7 });
+    search_server.AddDocument(2, "curly dog and fancy collar"sv,
+            DocumentStatus::ACTUAL, { 1, 2, 3 });
+    search_server.AddDocument(3, "big cat fancy collar "sv,
+            DocumentStatus::BANNED, { 1, 2, 8 });
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 0);
+    ASSERT_EQUAL(request_queue.GetStats().request_count, 0u);
+
+    for (size_t i = 0; i + 1 < REQUEST_WINDOW_SIZE; ++i) {
+        request_queue.AddFindRequest("empty request"sv);
+    }
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(),
+            static_cast<int>(REQUEST_WINDOW_SIZE) - 1);
+    // окно заполнено: запрос с результатом
+    ASSERT_EQUAL(request_queue.AddFindRequest("curly dog"sv).size(), 2u);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(),
+            static_cast<int>(REQUEST_WINDOW_SIZE) - 1);
+    // первый пустой запрос выходит из окна
+    ASSERT_EQUAL(request_queue.AddFindRequest("big collar"sv,
+            DocumentStatus::BANNED).size(), 1u);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(),
+            static_cast<int>(REQUEST_WINDOW_SIZE) - 2);
+    // пустой запрос вместо пустого
+    ASSERT(request_queue.AddFindRequest("sparrow"sv, [](int, DocumentStatus,
+            int) {
+        return true;
+    }).empty());
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(),
+            static_cast<int>(REQUEST_WINDOW_SIZE) - 2);
+    const RequestStatistics::Stats stats = request_queue.GetStats();
+    ASSERT_EQUAL(stats.request_count, REQUEST_WINDOW_SIZE);
+    ASSERT_EQUAL(stats.latencies.GetCount(), REQUEST_WINDOW_SIZE);
+}
+
+#ifdef SEARCH_SERVER_METRICS
+// метрики поиска (только при сборке с SEARCH_SERVER_METRICS): приращения
+// счётчиков за запрос, собственное время вложенного и объемлющего этапов,
+// выделения памяти только во время этапа, вывод в формате Prometheus
+void TestSearchMetrics() {
+    using Stage = SearchMetrics::Stage;
+    using Counter = SearchMetrics::Counter;
+    SearchMetrics::Snapshot before;
+    SearchMetrics::Snapshot after;
+    const auto counter_delta = [&before, &after](Counter counter) {
+        const size_t i = static_cast<size_t>(counter);
+        return after.counters[i] - before.counters[i];
+    };
+    const auto stage_delta = [&before, &after](Stage stage) {
+        const size_t i = static_cast<size_t>(stage);
+        return after.stage_times[i] - before.stage_times[i];
+    };
+
+    SearchServer server(""s);
+    server.AddDocument(1, "cat dog"sv, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "cat"sv, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "dog bird"sv, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "bird"sv, DocumentStatus::ACTUAL, { 4 });
+    server.FindTopDocuments("cat"sv);
+    before = SearchMetrics::Collect();
+    ASSERT_EQUAL(server.FindTopDocuments("cat dog -bird"sv).size(), 2u);
+    after = SearchMetrics::Collect();
+    ASSERT_EQUAL(counter_delta(Counter::QUERIES), 1u);
+    // записи плюс-слов (по 2 документа), записи минус-слов не считаются
+    ASSERT_EQUAL(counter_delta(Counter::POSTINGS_SCANNED), 4u);
+    // документ 3 исключён минус-словом
+    ASSERT_EQUAL(counter_delta(Counter::DOCUMENTS_SCORED), 2u);
+    ASSERT(stage_delta(Stage::PARSE) > chrono::nanoseconds(0));
+    ASSERT(stage_delta(Stage::POSTINGS) > chrono::nanoseconds(0));
+
+    // время вложенного этапа вычитается из времени объемлющего
+    const chrono::milliseconds inner_time(20);
+    const chrono::milliseconds outer_time(5);
+    before = SearchMetrics::Collect();
+    const auto start = chrono::steady_clock::now();
+    {
+        SearchMetrics::StageTimer outer(Stage::POSTINGS);
+        this_thread::sleep_for(outer_time);
+        {
+            SearchMetrics::StageTimer inner(Stage::MINUS_WORDS);
+            this_thread::sleep_for(inner_time);
+        }
+        this_thread::sleep_for(outer_time);
+    }
+    const auto elapsed = chrono::steady_clock::now() - start;
+    after = SearchMetrics::Collect();
+    ASSERT(stage_delta(Stage::MINUS_WORDS) >= inner_time);
+    ASSERT(stage_delta(Stage::POSTINGS) >= 2 * outer_time);
+    ASSERT(stage_delta(Stage::POSTINGS) + stage_delta(Stage::MINUS_WORDS)
+            <= elapsed);
+    ASSERT(stage_delta(Stage::PARSE) == chrono::nanoseconds(0));
+    ASSERT(stage_delta(Stage::TOP_K) == chrono::nanoseconds(0));
+
+    // SplitIntoWords одного слова выделяет память один раз
+    before = SearchMetrics::Collect();
+    static_cast<void>(SplitIntoWords("word"sv));
+    {
+        SearchMetrics::StageTimer stage(Stage::PARSE);
+        static_cast<void>(SplitIntoWords("word"sv));
+    }
+    after = SearchMetrics::Collect();
+    ASSERT_EQUAL(counter_delta(Counter::ALLOCATIONS), 1u);
+
+    ostringstream output;
+    SearchMetrics::WritePrometheus(output);
+    ASSERT(output.str().find("search_stage_seconds_total{stage=\"parse\"} "s)
+            != string::npos);
+    ASSERT(output.str().find("\nsearch_queries_total "s) != string::npos);
+    ASSERT(output.str().find("\nsearch_allocations_total "s)
+            != string::npos);
+}
+#endif
+
+// вложенные ParallelFor, исключения; поток, ожидающий задачу, которую
+// выполняет другой поток, спит, а не занимает ядро
+void TestQueryExecutor() {
+    const QueryExecutor executor(4);
+    atomic<int> sum = 0;
+    executor.ParallelFor(10, [&executor, &sum](size_t i) {
+        executor.ParallelFor(100, [&sum, i](size_t j) {
+            sum += static_cast<int>(i * j);
+        });
+    });
+    ASSERT_EQUAL(sum.load(), 45 * 4950);
+
+    bool is_thrown = false;
+    try {
+        executor.ParallelFor(50, [](size_t i) {
+            if (i == 17) {
+                throw runtime_error("17"s);
+            }
+        });
+    } catch (const runtime_error &error) {
+        is_thrown = error.what() == "17"s;
+    }
+    ASSERT(is_thrown);
+
+    const clock_t cpu_start = clock();
+    executor.ParallelFor(2, [](size_t) {
+        this_thread::sleep_for(chrono::milliseconds(300));
+    });
+    const double cpu_seconds = double(clock() - cpu_start) / CLOCKS_PER_SEC;
+    ASSERT_HINT(cpu_seconds < 0.1, to_string(cpu_seconds));
+}
+
+// кеш находит запрос с другим порядком и повторами слов, а после изменения
+// документов сервера вычисляет результат заново
+void TestQueryResultCacheInvalidation() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat and fancy collar"sv,
+            DocumentStatus::ACTUAL, { 8 });
+    server.AddDocument(2, "fluffy cat fluffy tail"sv, DocumentStatus::ACTUAL,
+            { 7 });
+    server.AddDocument(3, "groomed dog expressive eyes"sv,
+            DocumentStatus::ACTUAL, { 5 });
+    QueryResultCache cache(server, 10);
+    const auto check = [&server, &cache](string_view query) {
+        ASSERT_EQUAL_HINT(cache.FindTopDocuments(query),
+                server.FindTopDocuments(query), string(query));
+    };
+
+    check("fluffy cat -collar"sv);
+    check("cat fluffy cat -collar"sv);
+    QueryResultCache::Stats stats = cache.GetStats();
+    ASSERT_EQUAL(stats.misses, 1u);
+    ASSERT_EQUAL(stats.hits, 1u);
+
+    server.AddDocument(4, "fluffy fluffy cat"sv, DocumentStatus::ACTUAL,
+            { 1 });
+    check("fluffy cat -collar"sv);
+    ASSERT_EQUAL(cache.FindTopDocuments("fluffy cat -collar"sv)[0].id, 4);
+    server.RemoveDocument(4);
+    check("fluffy cat -collar"sv);
+    server.UpdateInverseDocumentFreqs();
+    check("fluffy cat -collar"sv);
+    stats = cache.GetStats();
+    ASSERT_EQUAL(stats.misses, 4u);
+    ASSERT_EQUAL(stats.invalidations, 3u);
+
+    const auto is_odd = [](int document_id, DocumentStatus, int) {
+        return document_id % 2 == 1;
+    };
+    ASSERT_EQUAL(cache.FindTopDocuments("cat"sv, 1, is_odd),
+            server.FindTopDocuments("cat"sv, is_odd));
+    server.AddDocument(5, "cat"sv, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(cache.FindTopDocuments("cat"sv, 1, is_odd),
+            server.FindTopDocuments("cat"sv, is_odd));
+    ASSERT_EQUAL(cache.FindTopDocuments("cat"sv, 1, is_odd)[0].id, 5);
+}
+
+// IDF после каждого добавления и удаления документа точные (tolerance 0),
+// у шардированного сервера - те же до бита
+void TestInverseDocumentFreqsAfterWrites() {
+    mt19937 generator(13);
+    const vector<string> dictionary = GenerateDictionary(generator, 80, 4);
+    const set<string, less<>> stop_words = { dictionary[0] };
+    const vector<TestDocument> all_documents = GenerateTestDocuments(
+            generator, dictionary, 400, 10);
+    SearchServer server(stop_words);
+    ShardedSearchServer sharded_server(3, stop_words);
+    vector<TestDocument> documents;
+    for (size_t i = 0; i < all_documents.size(); ++i) {
+        const TestDocument &document = all_documents[i];
+        server.AddDocument(document.id, document.text, document.status,
+                { document.rating });
+        sharded_server.AddDocument(document.id, document.text,
+                document.status, { document.rating });
+        documents.push_back(document);
+        if (i % 5 == 4) {
+            const size_t removed = uniform_int_distribution<size_t>(0,
+                    documents.size() - 1)(generator);
+            server.RemoveDocument(documents[removed].id);
+            sharded_server.RemoveDocument(documents[removed].id);
+            documents.erase(documents.begin() + removed);
+        }
+        const string query = GenerateQuery(generator, dictionary, 3);
+        const vector<Document> found = server.FindTopDocuments(query);
+        ASSERT_EQUAL_HINT(found, FindTopDocumentsNaive(documents, stop_words,
+                query, DocumentStatus::ACTUAL), query);
+        const vector<Document> sharded_found = sharded_server.FindTopDocuments(
+                query);
+        ASSERT_EQUAL(sharded_found.size(), found.size());
+        for (size_t j = 0; j < found.size(); ++j) {
+            ASSERT_EQUAL(sharded_found[j].id, found[j].id);
+            ASSERT(sharded_found[j].relevance == found[j].relevance);
+        }
+    }
+}
+
+// очистка индекса от удалённых документов (списки документов слов и прямой
+// индекс) не меняет результатов поиска и слов оставшихся документов
+void TestCompactIndex() {
+    mt19937 generator(21);
+    const vector<string> dictionary = GenerateDictionary(generator, 60, 4);
+    const set<string, less<>> stop_words = { dictionary[0] };
+    for (const double threshold : { 0.0, 0.1, 1.0 }) {
+        vector<TestDocument> documents = GenerateTestDocuments(generator,
+                dictionary, 600, 12);
+        SearchServer server(stop_words);
+        server.SetCompactionThreshold(threshold);
+        AddTestDocuments(server, documents);
+        map<int, vector<TermId>> document_terms;
+        for (const TestDocument &document : documents) {
+            const auto [begin, end] = server.GetDocumentTerms(document.id);
+            document_terms[document.id].assign(begin, end);
+        }
+        const auto check = [&](const string &hint) {
+            for (int i = 0; i < 20; ++i) {
+                const string query = GenerateQuery(generator, dictionary, 3);
+                ASSERT_EQUAL_HINT(server.FindTopDocuments(query),
+                        FindTopDocumentsNaive(documents, stop_words, query,
+                                DocumentStatus::ACTUAL), hint + query);
+                ASSERT_EQUAL_HINT(server.FindTopDocuments(query,
+                        DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT,
+                        EvaluationMode::PRUNED), FindTopDocumentsNaive(
+                        documents, stop_words, query, DocumentStatus::ACTUAL),
+                        hint + query);
+            }
+            for (const TestDocument &document : documents) {
+                const auto [begin, end] = server.GetDocumentTerms(document.id);
+                ASSERT_EQUAL_HINT(vector<TermId>(begin, end),
+                        document_terms[document.id], hint);
+            }
+            ASSERT_EQUAL(server.GetDocumentCount(), documents.size());
+        };
+        // удаляется больше половины документов, поэтому прямой индекс
+        // сжимается и при пороге 0.1
+        vector<int> removed_ids;
+        while (documents.size() > 200) {
+            const size_t removed = uniform_int_distribution<size_t>(0,
+                    documents.size() - 1)(generator);
+            server.RemoveDocument(documents[removed].id);
+            removed_ids.push_back(documents[removed].id);
+            documents.erase(documents.begin() + removed);
+            if (documents.size() % 100 == 0) {
+                check("threshold "s + to_string(threshold) + ": "s);
+            }
+        }
+        server.CompactIndex();
+        check("CompactIndex: "s);
+
+        // id удалённого документа можно использовать снова
+        const int reused_id = removed_ids.front();
+        ASSERT(server.GetDocumentTerms(reused_id).first == nullptr);
+        TestDocument reused { reused_id, "reused "s + dictionary[1],
+                DocumentStatus::ACTUAL, 7 };
+        server.AddDocument(reused.id, reused.text, reused.status,
+                { reused.rating });
+        documents.push_back(reused);
+        const vector<Document> found = server.FindTopDocuments("reused"sv);
+        ASSERT_EQUAL(found.size(), 1u);
+        ASSERT_EQUAL(found[0].id, reused_id);
+
+        const string path = (filesystem::temp_directory_path()
+                / "search_server_compact_test.snapshot"s).string();
+        server.SaveSnapshot(path);
+        const SearchServer opened = SearchServer::OpenSnapshot(path);
+        for (int i = 0; i < 20; ++i) {
+            const string query = GenerateQuery(generator, dictionary, 3);
+            ASSERT_EQUAL_HINT(opened.FindTopDocuments(query),
+                    server.FindTopDocuments(query), query);
+        }
+        filesystem::remove(path);
+    }
+}
+
+// частоты слов с количествами вхождений, не помещающимися в 16 бит
+// прямого индекса, точные; порядок слов - порядок их появления на сервере
+void TestWordFrequencies() {
+    const vector<pair<string, uint32_t>> word_counts = { { "many"s, 70'000 },
+            { "saturated"s, MAX_QUANTIZED_TERM_COUNT }, { "almost"s,
+                    MAX_QUANTIZED_TERM_COUNT - 1 }, { "once"s, 1 } };
+    string text = "the"s;
+    uint32_t total_count = 0;
+    for (const auto &[word, count] : word_counts) {
+        for (uint32_t i = 0; i < count; ++i) {
+            text += ' ' + word;
+        }
+        total_count += count;
+    }
+    SearchServer server("the"s);
+    server.AddDocument(1, text, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocuments(execution::par, { { 2, text, DocumentStatus::ACTUAL,
+            { 1 } }, { 3, "once more"sv, DocumentStatus::ACTUAL, { 1 } } });
+    for (const int document_id : { 1, 2 }) {
+        const WordFrequencies frequencies = server.GetWordFrequencies(
+                document_id);
+        ASSERT_EQUAL(frequencies.size(), word_counts.size());
+        size_t index = 0;
+        for (const auto [word, term_freq] : frequencies) {
+            const auto &[expected_word, count] = word_counts[index++];
+            ASSERT_EQUAL(word, expected_word);
+            ASSERT_EQUAL_HINT(term_freq, count * (1.0 / total_count),
+                    string(word));
+            ASSERT_EQUAL(frequencies.Get(word), term_freq);
+        }
+        ASSERT_EQUAL(frequencies.Get("the"sv), 0.0);
+        ASSERT_EQUAL(frequencies.Get("more"sv), 0.0);
+        ASSERT_EQUAL(frequencies.Get("absent"sv), 0.0);
+    }
+    ASSERT_EQUAL(server.GetWordFrequencies(3).Get("once"sv), 0.5);
+
+    server.RemoveDocument(1);
+    ASSERT(server.GetWordFrequencies(1).empty());
+    const WordFrequencies missing = server.GetWordFrequencies(4);
+    ASSERT(missing.empty());
+    ASSERT(missing.begin() == missing.end());
+    ASSERT_EQUAL(missing.Get("many"sv), 0.0);
+}
+
+// поиск с DocumentFilter совпадает с поиском с эквивалентным критерием-
+// функцией и с поиском перебором, в том числе после добавления документов
+// между запросами (индекс фильтра дополняется) и после удаления документов
+void TestDocumentFilter() {
+    mt19937 generator(23);
+    const vector<string> dictionary = GenerateDictionary(generator, 50, 3);
+    const set<string, less<>> stop_words = { dictionary[0] };
+    const vector<TestDocument> all_documents = GenerateTestDocuments(
+            generator, dictionary, 3000, 10);
+    const auto is_odd = [](int document_id, DocumentStatus, int) {
+        return document_id % 2 != 0;
+    };
+    // фильтры и эквивалентные им критерии
+    const vector<pair<DocumentFilter, function<bool(int, DocumentStatus,
+            int)>>> filters = {
+            { DocumentFilter(), [](int, DocumentStatus, int) {
+                return true;
+            } },
+            { DocumentFilter(DocumentStatus::BANNED), [](int,
+                    DocumentStatus status, int) {
+                return status == DocumentStatus::BANNED;
+            } },
+            { DocumentFilter().SetRatingRange(-1, 2), [](int, DocumentStatus,
+                    int rating) {
+                return rating >= -1 && rating <= 2;
+            } },
+            { DocumentFilter().SetRatingRange(numeric_limits<int>::min(), -3),
+                    [](int, DocumentStatus, int rating) {
+                        return rating <= -3;
+                    } },
+            { DocumentFilter().SetRatingRange(3, 2), [](int, DocumentStatus,
+                    int) {
+                return false;
+            } },
+            { DocumentFilter(DocumentStatus::ACTUAL).SetRatingRange(0, 5)
+                    .SetResidual(is_odd), [is_odd](int document_id,
+                    DocumentStatus status, int rating) {
+                return status == DocumentStatus::ACTUAL && rating >= 0
+                        && rating <= 5 && is_odd(document_id, status, rating);
+            } },
+    };
+
+    SearchServer server(stop_words);
+    vector<TestDocument> documents;
+    for (size_t step = 0; step < 3; ++step) {
+        const size_t first = step * 1000;
+        documents.insert(documents.end(), all_documents.begin() + first,
+                all_documents.begin() + first + 1000);
+        for (size_t i = first; i < first + 1000; ++i) {
+            const TestDocument &document = all_documents[i];
+            server.AddDocument(document.id, document.text, document.status,
+                    { document.rating });
+        }
+        for (int i = 0; i < 100; ++i) {
+            const size_t removed = uniform_int_distribution<size_t>(0,
+                    documents.size() - 1)(generator);
+            server.RemoveDocument(documents[removed].id);
+            documents.erase(documents.begin() + removed);
+        }
+        for (int i = 0; i < 10; ++i) {
+            const string query = GenerateQuery(generator, dictionary, 3) + " -"s
+                    + dictionary[uniform_int_distribution<size_t>(1,
+                            dictionary.size() - 1)(generator)];
+            const SearchServer::PreparedQuery prepared = server.Prepare(query);
+            for (const auto &[filter, predicate] : filters) {
+                for (const size_t top_k : { size_t(5), size_t(100) }) {
+                    const vector<Document> expected = FindTopDocumentsNaive(
+                            documents, stop_words, query, predicate, top_k);
+                    ASSERT_EQUAL_HINT(server.FindTopDocuments(query, predicate,
+                            top_k), expected, query);
+                    for (const EvaluationMode mode : {
+                            EvaluationMode::EXHAUSTIVE,
+                            EvaluationMode::PRUNED }) {
+                        ASSERT_EQUAL_HINT(server.FindTopDocuments(query,
+                                filter, top_k, mode), expected, query);
+                        ASSERT_EQUAL_HINT(server.FindTopDocuments(
+                                execution::par, query, filter, top_k, mode),
+                                expected, query);
+                        ASSERT_EQUAL_HINT(server.FindTopDocuments(prepared,
+                                filter, top_k, mode), expected, query);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// документы с минус-словами не попадают в результат, а исключение документа
+// в одном запросе не влияет на следующие запросы (накопители релевантности
+// потоков используются повторно)
+void TestMinusWords() {
+    {
+        SearchServer server("and"s);
+        server.AddDocument(1, "cat and dog"sv, DocumentStatus::ACTUAL, { 1 });
+        server.AddDocument(2, "cat and bird"sv, DocumentStatus::ACTUAL, { 2 });
+        server.AddDocument(3, "dog and bird"sv, DocumentStatus::ACTUAL, { 3 });
+        const auto find_ids = [&server](string_view query,
+                EvaluationMode mode) {
+            vector<int> ids;
+            for (const Document &document : server.FindTopDocuments(query,
+                    DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, mode)) {
+                ids.push_back(document.id);
+            }
+            sort(ids.begin(), ids.end());
+            return ids;
+        };
+        for (const EvaluationMode mode : { EvaluationMode::EXHAUSTIVE,
+                EvaluationMode::PRUNED }) {
+            ASSERT_EQUAL(find_ids("cat -dog"sv, mode), vector<int>( { 2 }));
+            ASSERT_EQUAL(find_ids("dog"sv, mode), vector<int>( { 1, 3 }));
+            ASSERT_EQUAL(find_ids("cat -cat"sv, mode), vector<int>());
+            ASSERT_EQUAL(find_ids("cat dog -bird"sv, mode),
+                    vector<int>( { 1 }));
+            ASSERT_EQUAL(find_ids("bird -mouse"sv, mode),
+                    vector<int>( { 2, 3 }));
+            ASSERT_EQUAL(find_ids("bird -and"sv, mode),
+                    vector<int>( { 2, 3 }));
+            ASSERT_EQUAL(find_ids("-cat -dog -bird"sv, mode), vector<int>());
+            ASSERT_EQUAL(get<0>(server.MatchDocument("cat -dog"sv, 1)),
+                    vector<string_view>());
+        }
+    }
+
+    mt19937 generator(24);
+    const vector<string> dictionary = GenerateDictionary(generator, 60, 3);
+    const set<string, less<>> stop_words = { dictionary[0] };
+    const vector<TestDocument> documents = GenerateTestDocuments(generator,
+            dictionary, 4000, 12);
+    SearchServer server(stop_words);
+    AddTestDocuments(server, documents);
+    const QueryExecutor executor(3);
+    for (int i = 0; i < 200; ++i) {
+        const string query = GenerateQuery(generator, dictionary, 5, 0.3);
+        for (const size_t top_k : { size_t(5), size_t(1000) }) {
+            const vector<Document> expected = FindTopDocumentsNaive(documents,
+                    stop_words, query, DocumentStatus::ACTUAL, top_k);
+            for (const EvaluationMode mode : { EvaluationMode::EXHAUSTIVE,
+                    EvaluationMode::PRUNED }) {
+                ASSERT_EQUAL_HINT(server.FindTopDocuments(query,
+                        DocumentStatus::ACTUAL, top_k, mode), expected, query);
+                ASSERT_EQUAL_HINT(server.FindTopDocuments(execution::par,
+                        query, DocumentStatus::ACTUAL, top_k, mode), expected,
+                        query);
+                ASSERT_EQUAL_HINT(server.FindTopDocuments(executor, query,
+                        DocumentStatus::ACTUAL, top_k, mode), expected, query);
+            }
+        }
+    }
+}
+
+// разобранный запрос используется только с той версией индекса, для которой
+// разобран: после изменения сервера, его копирования или присваивания
+// и на сервере, созданном по тому же адресу, он разбирается заново
+void TestPreparedQuery() {
+    const auto add_documents = [](SearchServer &server,
+            const vector<pair<int, string>> &documents) {
+        for (const auto &[id, text] : documents) {
+            server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+        }
+    };
+    const vector<pair<int, string>> pets = { { 1, "cat and dog"s }, { 2,
+            "dog and bird"s }, { 3, "cat"s } };
+    const vector<pair<int, string>> others = { { 7, "x y z"s }, { 8,
+            "dog and fish"s }, { 9, "dog dog rat"s } };
+    const string_view raw_query = "dog -bird"sv;
+    // результаты разобранного запроса совпадают с результатами текста
+    const auto check = [raw_query](const SearchServer &server,
+            const SearchServer::PreparedQuery &query, const string &hint) {
+        ASSERT_EQUAL_HINT(server.FindTopDocuments(query),
+                server.FindTopDocuments(raw_query), hint);
+        ASSERT_EQUAL_HINT(server.FindTopDocuments(execution::par, query,
+                DocumentStatus::ACTUAL, 5, EvaluationMode::PRUNED),
+                server.FindTopDocuments(raw_query), hint);
+        for (const int document_id : server) {
+            ASSERT_HINT(server.MatchDocument(query, document_id)
+                    == server.MatchDocument(raw_query, document_id), hint);
+        }
+    };
+
+    SearchServer server("and"s);
+    add_documents(server, pets);
+    SearchServer::PreparedQuery query = server.Prepare(raw_query);
+    ASSERT(server.IsCurrent(query));
+    check(server, query, "prepared"s);
+
+    server.AddDocument(4, "dog fish"sv, DocumentStatus::ACTUAL, { 4 });
+    ASSERT(!server.IsCurrent(query));
+    check(server, query, "after AddDocument"s);
+    ASSERT_EQUAL(server.FindTopDocuments(query).size(), 2u);
+    server.RemoveDocument(1);
+    ASSERT(!server.IsCurrent(query));
+    check(server, query, "after RemoveDocument"s);
+    server.Revalidate(query);
+    ASSERT(server.IsCurrent(query));
+    check(server, query, "revalidated"s);
+
+    // другой сервер и копия
+    SearchServer other("and"s);
+    add_documents(other, others);
+    ASSERT(!other.IsCurrent(query));
+    check(other, query, "other server"s);
+    const SearchServer copy = server;
+    ASSERT(!copy.IsCurrent(query));
+    check(copy, query, "copy"s);
+
+    // присваивание: у нового сервера столько же изменений (5), сколько было
+    // у прежнего, когда запрос был разобран
+    query = server.Prepare(raw_query);
+    server = SearchServer("and"s);
+    ASSERT(!server.IsCurrent(query));
+    add_documents(server, others);
+    server.RemoveDocument(7);
+    server.UpdateInverseDocumentFreqs();
+    ASSERT(!server.IsCurrent(query));
+    check(server, query, "after move assignment"s);
+    ASSERT_EQUAL(server.FindTopDocuments(query).size(), 2u);
+    query = server.Prepare(raw_query);
+    server = other;
+    ASSERT(!server.IsCurrent(query));
+    check(server, query, "after copy assignment"s);
+
+    // сервер, созданный по адресу уничтоженного
+    optional<SearchServer> reused;
+    reused.emplace("and"s);
+    add_documents(*reused, pets);
+    query = reused->Prepare(raw_query);
+    const SearchServer *const address = &*reused;
+    reused.reset();
+    reused.emplace("and"s);
+    ASSERT(&*reused == address);
+    add_documents(*reused, others);
+    ASSERT(!reused->IsCurrent(query));
+    check(*reused, query, "same address"s);
+
+    // кеш результатов сервера, которому присвоен другой сервер
+    SearchServer cached_server("and"s);
+    add_documents(cached_server, pets);
+    QueryResultCache cache(cached_server, 16);
+    ASSERT_EQUAL(cache.FindTopDocuments(raw_query),
+            cached_server.FindTopDocuments(raw_query));
+    SearchServer replacement("and"s);
+    add_documents(replacement, others);
+    cached_server = move(replacement);
+    ASSERT_EQUAL(cache.FindTopDocuments(raw_query),
+            cached_server.FindTopDocuments(raw_query));
+    ASSERT_EQUAL(cache.GetStats().hits, 0u);
+}
+
+// дубликаты - документы с тем же набором слов (порядок, повторы и стоп-слова
+// не важны), почти-дубликаты - с близким набором слов; остаётся документ
+// с меньшим id
+void TestRemoveDuplicates() {
+    SearchServer server("and with"s);
+    server.AddDocument(1, "funny pet and nasty rat"sv, DocumentStatus::ACTUAL,
+            { 1 });
+    server.AddDocument(2, "funny pet with curly hair"sv,
+            DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(3, "funny pet with curly hair"sv,
+            DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(4, "funny pet and curly hair"sv,
+            DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(5, "funny funny pet and nasty nasty rat"sv,
+            DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(6, "funny pet and not very nasty rat"sv,
+            DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(7, "very nasty rat and not very funny pet"sv,
+            DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(8, "pet with rat and rat and rat"sv,
+            DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(9, "nasty rat with curly hair"sv,
+            DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(FindDuplicates(server), vector<int>( { 3, 4, 5, 7 }));
+    // сообщения об удалённых дубликатах не смешиваются с выводом примеров
+    ostringstream removal_log;
+    streambuf *const cout_buffer = cout.rdbuf(removal_log.rdbuf());
+    RemoveDuplicates(server);
+    ASSERT_EQUAL(vector<int>(server.begin(), server.end()),
+            vector<int>( { 1, 2, 6, 8, 9 }));
+
+    // базовые документы - по 20 разных слов из большого словаря, варианты
+    // отличаются от базового одним словом (коэффициент Жаккара с базовым -
+    // 19/21, между собой - не меньше 18/22)
+    mt19937 generator(16);
+    vector<string> dictionary = GenerateDictionary(generator, 5000, 8);
+    sort(dictionary.begin(), dictionary.end());
+    dictionary.erase(unique(dictionary.begin(), dictionary.end()),
+            dictionary.end());
+    shuffle(dictionary.begin(), dictionary.end(), generator);
+    SearchServer near_server("and"s);
+    vector<int> expected_ids;
+    vector<int> base_ids;
+    int id = 0;
+    size_t next_word = 0;
+    for (int base = 0; base < 50; ++base) {
+        vector<string> words(dictionary.begin() + next_word,
+                dictionary.begin() + next_word + 20);
+        next_word += 20;
+        string text;
+        for (const string &word : words) {
+            text += word + ' ';
+        }
+        base_ids.push_back(++id);
+        near_server.AddDocument(id, text, DocumentStatus::ACTUAL, { 1 });
+        for (int variant = 0; variant < base % 4; ++variant) {
+            vector<string> variant_words = words;
+            variant_words[uniform_int_distribution(0, 19)(generator)] =
+                    dictionary[next_word++];
+            shuffle(variant_words.begin(), variant_words.end(), generator);
+            string variant_text;
+            for (const string &word : variant_words) {
+                variant_text += word + ' ';
+            }
+            expected_ids.push_back(++id);
+            near_server.AddDocument(id, variant_text, DocumentStatus::ACTUAL,
+                    { 1 });
+        }
+    }
+    ASSERT_EQUAL(FindNearDuplicates(near_server, 0.6), expected_ids);
+    ASSERT_EQUAL(FindNearDuplicates(near_server, 0.95), vector<int>());
+    RemoveNearDuplicates(near_server, 0.6);
+    cout.rdbuf(cout_buffer);
+    ASSERT_EQUAL(vector<int>(near_server.begin(), near_server.end()),
+            base_ids);
+}
+
+void TestSearchServer() {
+    RUN_TEST(TestDocumentIdsInRandomOrder);
+    RUN_TEST(TestTopDocumentsMatchFullSort);
+    RUN_TEST(TestScoreAccumulatorReuse);
+    RUN_TEST(TestPrunedMatchesExhaustive);
+    RUN_TEST(TestPostingListCursor);
+    RUN_TEST(TestSplitIntoWordsVariants);
+    RUN_TEST(TestStopWordSet);
+    RUN_TEST(TestSnapshotResave);
+    RUN_TEST(TestShardedMatchesSingleServer);
+    RUN_TEST(TestVersionedSearchServer);
+    RUN_TEST(TestConcurrentMap);
+    RUN_TEST(TestLatencyHistogram);
+    RUN_TEST(TestRequestStatistics);
+    RUN_TEST(TestRequestQueue);
+#ifdef SEARCH_SERVER_METRICS
+    RUN_TEST(TestSearchMetrics);
+#endif
+    RUN_TEST(TestQueryExecutor);
+    RUN_TEST(TestQueryResultCacheInvalidation);
+    RUN_TEST(TestInverseDocumentFreqsAfterWrites);
+    RUN_TEST(TestCompactIndex);
+    RUN_TEST(TestWordFrequencies);
+    RUN_TEST(TestDocumentFilter);
+    RUN_TEST(TestMinusWords);
+    RUN_TEST(TestPreparedQuery);
+    RUN_TEST(TestRemoveDuplicates);
+}
+
 #define TEST(policy) Test(#policy, search_server, queries, execution::policy)
+#define TEST_PRUNED(policy) Test(#policy " pruned", search_server, queries, \
+        execution::policy, EvaluationMode::PRUNED)
 void main_test() {
+    TestSearchServer();
     mt19937 generator;
     const auto dictionary = GenerateDictionary(generator, 1000, 10);
     const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
     SearchServer search_server(dictionary[0]);
+    {
+        LOG_DURATION("AddDocument");
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(static_cast<int>(i), documents[i],
+                    DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+    }
+    vector<DocumentToAdd> batch;
+    batch.reserve(documents.size());
     for (size_t i = 0; i < documents.size(); ++i) {
-        search_server.AddDocument(static_cast<int>(i), documents[i],
-                DocumentStatus::ACTUAL, { 1, 2, 3 });
+        batch.push_back( { static_cast<int>(i), documents[i],
+                DocumentStatus::ACTUAL, { 1, 2, 3 } });
+    }
+    {
+        SearchServer batch_server(dictionary[0]);
+        LOG_DURATION("AddDocuments seq");
+        batch_server.AddDocuments(execution::seq, batch);
     }
+    {
+        SearchServer batch_server(dictionary[0]);
+        LOG_DURATION("AddDocuments par");
+        batch_server.AddDocuments(execution::par, batch);
+    }
+    {
+        // подсчёт слов документов в несколько потоков
+        ConcurrentMap<string, int> word_counts(64);
+        {
+            LOG_DURATION("ConcurrentMap word counts");
+            for_each(execution::par, documents.begin(), documents.end(),
+                    [&word_counts](const string &document) {
+                        for (const string_view word : SplitIntoWords(
+                                document)) {
+                            word_counts.Add(string(word), 1);
+                        }
+                    });
+        }
+        const auto counts = word_counts.BuildSortedVector();
+        cout << "distinct words: "s << counts.size() << ", total: "s
+                << accumulate(counts.begin(), counts.end(), 0,
+                        [](int sum, const auto &item) {
+                            return sum + item.second;
+                        }) << endl;
+    }
+    {
+        SearchServer static_server(STATIC_STOP_WORDS);
+        static_server.AddDocument(0, "cat with collar in the city"sv,
+                DocumentStatus::ACTUAL, { 1 });
+        // количество вхождений, не помещающееся в 16 бит прямого индекса
+        string long_text = "rat"s;
+        for (int i = 0; i < 70'000; ++i) {
+            long_text += " cat"s;
+        }
+        static_server.AddDocument(1, long_text, DocumentStatus::ACTUAL, { 1 });
+        const WordFrequencies word_frequencies =
+                static_server.GetWordFrequencies(0);
+        cout << "words without stop words: "s << word_frequencies.size()
+                << ", TF of cat: "s << word_frequencies.Get("cat"sv)
+                << ", in long document: "s
+                << static_server.GetWordFrequencies(1).Get("cat"sv) * 70'001
+                << endl;
+    }
+    {
+        SearchServer duplicates_server("and with"s);
+        int id = 0;
+        for (const string_view text : { "funny pet and nasty rat"sv,
+                "funny pet with curly hair"sv, "funny pet with curly hair"sv,
+                "funny pet and curly hair"sv,
+                "funny funny pet and nasty nasty rat"sv,
+                "funny pet and not very nasty rat"sv }) {
+            duplicates_server.AddDocument(++id, text, DocumentStatus::ACTUAL,
+                    { 1 });
+        }
+        RemoveDuplicates(duplicates_server);
+        RemoveNearDuplicates(duplicates_server, 0.6);
+        cout << "documents after removing duplicates: "s
+                << duplicates_server.GetDocumentCount() << endl;
+    }
+    {
+        LOG_DURATION("FindDuplicates");
+        cout << FindDuplicates(search_server).size() << endl;
+    }
+    {
+        LOG_DURATION("FindNearDuplicates");
+        cout << FindNearDuplicates(search_server, 0.5).size() << endl;
+    }
+    cout << "index memory: "s << search_server.GetIndexMemoryUsage()
+            << " bytes"s << endl;
     const auto queries = GenerateQueries(generator, dictionary, 100, 70);
     TEST(seq);
     TEST(par);
+    TEST_PRUNED(seq);
+    TEST_PRUNED(par);
+    {
+        // 70% документов - действительные, рейтинги от 0 до 9
+        SearchServer filtered_server(dictionary[0]);
+        vector<DocumentToAdd> filtered_batch = batch;
+        for (size_t i = 0; i < filtered_batch.size(); ++i) {
+            filtered_batch[i].status = i % 10 < 7 ? DocumentStatus::ACTUAL :
+                    DocumentStatus::IRRELEVANT;
+            filtered_batch[i].ratings = { static_cast<int>(i % 10) };
+        }
+        filtered_server.AddDocuments(filtered_batch);
+        const DocumentFilter filter = DocumentFilter(DocumentStatus::ACTUAL)
+                .SetRatingRange(3, 6);
+        for (const bool use_filter : { true, false }) {
+            LOG_DURATION(use_filter ? "DocumentFilter"s : "lambda filter"s);
+            double total_relevance = 0;
+            for (const string_view query : queries) {
+                const vector<Document> found = use_filter ?
+                        filtered_server.FindTopDocuments(query, filter) :
+                        filtered_server.FindTopDocuments(query,
+                                [](int /*document_id*/,
+                                        DocumentStatus status, int rating) {
+                                    return status == DocumentStatus::ACTUAL
+                                            && rating >= 3 && rating <= 6;
+                                });
+                for (const auto &document : found) {
+                    total_relevance += document.relevance;
+                }
+            }
+            cout << total_relevance << endl;
+        }
+    }
+    {
+        // запросы с минус-словами (каждое слово - минус-слово с вероятностью
+        // 0.3): документы с минус-словами исключаются до подсчёта релевантности
+        vector<string> minus_queries;
+        for (int i = 0; i < 100; ++i) {
+            minus_queries.push_back(GenerateQuery(generator, dictionary, 70,
+                    0.3));
+        }
+        Test("minus words"s, search_server, minus_queries, execution::seq);
+        Test("minus words pruned"s, search_server, minus_queries,
+                execution::seq, EvaluationMode::PRUNED);
+    }
+    {
+        // запросы, разобранные один раз, выполняются многократно без разбора
+        vector<SearchServer::PreparedQuery> prepared_queries;
+        prepared_queries.reserve(queries.size());
+        for (const string &query : queries) {
+            prepared_queries.push_back(search_server.Prepare(query));
+        }
+        for (const bool use_prepared : { false, true }) {
+            LOG_DURATION(use_prepared ? "prepared queries"s : "raw queries"s);
+            double total_relevance = 0;
+            for (int pass = 0; pass < 10; ++pass) {
+                for (size_t i = 0; i < queries.size(); ++i) {
+                    const vector<Document> found = use_prepared ?
+                            search_server.FindTopDocuments(prepared_queries[i]) :
+                            search_server.FindTopDocuments(queries[i]);
+                    for (const auto &document : found) {
+                        total_relevance += document.relevance;
+                    }
+                }
+            }
+            cout << total_relevance / 10 << endl;
+        }
+        size_t found_count = 0;
+        for (const auto &found : ProcessQueries(search_server,
+                prepared_queries)) {
+            found_count += found.size();
+        }
+        cout << "prepared ProcessQueries: "s << found_count << endl;
+
+        // после изменения индекса запрос разбирается заново
+        SearchServer small_server("and"s);
+        small_server.AddDocument(1, "white cat"sv, DocumentStatus::ACTUAL,
+                { 1 });
+        SearchServer::PreparedQuery query = small_server.Prepare("cat dog"sv);
+        small_server.AddDocument(2, "black dog"sv, DocumentStatus::ACTUAL,
+                { 1 });
+        const bool is_current = small_server.IsCurrent(query);
+        const size_t stale_found =
+                small_server.FindTopDocuments(query).size();
+        small_server.Revalidate(query);
+        cout << "prepared query current: "s << is_current << ", found: "s
+                << stale_found << ", revalidated: "s
+                << small_server.IsCurrent(query) << ", matched: "s
+                << get<0>(small_server.MatchDocument(query, 2)).size()
+                << endl;
+    }
+    const QueryExecutor executor;
+    cout << "executor threads: "s << executor.GetConcurrency() << endl;
+    Test("executor", search_server, queries, executor);
+    {
+        LOG_DURATION("ProcessQueriesJoined");
+        cout << ProcessQueriesJoined(executor, search_server, queries).size()
+                << endl;
+    }
+    {
+        QueryResultCache cache(search_server, queries.size() * 4);
+        for (const string &mark : { "cache miss"s, "cache hit"s }) {
+            LOG_DURATION(mark);
+            double total_relevance = 0;
+            for (const string_view query : queries) {
+                for (const auto &document : cache.FindTopDocuments(query)) {
+                    total_relevance += document.relevance;
+                }
+            }
+            cout << total_relevance << endl;
+        }
+        const QueryResultCache::Stats stats = cache.GetStats();
+        cout << "cache hits: "s << stats.hits << ", misses: "s << stats.misses
+                << ", evictions: "s << stats.evictions << endl;
+    }
+
+    {
+        RequestQueue request_queue(search_server);
+        for (int i = 0; i < 1439; ++i) {
+            request_queue.AddFindRequest("empty request"s);
+        }
+        // запросы из нескольких потоков вытесняют из окна первые 100 пустых
+        for_each(execution::par, queries.begin(), queries.end(),
+                [&request_queue](const string &query) {
+                    request_queue.AddFindRequest(query,
+                            DocumentStatus::ACTUAL);
+                });
+        cout << "no result requests: "s << request_queue.GetNoResultRequests()
+                << endl;
+        const RequestStatistics::Stats stats = request_queue.GetStats();
+        cerr << "requests: "s << stats.request_count << ", queries/s: "s
+                << static_cast<int64_t>(stats.queries_per_second)
+                << ", p50: "s << stats.latencies.GetPercentile(0.5).count()
+                << " ns, p99: "s
+                << stats.latencies.GetPercentile(0.99).count() << " ns"s
+                << endl;
+    }
+    {
+        // удаление каждого 20-го документа: с порогом по умолчанию документы
+        // только отмечаются удалёнными, с порогом 0 списки очищаются сразу;
+        // результаты поиска должны совпадать
+        SearchServer tombstone_server = search_server;
+        SearchServer eager_server = search_server;
+        eager_server.SetCompactionThreshold(0.0);
+        for (auto [mark, server] : { pair { "RemoveDocument tombstones"s,
+                &tombstone_server }, pair { "RemoveDocument eager"s,
+                &eager_server } }) {
+            LOG_DURATION(mark);
+            for (int id = 0; id < static_cast<int>(documents.size());
+                    id += 20) {
+                server->RemoveDocument(id);
+            }
+        }
+        Test("after removal"s, tombstone_server, queries, execution::seq);
+        Test("after removal pruned"s, tombstone_server, queries,
+                execution::seq, EvaluationMode::PRUNED);
+        Test("after eager removal"s, eager_server, queries, execution::seq);
+        tombstone_server.CompactIndex();
+        cout << "documents after removal: "s
+                << tombstone_server.GetDocumentCount() << endl;
+    }
+    TestConcurrentIngestion(batch, dictionary[0], queries);
+
+    ShardedSearchServer sharded_server(4, dictionary[0]);
+    sharded_server.AddDocuments(batch);
+    {
+        LOG_DURATION("sharded");
+        double total_relevance = 0;
+        for (const string_view query : queries) {
+            for (const auto &document : sharded_server.FindTopDocuments(
+                    query)) {
+                total_relevance += document.relevance;
+            }
+        }
+        cout << total_relevance << endl;
+    }
+#ifdef SEARCH_SERVER_METRICS
+    SearchMetrics::WritePrometheus(cerr);
+#endif
 }
@@ -1,5 +1,68 @@
 #pragma once
 
+#include <cstdlib>
+#include <iostream>
 #include <string>
+#include <vector>
+
+using namespace std;
+
+// Юнит-тесты: ASSERT* прерывают программу с сообщением о месте ошибки,
+// RUN_TEST выполняет тест и сообщает о нём в cerr
+
+template<typename Element>
+ostream& operator<<(ostream &out, const vector<Element> &container) {
+    out << '[';
+    bool is_first = true;
+    for (const Element &element : container) {
+        if (!is_first) {
+            out << ", "s;
+        }
+        is_first = false;
+        out << element;
+    }
+    return out << ']';
+}
+
+template<typename T, typename U>
+void AssertEqualImpl(const T &t, const U &u, const string &t_str,
+        const string &u_str, const string &file, const string &func,
+        unsigned line, const string &hint) {
+    if (t != u) {
+        cerr << boolalpha;
+        cerr << file << "("s << line << "): "s << func << ": "s;
+        cerr << "ASSERT_EQUAL("s << t_str << ", "s << u_str << ") failed: "s;
+        cerr << t << " != "s << u << "."s;
+        if (!hint.empty()) {
+            cerr << " Hint: "s << hint;
+        }
+        cerr << endl;
+        abort();
+    }
+}
+
+#define ASSERT_EQUAL(a, b) AssertEqualImpl((a), (b), #a, #b, __FILE__, \
+        __FUNCTION__, __LINE__, ""s)
+#define ASSERT_EQUAL_HINT(a, b, hint) AssertEqualImpl((a), (b), #a, #b, \
+        __FILE__, __FUNCTION__, __LINE__, (hint))
+
+void AssertImpl(bool value, const string &expr_str, const string &file,
+        const string &func, unsigned line, const string &hint);
+
+#define ASSERT(expr) AssertImpl(!!(expr), #expr, __FILE__, __FUNCTION__, \
+        __LINE__, ""s)
+#define ASSERT_HINT(expr, hint) AssertImpl(!!(expr), #expr, __FILE__, \
+        __FUNCTION__, __LINE__, (hint))
+
+template<typename TestFunc>
+void RunTestImpl(const TestFunc &func, const string &test_name) {
+    func();
+    cerr << test_name << " OK"s << endl;
+}
+
+#define RUN_TEST(func) RunTestImpl((func), #func)
+
+// все юнит-тесты поискового сервера
+void TestSearchServer();
 
 void main_test();
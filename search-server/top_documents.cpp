@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "top_documents.h"
+
+using namespace std;
+
+TopDocuments::TopDocuments(size_t capacity) :
+        capacity_(capacity) {
+    documents_.reserve(capacity);
+}
+
+/**
+ * @brief Добавляет документ в отбор
+ *
+ *  Если отбор заполнен, документ вытесняет худший из отобранных
+ *  (если он лучше него).
+ *
+ * @param document Найденный документ
+ */
+void TopDocuments::Add(const Document &document) {
+    if (!IsCandidate(document)) {
+        return;
+    }
+    if (IsFull()) {
+        pop_heap(documents_.begin(), documents_.end(), IsBetter);
+        documents_.back() = document;
+    } else {
+        documents_.push_back(document);
+    }
+    push_heap(documents_.begin(), documents_.end(), IsBetter);
+}
+
+void TopDocuments::Merge(const TopDocuments &other) {
+    for (const Document &document : other.documents_) {
+        Add(document);
+    }
+}
+
+bool TopDocuments::IsCandidate(const Document &document) const {
+    if (capacity_ == 0) {
+        return false;
+    }
+    return !IsFull() || IsBetter(document, GetWorst());
+}
+
+double TopDocuments::GetMinCompetitiveRelevance() const {
+    if (capacity_ == 0) {
+        return numeric_limits<double>::infinity();
+    }
+    if (!IsFull()) {
+        return -numeric_limits<double>::infinity();
+    }
+    // при разнице релевантностей меньше MIN_DELTA_RELEVANCE документ
+    // ещё может оказаться выше за счёт рейтинга
+    return GetWorst().relevance - MIN_DELTA_RELEVANCE;
+}
+
+vector<Document> TopDocuments::Extract() {
+    sort_heap(documents_.begin(), documents_.end(), IsBetter);
+    return move(documents_);
+}
+
+bool TopDocuments::IsBetter(const Document &lhs, const Document &rhs) {
+    if (abs(lhs.relevance - rhs.relevance) >= MIN_DELTA_RELEVANCE) {
+        return lhs.relevance > rhs.relevance;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.id < rhs.id;
+}
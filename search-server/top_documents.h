@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+#include "document.h"
+
+using namespace std;
+
+/**
+ * @brief Отбор K лучших документов поисковой выдачи
+ *
+ *  Хранит не больше K документов в куче, на вершине которой худший из
+ *  отобранных, поэтому добавление документа - O(log K), а не сортировка всех
+ *  найденных документов. Документы сравниваются по убыванию релевантности,
+ *  затем рейтинга, затем по возрастанию id (чтобы выдача не зависела от
+ *  порядка добавления документов).
+ *  Частичные результаты нескольких потоков объединяются методом Merge.
+ */
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t capacity);
+
+    void Add(const Document &document);
+
+    // добавляет в отбор документы другого отбора
+    void Merge(const TopDocuments &other);
+
+    // true, если документ попадёт в отбор
+    bool IsCandidate(const Document &document) const;
+
+    bool IsFull() const {
+        return documents_.size() == capacity_;
+    }
+
+    // худший из отобранных документов (отбор не пуст)
+    const Document& GetWorst() const {
+        return documents_.front();
+    }
+
+    // документ с релевантностью меньше этого значения в отбор не попадёт
+    // (-inf, пока отбор не заполнен)
+    double GetMinCompetitiveRelevance() const;
+
+    // возвращает отобранные документы, отсортированные от лучшего к худшему
+    vector<Document> Extract();
+
+    // true, если документ lhs должен стоять в выдаче выше документа rhs
+    static bool IsBetter(const Document &lhs, const Document &rhs);
+
+private:
+    size_t capacity_;
+    vector<Document> documents_;  // куча, на вершине - худший документ
+};
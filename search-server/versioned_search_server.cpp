@@ -0,0 +1,189 @@
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "string_processing.h"
+#include "versioned_search_server.h"
+
+using namespace std;
+
+VersionedSearchServer::VersionedSearchServer(string stop_words_text) :
+        VersionedSearchServer(SplitIntoWords(stop_words_text)) {
+}
+
+VersionedSearchServer::VersionedSearchServer(string_view stop_words_text) :
+        VersionedSearchServer(SplitIntoWords(stop_words_text)) {
+}
+
+VersionedSearchServer::VersionedSearchServer(SearchServer search_server) :
+        current_slot_(make_shared<VersionSlot>(move(search_server))) {
+    current_ = MakeVersion(current_slot_);
+}
+
+/**
+ * @brief Текущая версия индекса
+ *
+ *  Версия не изменяется, пока на неё есть указатель; данные, на которые
+ *  ссылаются результаты MatchDocument и GetWordFrequencies версии,
+ *  действительны, пока указатель не освобождён.
+ */
+VersionedSearchServer::Version VersionedSearchServer::GetVersion() const {
+    return atomic_load(&current_);
+}
+
+/**
+ * @brief Добавляет документ и публикует новую версию
+ *
+ *  Текст документа копируется: он нужен для повторного добавления
+ *  в запасную копию.
+ */
+void VersionedSearchServer::AddDocument(int document_id, string_view document,
+        DocumentStatus status, const vector<int> &ratings) {
+    Update([document_id, text = string(document), status, ratings](
+            SearchServer &search_server) {
+        search_server.AddDocument(document_id, text, status, ratings);
+    });
+}
+
+/**
+ * @brief Добавляет пакет документов и публикует новую версию
+ *
+ * @param documents Пакет документов
+ * @return Документы, которые не удалось добавить (см. SearchServer::AddDocuments)
+ */
+vector<AddDocumentError> VersionedSearchServer::AddDocuments(
+        const vector<DocumentToAdd> &documents) {
+    // тексты пакета принадлежат изменению (DocumentToAdd ссылается на текст)
+    auto texts = make_shared<vector<string>>();
+    texts->reserve(documents.size());
+    auto batch = make_shared<vector<DocumentToAdd>>(documents);
+    for (DocumentToAdd &document : *batch) {
+        document.text = texts->emplace_back(document.text);
+    }
+
+    vector<AddDocumentError> errors;
+    Apply([&batch, &errors](SearchServer &search_server) {
+        errors = search_server.AddDocuments(execution::par, *batch);
+    }, [texts, batch](SearchServer &search_server) {
+        search_server.AddDocuments(execution::par, *batch);
+    });
+    return errors;
+}
+
+void VersionedSearchServer::RemoveDocument(int document_id) {
+    Update([document_id](SearchServer &search_server) {
+        search_server.RemoveDocument(document_id);
+    });
+}
+
+void VersionedSearchServer::RemoveDocuments(const vector<int> &document_ids) {
+    Update([document_ids](SearchServer &search_server) {
+        search_server.RemoveDocuments(execution::par, document_ids);
+    });
+}
+
+void VersionedSearchServer::Update(function<void(SearchServer&)> updater) {
+    Apply(updater, updater);
+}
+
+vector<Document> VersionedSearchServer::FindTopDocuments(
+        string_view raw_query) const {
+    return GetVersion()->FindTopDocuments(raw_query);
+}
+
+vector<Document> VersionedSearchServer::FindTopDocuments(string_view raw_query,
+        DocumentStatus status, size_t top_k, EvaluationMode mode) const {
+    return GetVersion()->FindTopDocuments(raw_query, status, top_k, mode);
+}
+
+size_t VersionedSearchServer::GetDocumentCount() const {
+    return GetVersion()->GetDocumentCount();
+}
+
+VersionedSearchServer::Stats VersionedSearchServer::GetStats() const {
+    Stats stats;
+    stats.versions = version_count_.load();
+    stats.copies = copy_count_.load();
+    return stats;
+}
+
+/**
+ * @brief Указатель читателей на сервер версии
+ *
+ *  Указатель не владеет сервером (им владеет slot): его освобождение
+ *  (последней копии) только отмечает slot отпущенным и будит писателя.
+ *  Ссылка на slot хранится в функции освобождения, поэтому сервер
+ *  не удаляется, пока указатель существует.
+ */
+VersionedSearchServer::Version VersionedSearchServer::MakeVersion(
+        const shared_ptr<VersionSlot> &slot) {
+    return Version(&slot->server, [slot](const SearchServer*) {
+        lock_guard lock(slot->released_mutex);
+        slot->is_released = true;
+        slot->released_condition.notify_all();
+    });
+}
+
+/**
+ * @brief Готовит запасную копию к изменению
+ *
+ *  Запасную копию (прежнюю версию) новые читатели получить уже не могут,
+ *  так как она не текущая, поэтому писатель ждёт (не дольше
+ *  MAX_SPARE_WAIT), пока её отпустят читатели, начавшие запросы до
+ *  публикации текущей версии. Затем в ней повторяются изменения,
+ *  опубликованные после неё. Если копию так и не отпустили (или запасной
+ *  копии нет), копируется текущая версия, а прежняя удаляется, когда её
+ *  отпустит последний читатель. Вызывается под мьютексом писателя.
+ *
+ * @return Копия сервера, совпадающая с текущей версией
+ */
+shared_ptr<VersionedSearchServer::VersionSlot>
+VersionedSearchServer::AcquireSpare() {
+    bool is_released = false;
+    if (spare_) {
+        unique_lock lock(spare_->released_mutex);
+        // захват мьютекса после освобождения версии последним читателем:
+        // изменения, сделанные читателями (обновление IDF), видны писателю
+        is_released = spare_->released_condition.wait_for(lock,
+                MAX_SPARE_WAIT, [this] {
+                    return spare_->is_released;
+                });
+        spare_->is_released = false;
+    }
+    if (is_released) {
+        for (const auto &replay : pending_updates_) {
+            replay(spare_->server);
+        }
+    } else {
+        spare_ = make_shared<VersionSlot>(current_slot_->server);
+        ++copy_count_;
+    }
+    pending_updates_.clear();
+    return move(spare_);
+}
+
+/**
+ * @brief Изменяет сервер и публикует новую версию
+ *
+ *  Изменение выполняется в запасной копии, там же до публикации обновляется
+ *  таблица IDF, чтобы первые запросы к версии не ждали её обновления. Если
+ *  изменение выбрасывает исключение, текущая версия остаётся прежней,
+ *  а запасная копия (возможно, изменённая частично) удаляется.
+ *
+ * @param updater Изменение
+ * @param replay  То же изменение для повторения в прежней версии
+ */
+void VersionedSearchServer::Apply(const function<void(SearchServer&)> &updater,
+        function<void(SearchServer&)> replay) {
+    lock_guard lock(writer_mutex_);
+    shared_ptr<VersionSlot> next = AcquireSpare();
+    updater(next->server);
+    next->server.UpdateInverseDocumentFreqTable();
+
+    atomic_store(&current_, MakeVersion(next));
+    spare_ = exchange(current_slot_, move(next));
+    pending_updates_.push_back(move(replay));
+    ++version_count_;
+}
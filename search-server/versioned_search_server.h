@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+using namespace std;
+
+// наибольшее время, которое писатель ждёт, пока читатели отпустят прежнюю
+// версию, прежде чем скопировать текущую
+const chrono::milliseconds MAX_SPARE_WAIT(100);
+
+/**
+ * @brief Поисковый сервер, поиск в котором не останавливается на время
+ *        изменения документов
+ *
+ *  Читатели работают с неизменяемой версией индекса: GetVersion атомарно
+ *  берёт указатель на текущую версию (shared_ptr), и пока указатель
+ *  не освобождён, версия не изменяется и не удаляется. Изменения
+ *  выполняются по одному (мьютекс писателя) во второй копии сервера, после
+ *  чего она атомарно публикуется как текущая версия, а прежняя версия
+ *  становится запасной копией. Следующее изменение ждёт, пока читатели
+ *  отпустят запасную копию (не дольше MAX_SPARE_WAIT), и повторяет в ней
+ *  изменения, которых в ней нет; если копию держат дольше, она создаётся
+ *  копированием текущей версии.
+ *  Указатели читателей на версию разделяют один счётчик ссылок, при
+ *  освобождении последнего из них версия под мьютексом отмечается
+ *  отпущенной, и писатель, ожидающий её, просыпается: всё, что читатели
+ *  сделали с версией, видно писателю (освобождение - захват мьютекса).
+ *  Память версии освобождается, когда её отпустили и читатели, и писатель.
+ *
+ *  Поиск (FindTopDocuments, GetDocumentCount) не ждёт писателя: запрос
+ *  выполняется в версии, текущей на момент его начала. Результаты,
+ *  ссылающиеся на данные сервера (MatchDocument, GetWordFrequencies),
+ *  действительны, пока удерживается версия, поэтому они доступны только
+ *  через GetVersion.
+ */
+class VersionedSearchServer {
+public:
+    // счётчики изменений сервера
+    struct Stats {
+        uint64_t versions = 0;  // опубликованные версии
+        uint64_t copies = 0;    // копирования сервера (запасная копия была
+                                // занята читателями)
+    };
+
+    // неизменяемая версия индекса
+    using Version = shared_ptr<const SearchServer>;
+
+    template<typename StringContainer>
+    explicit VersionedSearchServer(const StringContainer &stop_words);
+
+    explicit VersionedSearchServer(string stop_words_text);
+    explicit VersionedSearchServer(string_view stop_words_text);
+    explicit VersionedSearchServer(SearchServer search_server);
+
+    // текущая версия индекса
+    Version GetVersion() const;
+
+    void AddDocument(int document_id, string_view document,
+            DocumentStatus status, const vector<int> &ratings);
+
+    vector<AddDocumentError> AddDocuments(
+            const vector<DocumentToAdd> &documents);
+
+    void RemoveDocument(int document_id);
+
+    void RemoveDocuments(const vector<int> &document_ids);
+
+    // выполняет несколько изменений и публикует их одной версией.
+    // updater вызывается для двух копий сервера (второй раз - позже,
+    // при следующем изменении), поэтому он должен изменять сервер одинаково
+    // при каждом вызове и не ссылаться на данные, которые могут быть
+    // освобождены до этого
+    void Update(function<void(SearchServer&)> updater);
+
+    vector<Document> FindTopDocuments(string_view raw_query) const;
+    template<typename ExecutionPolicy>
+    vector<Document> FindTopDocuments(const ExecutionPolicy &policy,
+            string_view raw_query) const;
+
+    vector<Document> FindTopDocuments(string_view raw_query,
+            DocumentStatus status, size_t top_k = MAX_RESULT_DOCUMENT_COUNT,
+            EvaluationMode mode = EvaluationMode::EXHAUSTIVE) const;
+    template<typename ExecutionPolicy>
+    vector<Document> FindTopDocuments(const ExecutionPolicy &policy,
+            string_view raw_query, DocumentStatus status, size_t top_k =
+                    MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
+
+    template<typename DocumentPredicate>
+    vector<Document> FindTopDocuments(string_view raw_query,
+            DocumentPredicate document_predicate, size_t top_k =
+                    MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
+    template<typename ExecutionPolicy, typename DocumentPredicate>
+    vector<Document> FindTopDocuments(const ExecutionPolicy &policy,
+            string_view raw_query, DocumentPredicate document_predicate,
+            size_t top_k = MAX_RESULT_DOCUMENT_COUNT, EvaluationMode mode =
+                    EvaluationMode::EXHAUSTIVE) const;
+
+    size_t GetDocumentCount() const;
+
+    Stats GetStats() const;
+
+private:
+    // сервер версии и признак того, что читатели его отпустили
+    struct VersionSlot {
+        explicit VersionSlot(SearchServer search_server) :
+                server(move(search_server)) {
+        }
+
+        SearchServer server;
+        mutex released_mutex;
+        condition_variable released_condition;
+        // указатели читателей (Version) на сервер освобождены
+        bool is_released = false;
+    };
+
+    // текущая версия (читается и заменяется через atomic_load/atomic_store)
+    shared_ptr<const SearchServer> current_;
+
+    mutex writer_mutex_;
+    // сервер текущей версии
+    shared_ptr<VersionSlot> current_slot_;
+    // запасная копия: прежняя версия, в которой нет изменений pending_updates_
+    shared_ptr<VersionSlot> spare_;
+    vector<function<void(SearchServer&)>> pending_updates_;
+
+    atomic<uint64_t> version_count_ { 0 };
+    atomic<uint64_t> copy_count_ { 0 };
+
+    // указатель читателей на сервер slot: освобождение последнего из них
+    // отмечает slot отпущенным
+    static Version MakeVersion(const shared_ptr<VersionSlot> &slot);
+
+    // запасная копия, совпадающая с текущей версией
+    shared_ptr<VersionSlot> AcquireSpare();
+
+    // изменяет запасную копию (updater) и публикует её; replay повторяет
+    // то же изменение в прежней версии при следующем изменении
+    void Apply(const function<void(SearchServer&)> &updater,
+            function<void(SearchServer&)> replay);
+};
+
+// Шаблонные функции
+
+template<typename StringContainer>
+VersionedSearchServer::VersionedSearchServer(const StringContainer &stop_words) :
+        VersionedSearchServer(SearchServer(stop_words)) {
+}
+
+template<typename ExecutionPolicy, typename DocumentPredicate>
+vector<Document> VersionedSearchServer::FindTopDocuments(
+        const ExecutionPolicy &policy, string_view raw_query,
+        DocumentPredicate document_predicate, size_t top_k,
+        EvaluationMode mode) const {
+    return GetVersion()->FindTopDocuments(policy, raw_query,
+            document_predicate, top_k, mode);
+}
+
+template<typename DocumentPredicate>
+vector<Document> VersionedSearchServer::FindTopDocuments(string_view raw_query,
+        DocumentPredicate document_predicate, size_t top_k,
+        EvaluationMode mode) const {
+    return GetVersion()->FindTopDocuments(raw_query, document_predicate, top_k,
+            mode);
+}
+
+template<typename ExecutionPolicy>
+vector<Document> VersionedSearchServer::FindTopDocuments(
+        const ExecutionPolicy &policy, string_view raw_query,
+        DocumentStatus status, size_t top_k, EvaluationMode mode) const {
+    return GetVersion()->FindTopDocuments(policy, raw_query, status, top_k,
+            mode);
+}
+
+template<typename ExecutionPolicy>
+vector<Document> VersionedSearchServer::FindTopDocuments(
+        const ExecutionPolicy &policy, string_view raw_query) const {
+    return GetVersion()->FindTopDocuments(policy, raw_query);
+}
@@ -0,0 +1,52 @@
+#include <algorithm>
+
+#include "word_frequencies.h"
+
+using namespace std;
+
+WordFrequencies::WordFrequencies(const TermDictionary &dictionary,
+        const vector<PostingList> &postings, DocumentOrdinal ordinal,
+        const TermId *terms, const QuantizedTermCount *term_counts,
+        size_t size, double term_freq) :
+        dictionary_(&dictionary), postings_(&postings), ordinal_(ordinal),
+        terms_(terms), term_counts_(term_counts), size_(size),
+        term_freq_(term_freq) {
+}
+
+WordFrequencies::value_type WordFrequencies::operator[](size_t index) const {
+    return {dictionary_->GetTerm(terms_[index]),
+            GetTermCount(index) * term_freq_};
+}
+
+/**
+ * @brief TF слова в документе
+ *
+ *  Идентификатор слова ищется в словаре, затем - двоичным поиском среди
+ *  слов документа.
+ *
+ * @param word Слово
+ * @return TF слова или 0, если слова нет в документе
+ */
+double WordFrequencies::Get(string_view word) const {
+    if (size_ == 0) {
+        return 0.0;
+    }
+    const TermId term_id = dictionary_->Find(word);
+    const TermId *it = lower_bound(terms_, terms_ + size_, term_id);
+    if (it == terms_ + size_ || *it != term_id) {
+        return 0.0;
+    }
+    return GetTermCount(it - terms_) * term_freq_;
+}
+
+uint32_t WordFrequencies::GetTermCount(size_t index) const {
+    if (term_counts_[index] < MAX_QUANTIZED_TERM_COUNT) {
+        return term_counts_[index];
+    }
+    uint32_t term_count = MAX_QUANTIZED_TERM_COUNT;
+    (*postings_)[terms_[index]].ForEachInRange(ordinal_, ordinal_ + 1,
+            [&term_count](DocumentOrdinal, uint32_t count) {
+                term_count = count;
+            });
+    return term_count;
+}
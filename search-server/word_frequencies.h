@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "document.h"
+#include "posting_list.h"
+#include "term_dictionary.h"
+
+using namespace std;
+
+// количество вхождений слова в документ в прямом индексе документов
+// (количества, не меньшие MAX_QUANTIZED_TERM_COUNT, хранятся как
+// MAX_QUANTIZED_TERM_COUNT, точное значение - в списке документов слова)
+using QuantizedTermCount = uint16_t;
+constexpr QuantizedTermCount MAX_QUANTIZED_TERM_COUNT =
+        numeric_limits<QuantizedTermCount>::max();
+
+inline QuantizedTermCount QuantizeTermCount(uint32_t term_count) {
+    return term_count < MAX_QUANTIZED_TERM_COUNT ?
+            static_cast<QuantizedTermCount>(term_count) :
+            MAX_QUANTIZED_TERM_COUNT;
+}
+
+/**
+ * @brief Частоты слов (TF) документа без копирования
+ *
+ *  Представление части прямого индекса сервера: идентификаторов слов
+ *  документа (по возрастанию) и квантованных количеств их вхождений.
+ *  Элемент - пара {слово, TF}; элементы упорядочены по идентификатору
+ *  слова (порядку первого появления слова на сервере), а не по алфавиту.
+ *  Представление действительно, пока сервер не изменяется.
+ */
+class WordFrequencies {
+public:
+    using value_type = pair<string_view, double>;
+
+    class Iterator {
+    public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = WordFrequencies::value_type;
+        using difference_type = ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        Iterator(const WordFrequencies &frequencies, size_t index) :
+                frequencies_(&frequencies), index_(index) {
+        }
+
+        value_type operator*() const {
+            return (*frequencies_)[index_];
+        }
+        Iterator& operator++() {
+            ++index_;
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++index_;
+            return old;
+        }
+        bool operator==(const Iterator &other) const {
+            return index_ == other.index_;
+        }
+        bool operator!=(const Iterator &other) const {
+            return index_ != other.index_;
+        }
+
+    private:
+        const WordFrequencies *frequencies_;
+        size_t index_;
+    };
+
+    // пустое представление (документа нет)
+    WordFrequencies() = default;
+    // term_freq - TF одного вхождения слова (1 / количество слов документа)
+    WordFrequencies(const TermDictionary &dictionary,
+            const vector<PostingList> &postings, DocumentOrdinal ordinal,
+            const TermId *terms, const QuantizedTermCount *term_counts,
+            size_t size, double term_freq);
+
+    size_t size() const {
+        return size_;
+    }
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    Iterator begin() const {
+        return Iterator(*this, 0);
+    }
+    Iterator end() const {
+        return Iterator(*this, size_);
+    }
+
+    value_type operator[](size_t index) const;
+
+    // TF слова (0, если слова нет в документе)
+    double Get(string_view word) const;
+
+private:
+    const TermDictionary *dictionary_ = nullptr;
+    const vector<PostingList> *postings_ = nullptr;
+    DocumentOrdinal ordinal_ = 0;
+    const TermId *terms_ = nullptr;
+    const QuantizedTermCount *term_counts_ = nullptr;
+    size_t size_ = 0;
+    double term_freq_ = 0.0;
+
+    // точное количество вхождений слова с номером index
+    uint32_t GetTermCount(size_t index) const;
+};